@@ -0,0 +1,134 @@
+/* Optional reliable mode for the link layer (CONFIG_RPC_ARQ_WINDOW > 0).
+   Frames are sent with a link-level sequence number and kept until the
+   peer acknowledges them; lost frames are resent on a NAK or after a
+   timeout derived from the measured round-trip time (selective repeat).
+
+   Sequenced frame: [LINK_ARQ_MARKER][seq][flags][payload...]
+   SYN frame      : [LINK_ARQ_MARKER][seq][flags | SYN][session LE32][payload...]
+   ACK control    : [LINK_CTRL_MARKER][LINK_CTRL_ARQ_ACK][next expected seq]
+   NAK control    : [LINK_CTRL_MARKER][LINK_CTRL_ARQ_NAK][missing seq]
+   SYNC control   : [LINK_CTRL_MARKER][LINK_CTRL_ARQ_SYNC][dropped seq]
+
+   A receiver only joins a stream at a frame flagged LINK_ARQ_FLAG_SYN.
+   Until then it drops sequenced frames and answers each with a SYNC,
+   upon which the sender resends its oldest unacknowledged frame flagged
+   as SYN (or flags the next one if none is in flight).  A SYN carries
+   the session number the sender drew at boot; one of the session the
+   receiver follows is an ordinary frame, one of another session (the
+   peer rebooted) starts over, whatever its sequence number.
+
+   The receive side is always active, so a peer with ARQ enabled can talk
+   to one that has it disabled.  Each link keeps its own state.  Used by
+   link_layer.c only. */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "link_layer.h"
+#include "rpc_config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/timers.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define LINK_ARQ_MARKER          0x7E
+#define LINK_ARQ_HDR_LEN         3
+#define LINK_ARQ_FLAG_SYN        0x01  // first sequence number of a new sender
+#define LINK_ARQ_SYN_HDR_LEN     (LINK_ARQ_HDR_LEN + 4)  // with the session number
+
+/* Sequence numbers a receiver accepts ahead of the next one it expects.
+   Also the hard limit of frames in flight: the RX task may go past
+   CONFIG_RPC_ARQ_WINDOW up to this, as it cannot wait for room it frees
+   itself. */
+#define LINK_ARQ_RX_SLOTS        32
+
+#if CONFIG_RPC_ARQ_WINDOW > 0
+// Send side: one slot per frame in flight, indexed by seq % LINK_ARQ_RX_SLOTS
+typedef struct {
+    uint8_t *frame;    // the sequenced frame, pool block; NULL when free
+    uint16_t len;
+    uint8_t  tries;    // transmissions so far
+    bool     counted;  // holds one of the CONFIG_RPC_ARQ_WINDOW tx_room tokens
+    int64_t  sent_us;  // time of the last transmission
+} link_arq_tx_slot_t;
+#endif
+
+// ARQ state of one link, embedded in it; the fields are internal to link_arq.c
+typedef struct {
+    rpc_link_t *link;  // where ACKs, NAKs and resent frames go
+
+    // Receive side: in-order delivery state (RX task only)
+    struct {
+        uint8_t *data;   // payload held until its turn, pool block
+        uint16_t len;
+    } rx_hold[LINK_ARQ_RX_SLOTS];
+    bool    rx_synced;
+    uint8_t rx_deliver;   // next sequence number to hand up
+    uint8_t rx_next;      // lowest sequence number not received yet
+    bool    rx_nak_sent;
+    bool     rx_syn_seen;
+    uint32_t rx_session;  // of the SYN that started the current stream
+
+    uint32_t retransmits;
+    int64_t  srtt_us;
+
+#if CONFIG_RPC_ARQ_WINDOW > 0
+    link_arq_tx_slot_t tx[LINK_ARQ_RX_SLOTS];
+    uint8_t tx_base;              // oldest unacknowledged sequence number
+    uint8_t tx_next;              // sequence number of the next new frame
+    bool    tx_syn;               // next frame is the first one sent
+    uint32_t tx_session;          // drawn at boot, sent in every SYN
+    SemaphoreHandle_t tx_room;    // counts free window slots
+    SemaphoreHandle_t tx_lock;    // protects tx and the RTT estimate
+    TimerHandle_t     tx_timer;
+    bool    tx_timer_on;          // tx_timer started and not stopped since (tx_lock)
+    int64_t rttvar_us;
+    int64_t rto_us;
+#endif
+} link_arq_t;
+
+// Reset the state and create the window, timer and lock of link's ARQ; called on link setup
+void link_arq_init(link_arq_t *arq, rpc_link_t *link);
+
+// True if outgoing frames are sequenced
+bool link_arq_enabled(const link_arq_t *arq);
+
+/* Send a payload as a sequenced frame.  Waits up to
+   CONFIG_RPC_TX_QUEUE_WAIT_MS for room in the window; without may_wait
+   (the RX task, which processes the ACKs) it goes past the window
+   instead, up to the receiver's limit.  Returns as link_send_framev(),
+   -2 also when there was no room. */
+int link_arq_send(link_arq_t *arq, const phys_iovec_t *iov, size_t iovcnt, uint8_t flags, bool may_wait);
+
+/* Process a received sequenced frame of length bytes, of which buffer
+   holds the first buffer_size (RX task).  If it is the next one in
+   order, its payload is moved to the start of buffer, *out_len set to
+   its full length and 0 returned, or -4 if it did not fit (buffer then
+   holds what fit after the header).  Frames that
+   arrive early are held (unless truncated), duplicates are dropped.
+   Returns -1 if nothing is to be delivered now. */
+int link_arq_receive(link_arq_t *arq, uint8_t *buffer, uint16_t length, uint16_t buffer_size,
+                     uint16_t *out_len);
+
+/* Hand up the next held frame that is now in order: copies up to
+   buffer_size bytes into buffer and sets *out_len to its full length.
+   Returns false if there is none (RX task). */
+bool link_arq_next_held(link_arq_t *arq, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len);
+
+// Handle an ACK, NAK or SYNC control frame (RX task)
+void link_arq_control(link_arq_t *arq, uint8_t op, const uint8_t *frame, uint16_t len);
+
+// A corrupt frame arrived: ask for the next expected one right away (RX task)
+void link_arq_rx_error(link_arq_t *arq);
+
+/* Statistics: frames resent, and the smoothed round-trip time in
+   microseconds (0 before the first sample). */
+void link_arq_stats(const link_arq_t *arq, uint32_t *retransmits, uint32_t *srtt_us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,87 @@
+/* Channel bonding: one logical link over two member links (two UARTs,
+   say), for about twice the throughput of one.  Payloads of at least
+   CONFIG_RPC_BOND_STRIPE_MIN bytes are cut in two halves sent at the
+   same time, one per member; shorter ones go whole, on the members in
+   turn.  Every piece carries the message sequence number, and the
+   receiver hands messages up in that order, so the transport above sees
+   one ordered link.
+
+   Fragment: [LINK_BOND_MARKER][seq][index << 4 | count][total LE16][bytes...]
+   Fragment index of count carries bytes [index * stripe, ...) of the
+   total-byte message, stripe = ceil(total / count).
+
+   A message that stays incomplete while a later one is complete is
+   given up after CONFIG_RPC_BOND_REORDER_MS; use the reliable mode
+   (CONFIG_RPC_ARQ_WINDOW) on the members when nothing may be lost.
+   Frames without the marker (a peer that does not bond) are handed up
+   as they are.  Used by link_layer.c only. */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "link_layer.h"
+#include "rpc_config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define LINK_BOND_MARKER   0x7C
+#define LINK_BOND_HDR_LEN  5
+#define LINK_BOND_MEMBERS  2
+
+// Messages the receiver reassembles at once, counted from the next one it delivers
+#define LINK_BOND_SLOTS    8
+
+typedef struct link_bond link_bond_t;
+
+// A member link and the task that reads it
+typedef struct {
+    link_bond_t *bond;
+    rpc_link_t  *link;
+} link_bond_member_t;
+
+// Reassembly of one message
+typedef struct {
+    uint8_t  *data;   // pool block of total bytes; NULL when the slot is free
+    uint16_t  total;
+    uint8_t   count;  // fragments it was cut into
+    uint8_t   got;    // bit i set: fragment i arrived
+} link_bond_slot_t;
+
+// State of one bonded link; the fields are internal to link_bond.c
+struct link_bond {
+    link_bond_member_t members[LINK_BOND_MEMBERS];
+
+    portMUX_TYPE tx_lock;          // protects the two fields below
+    uint8_t      tx_seq;           // sequence number of the next message
+    uint8_t      tx_turn;          // member that carries the next whole message
+
+    SemaphoreHandle_t rx_lock;     // protects the slots, taken by the member tasks
+    SemaphoreHandle_t rx_ready;    // given when something may be deliverable
+    QueueHandle_t     rx_plain;    // unbonded frames from the members
+    link_bond_slot_t  rx[LINK_BOND_SLOTS];
+    uint8_t    rx_next;            // sequence number to deliver next
+    bool       rx_stalled;         // rx_next is missing while a later message is complete
+    TickType_t rx_stall_since;
+};
+
+/* Bond links a and b and start one task per member that receives its
+   frames.  Returns 0, or -1 if a resource could not be created. */
+int link_bond_init(link_bond_t *bond, rpc_link_t *a, rpc_link_t *b);
+
+/* Send a payload of up to LINK_MAX_IOV - 1 segments, striped or whole.
+   Returns as rpc_link_send_framev_until() on a member. */
+int link_bond_send(link_bond_t *bond, const phys_iovec_t *iov, size_t iovcnt, uint8_t flags,
+                   int64_t deadline_us);
+
+// Deliver the next message in order; returns as rpc_link_receive_frame()
+int link_bond_receive(link_bond_t *bond, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,10 +1,20 @@
 /* Implements framing for the link‑layer protocol described in the test task.
    The frame format is:
-   [0xFA][len_low][len_high][CRC_header][0xFB][payload][CRC_full][0xFE] */
+   [0xFA][len_low][len_high][CRC_header][0xFB][payload][CRC_full][0xFE]
+
+   Each link (rpc_link_t) runs over its own physical port with its own
+   TX queue, RX state and statistics.  link_init() sets up the default
+   link on the default port, which the functions without a link argument
+   use; boards with more peers add links with rpc_link_create(), and two
+   links to the same peer can be bonded into one (link_bond.h).  Nodes
+   further away, behind other boards or on a shared bus, are reached
+   through addressed frames (link_route.h). */
 
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include "physical.h"
+#include "rpc_codec.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -15,13 +25,225 @@ extern "C" {
 #define LINK_DATA_START_BYTE     0xFB
 #define LINK_STOP_BYTE           0xFE
 
+// Maximum number of payload segments accepted by link_send_framev()
+#define LINK_MAX_IOV             4
+
+/* Point out[] at len bytes of the iovcnt segments, starting off bytes
+   in.  Returns the number of segments used, at most iovcnt. */
+size_t link_iov_slice(const phys_iovec_t *iov, size_t iovcnt, size_t off, size_t len,
+                      phys_iovec_t *out);
+
+// Flags for link_send_framev_ex()
+#define LINK_TX_URGENT           0x01  // queue ahead of normal frames
+#define LINK_TX_SYNC             0x02  // write now from the calling task, bypassing the queue
+#define LINK_TX_UNSEQ            0x04  // never sequenced by the reliable mode (link_arq.h)
+#define LINK_TX_BULK             0x08  // queue behind normal frames
+#define LINK_TX_NOWAIT           0x10  // fail with -2 rather than wait for TX queue or ARQ window room
+
+// Bytes requested from the physical layer per receive call
+#define LINK_RX_CHUNK            128
+
+/* Link control frames: [LINK_CTRL_MARKER][op][args...].  They are
+   handled inside link_receive_frame() and never reach the transport,
+   whose message types do not use this value. */
+#define LINK_CTRL_MARKER         0x7F
+#define LINK_CTRL_BAUD_PROPOSE   0x01  // [baud LE32]: highest rate the sender accepts
+#define LINK_CTRL_BAUD_ACCEPT    0x02  // [baud LE32]: rate the sender has switched to
+#define LINK_CTRL_ARQ_ACK        0x03  // [seq]: all frames before seq arrived
+#define LINK_CTRL_ARQ_NAK        0x04  // [seq]: frame seq is missing
+#define LINK_CTRL_ARQ_SYNC       0x05  // [seq]: frame seq dropped, the receiver waits for a SYN
+
+/* With CONFIG_RPC_LINK_SPLIT_SIZE > 0, payloads longer than that (unless
+   urgent) are sent as several frames, so frames of other lanes can go
+   out between them:
+       [LINK_PART_MARKER][seq][index][count][bytes...]
+   The receiver joins them inside link_receive_frame() and drops a
+   payload whose parts do not arrive in order; it always understands
+   parts, whatever its own setting. */
+#define LINK_PART_MARKER         0x7B
+#define LINK_PART_HDR_LEN        4
+
+/* Most bytes the link layer puts in front of a payload inside one frame:
+   a sequence (link_arq.h), an address (link_route.h) and a bond header
+   (link_bond.h).  Payloads up to a frame limit less this arrive whole. */
+#define LINK_PAYLOAD_HDR_MAX     16
+
+
+// A link instance; see rpc_link_create()
+typedef struct rpc_link rpc_link_t;
 
+// Set up the default link on the default physical port (physical_init())
 void link_init(void);
 
+// The default link, valid after link_init()
+rpc_link_t *rpc_link_default(void);
+
+/* Open a further link on backend with phys_ctx (see physical.h, e.g. a
+   phys_uart_config_t for a second UART) and start its sender task.
+   The transport serves it once it is passed to transport_attach().
+   Returns NULL if the port or a resource could not be set up. */
+rpc_link_t *rpc_link_create(const phys_backend_t *backend, void *phys_ctx);
+
+/* Bond two links to the same peer into one logical link, which stripes
+   payloads of CONFIG_RPC_BOND_STRIPE_MIN bytes or more across both and
+   delivers in order (link_bond.h).  The peer must bond its two links in
+   the same way.  From then on a and b are only used through the bond:
+   attach the bond to the transport, not its members.  A bond takes
+   payloads of up to LINK_MAX_IOV - 1 segments.  Returns NULL on error. */
+rpc_link_t *rpc_link_bond(rpc_link_t *a, rpc_link_t *b);
+
+/* Address of this node on link (0: none, the default
+   CONFIG_RPC_NODE_ADDRESS); on a view, that of its link.  Frames
+   addressed to it are taken, others routed. */
+void    rpc_link_set_address(rpc_link_t *link, uint8_t address);
+uint8_t rpc_link_get_address(const rpc_link_t *link);
+
+/* A link to the remote node reached over via, which needs an address
+   of its own: frames sent on it are addressed to node, and it receives
+   what node sends to this one.  Attach it to the transport like any
+   link; via itself is read by a routing task from then on and must not
+   be attached later (if it is attached already, its RX task does the
+   routing).  One view per node, sending up to LINK_MAX_IOV - 1
+   segments.  Returns NULL on bad arguments or error. */
+rpc_link_t *rpc_link_remote(rpc_link_t *via, uint8_t node);
+
+/* Forward frames for node that arrive on other links out on via (for a
+   view, its link), which is read by the routing task from then on
+   unless it is attached already, as for rpc_link_remote(); a view of
+   node is a route to it already.  Returns 0, -1 on bad
+   arguments, -2 when CONFIG_RPC_ROUTES are set, or -1 if the task
+   could not be started. */
+int rpc_link_add_route(uint8_t node, rpc_link_t *via);
+
+// One pointer the link's owner may keep with it (the transport's per-link state)
+void  rpc_link_set_context(rpc_link_t *link, void *context);
+void *rpc_link_get_context(const rpc_link_t *link);
+
+/* The functions below on a given link; the ones without a link argument
+   act on the default link.  Only one task may receive from a link. */
+int      rpc_link_send_framev(rpc_link_t *link, const phys_iovec_t *iov, size_t iovcnt, uint8_t flags);
+
+/* rpc_link_send_framev() for a frame that is stale after deadline_us
+   (esp_timer_get_time() clock, 0 for none): it is dropped, and -7
+   returned, if it could not be handed over in time, and dropped by the
+   sender task if still queued then.  Sequenced frames (reliable mode)
+   are always sent once handed over. */
+int      rpc_link_send_framev_until(rpc_link_t *link, const phys_iovec_t *iov, size_t iovcnt,
+                                    uint8_t flags, int64_t deadline_us);
+int      rpc_link_receive_frame(rpc_link_t *link, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len);
+
+/* A frame built ahead of time for a payload that goes out many times
+   with only a few bytes changed, such as a cached response whose request
+   ID differs per reply.  Up to LINK_PATCH_MAX bytes at patch_off can be
+   replaced on each send; as the CRC is linear, its change from flipping
+   each of their bits is kept, so the frame is never walked again. */
+#define LINK_PATCH_MAX           2
+#define LINK_FRAME_OVERHEAD      7   // header (5) and trailer (2) bytes around the payload
+
+typedef struct {
+    uint16_t len;          // frame length, payload + LINK_FRAME_OVERHEAD
+    uint16_t patch_off;    // payload offset of the replaceable bytes
+    uint8_t  patch_len;
+    uint8_t  crc_delta[LINK_PATCH_MAX * 8];  // CRC change per replaceable bit
+    uint8_t  data[];       // the frame, unstuffed
+} link_prebuilt_t;
+
+/* Frame a payload given as segments into a new heap block (vPortFree
+   it).  Returns NULL on bad arguments or when out of memory. */
+link_prebuilt_t *link_prebuild(const phys_iovec_t *iov, size_t iovcnt, uint16_t patch_off, uint8_t patch_len);
+
+// The payload inside a prebuilt frame
+static inline const uint8_t *link_prebuilt_payload(const link_prebuilt_t *frame, uint16_t *len) {
+    *len = (uint16_t)(frame->len - LINK_FRAME_OVERHEAD);
+    return frame->data + 5;
+}
+
+/* Send a prebuilt frame with its replaceable bytes set to patch; the
+   frame itself is left as it is, so several tasks may send it at once.
+   Returns as rpc_link_send_framev(), or -5 if frames on this link are
+   transformed further on the way out (bonded, sequenced, stuffed or
+   split): the caller then sends the payload the usual way. */
+int      rpc_link_send_prebuilt(rpc_link_t *link, const link_prebuilt_t *frame, const uint8_t *patch,
+                                uint8_t flags);
+size_t   rpc_link_tx_queued(rpc_link_t *link);
+int      rpc_link_negotiate_baudrate(rpc_link_t *link, uint32_t timeout_ms);
+uint32_t rpc_link_get_baudrate(const rpc_link_t *link);
+
 int link_send_frame(const uint8_t *payload, uint16_t length);
 
+/* Send one frame whose payload is the concatenation of iovcnt segments.
+   The CRC is computed over the segments incrementally.  With the TX queue
+   enabled (CONFIG_RPC_TX_QUEUE_LEN) the frame is copied and handed to the
+   sender task, and 0 means it was queued; otherwise the segments go to
+   the physical layer as-is.  Returns 0 on success, -1 on bad arguments or
+   a payload above 65535 bytes, -2 when the TX queue stayed full for
+   CONFIG_RPC_TX_QUEUE_WAIT_MS, -3 on a write error.
+   In reliable mode (CONFIG_RPC_ARQ_WINDOW) frames are sequenced and
+   resent until acknowledged; -2 then also means the window stayed full. */
+int link_send_framev(const phys_iovec_t *iov, size_t iovcnt);
+
+// link_send_framev() with LINK_TX_* flags
+int link_send_framev_ex(const phys_iovec_t *iov, size_t iovcnt, uint8_t flags);
+
+// Frames waiting in the TX queue (both lanes), for back-pressure decisions
+size_t link_tx_queued(void);
+
+/* Receive the next valid frame into buffer.  Returns 0 on success.
+   Returns -4 for a valid frame longer than buffer_size: *out_len is set
+   to the full length and buffer holds its first buffer_size bytes, so
+   the caller can still tell the peer what was dropped. */
 int link_receive_frame(uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len);
 
+/* Agree with the peer on the highest standard baud rate both accept
+   and switch to it.  Both sides start at PHYS_UART_BAUDRATE; call this
+   before RPC traffic starts, while the RX task is receiving (it answers
+   the peer and delivers its reply).  Returns the rate now in use, -3 on
+   a write error or -5 when the peer did not answer within timeout_ms.
+   On a bond each member negotiates on its own; the slower rate is
+   returned. */
+int link_negotiate_baudrate(uint32_t timeout_ms);
+
+// Baud rate the link currently runs at
+uint32_t link_get_baudrate(void);
+
+/* Link statistics since boot (CONFIG_RPC_STATS), as an rpc_codec.h
+   record so "__stats" can send it as is:
+   frames_sent       - frames written or queued for the sender task,
+                       resent and control frames included
+   frames_received   - frames with a valid CRC and stop byte
+   header_crc_errors - headers rejected by their CRC
+   crc_errors        - frames rejected by the full CRC
+   framing_errors    - missing data start or stop byte, or a frame cut
+                       off by CONFIG_RPC_LINK_BYTE_TIMEOUT_MS or a new start
+   resyncs           - rejected headers searched again from a start byte
+                       found inside them
+   oversize_drops    - frames longer than CONFIG_RPC_LINK_MAX_PAYLOAD or
+                       the receive buffer
+   stray_bytes       - bytes skipped while hunting for a start byte
+   retransmits       - frames resent by the reliable mode (link_arq.h)
+   deadline_drops    - frames dropped unsent as their deadline had passed
+                       (rpc_link_send_framev_until())
+   forwarded         - addressed frames sent on towards another node
+   route_drops       - addressed frames neither delivered nor forwarded:
+                       no view of the sender, hop limit reached, cut
+                       short, or no room on the way out */
+#define LINK_STATS_FIELDS(X)                                                   \
+    X(var, frames_sent) X(var, frames_received)                                \
+    X(var, header_crc_errors) X(var, crc_errors) X(var, framing_errors)        \
+    X(var, resyncs) X(var, oversize_drops) X(var, stray_bytes)                 \
+    X(var, retransmits) X(var, deadline_drops)                                 \
+    X(var, forwarded) X(var, route_drops)
+RPC_CODEC_STRUCT(link_stats, LINK_STATS_FIELDS)
+
+// Copy the current counters (all zero without CONFIG_RPC_STATS)
+void link_get_stats(link_stats_t *out);
+
+// Counters of one link; those of a bond are the sums over its members
+void rpc_link_get_stats(const rpc_link_t *link, link_stats_t *out);
+
+// CRC-8 (poly 0x07, init 0) used for the header and full-frame checksums
+uint8_t link_crc8(const uint8_t *data, size_t length);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+/* Node addressing and store-and-forward routing, for chains of boards
+   and shared buses (RS-485) where one link reaches more than one node.
+
+   Addressed frame: [LINK_ADDR_MARKER][dst][src][hops][payload...]
+   A node talks to a remote node through a view (rpc_link_remote()):
+   frames sent on it get the header, and frames from that node come out
+   of it with the header taken off, so the transport above sees an
+   ordinary point-to-point link.  Every other addressed frame is
+   handled inside rpc_link_receive_frame(): one for another node is sent
+   on towards it as it is, with hops counted down, and never back out of
+   the link it came in on (on a bus, frames for the other nodes are
+   simply not ours).  The transport never parses a forwarded message.
+   Used by link_layer.c only. */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "link_layer.h"
+#include "rpc_config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define LINK_ADDR_MARKER   0x7D
+#define LINK_ADDR_HDR_LEN  4
+
+// A remote node seen through the link that reaches it; internal to link_route.c
+typedef struct link_route_view link_route_view_t;
+struct link_route_view {
+    rpc_link_t        *base;   // the link that carries its frames
+    uint8_t            node;
+    QueueHandle_t      rx;     // frames from it, pool allocated
+    link_route_view_t *next;
+};
+
+// What became of an addressed frame handed to link_route_input()
+typedef enum {
+    LINK_ROUTE_DELIVERED,  // queued on the view of its sender
+    LINK_ROUTE_FORWARDED,  // sent on towards its destination
+    LINK_ROUTE_IGNORED,    // for a node this one does not lead to
+    LINK_ROUTE_DROPPED,    // hop limit reached, no view of its sender, or no room
+} link_route_result_t;
+
+/* Set up view for node behind base and add it to the views searched by
+   link_route_input().  Returns 0, or -1 if a resource could not be
+   created. */
+int link_route_view_init(link_route_view_t *view, rpc_link_t *base, uint8_t node);
+
+/* Record that frames for node go out on via.  Returns 0, or -2 when
+   CONFIG_RPC_ROUTES routes are set. */
+int link_route_add(uint8_t node, rpc_link_t *via);
+
+/* Start the task that reads base, so the frames arriving on it are
+   routed with nobody else receiving from it.  Once per link. */
+int link_route_start(rpc_link_t *base);
+
+/* Send a payload of up to LINK_MAX_IOV - 1 segments to the node of
+   view, from address src.  Returns as rpc_link_send_framev_until(). */
+int link_route_send(link_route_view_t *view, uint8_t src, const phys_iovec_t *iov, size_t iovcnt,
+                    uint8_t flags, int64_t deadline_us);
+
+// Deliver the next frame from the node of view; returns as rpc_link_receive_frame()
+int link_route_receive(link_route_view_t *view, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len);
+
+/* Route an addressed frame of len bytes (have of them in frame, fewer
+   if it was truncated) that arrived on link from, whose own address is
+   self.  Called from the receiving task of from. */
+link_route_result_t link_route_input(rpc_link_t *from, uint8_t self, const uint8_t *frame,
+                                     uint16_t len, uint16_t have);
+
+#ifdef __cplusplus
+}
+#endif
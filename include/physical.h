@@ -1,6 +1,17 @@
+/* Physical layer: moves bytes between this node and its peer.  The
+   functions below are the same for every medium; the work is done by a
+   backend (phys_backend_t), chosen with "Physical link" in Kconfig or at
+   run time with physical_set_backend().  Boards with several links open
+   one phys_port_t per medium; the functions without a port argument
+   use the default one. */
+
 #pragma once
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/stream_buffer.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -10,17 +21,152 @@ extern "C" {
 #define PHYS_UART_NUM      UART_NUM_1
 #define PHYS_UART_TX_PIN   17
 #define PHYS_UART_RX_PIN   16
-#define PHYS_UART_BAUDRATE 115200
+#define PHYS_UART_BAUDRATE 115200   // rate both sides start at (see link_negotiate_baudrate())
+
+// Timeout value for physical_receive() that waits without limit
+#define PHYS_WAIT_FOREVER  UINT32_MAX
+
+// One segment of a scatter-gather write
+typedef struct {
+    const void *base;
+    size_t      len;
+} phys_iovec_t;
+
+/* A physical-layer backend.  Every function gets the ctx the port was
+   opened with (physical_port_init()), so one backend can drive several
+   ports.  physical.c keeps the writes of one physical_port_sendv()
+   together with a mutex per port, and read() is only called from that
+   port's RX task, so backends need no locking of their own. */
+typedef struct {
+    const char *name;
+
+    // Context used by ports opened with ctx == NULL (the Kconfig settings)
+    void *default_ctx;
+
+    // Bring the medium up.  Returns 0 or negative on error
+    int (*init)(void *ctx);
+
+    // Write all len bytes, waiting for room as needed.  Returns len or negative
+    int (*write)(void *ctx, const uint8_t *data, size_t len);
+
+    /* Called after the last write of a physical_port_sendv() (NULL if
+       not needed).  Datagram media send what was written as one packet
+       here. */
+    int (*flush)(void *ctx);
+
+    /* Wait up to timeout_ms (PHYS_WAIT_FOREVER for no limit) for the
+       first byte, then return what has arrived, up to max_len bytes.
+       Returns the number of bytes, 0 on timeout or negative on error */
+    int (*read)(void *ctx, uint8_t *buf, size_t max_len, uint32_t timeout_ms);
+
+    /* Change the line rate after the bytes already written have left.
+       NULL for media without one; physical_port_set_baudrate() then
+       succeeds without doing anything. */
+    int (*set_baudrate)(void *ctx, uint32_t baud);
+} phys_backend_t;
+
+/* Built-in backends.  UART, in-memory loopback and UDP are always
+   available; USB Serial/JTAG on chips that have it (SOC_USB_SERIAL_JTAG_SUPPORTED). */
+extern const phys_backend_t phys_uart_backend;       // ctx: phys_uart_config_t
+extern const phys_backend_t phys_mem_backend;        // ctx: phys_mem_t, no hardware
+extern const phys_backend_t phys_usb_jtag_backend;   // native USB Serial/JTAG port (ESP32-S3, -C3, ...), no ctx
+extern const phys_backend_t phys_udp_backend;        // ctx: phys_udp_t
+
+/* Settings of one UART port.  The default context is PHYS_UART_NUM on
+   PHYS_UART_TX_PIN/PHYS_UART_RX_PIN, with the flow control and loopback
+   chosen in Kconfig. */
+typedef struct {
+    int  uart_num;
+    int  tx_pin;
+    int  rx_pin;
+    int  rts_pin;    // RTS/CTS flow control when both pins are >= 0
+    int  cts_pin;
+    bool loopback;   // TX wired to RX inside the peripheral, pins stay idle
+} phys_uart_config_t;
+
+/* An in-memory port.  Bytes written are read back by the port itself,
+   or by its peer after phys_mem_pair(), which lets one board run both
+   ends of a link.  Zero-initialize; init() creates the buffer. */
+typedef struct phys_mem {
+    struct phys_mem     *peer;  // receives what this port writes; NULL: the port itself
+    StreamBufferHandle_t rx;
+} phys_mem_t;
 
-// Initialize physical layer: configures UART
+// Cross-connect two in-memory ports; call before opening either of them
+void phys_mem_pair(phys_mem_t *a, phys_mem_t *b);
+
+/* A UDP port (see phys_udp.c).  Fill in the first three fields; the rest
+   belongs to the backend. */
+typedef struct {
+    uint16_t     local_port;
+    const char  *peer_addr;    // dotted IPv4 address; "" answers whoever sent last
+    uint16_t     peer_port;
+
+    int          sock;
+    portMUX_TYPE peer_lock;    // the RX task may learn a new peer
+    uint32_t     peer_ip;      // network byte order
+    uint16_t     peer_port_n;  // network byte order
+    bool         peer_known;
+    uint8_t     *tx_buf;       // CONFIG_RPC_UDP_MTU bytes each, allocated by init()
+    size_t       tx_len;
+    uint8_t     *rx_buf;
+    size_t       rx_pos;
+    size_t       rx_len;
+} phys_udp_t;
+
+/* One open medium: a backend with its context.  physical_init() sets up
+   the default port; further ones are opened with physical_port_init(),
+   usually by rpc_link_create().  The fields are internal. */
+typedef struct {
+    const phys_backend_t *backend;
+    void                 *ctx;
+    SemaphoreHandle_t     tx_mutex;   // keeps segments of one write together
+    bool                  installed;
+} phys_port_t;
+
+/* Open port on backend with ctx (NULL: the backend's default context).
+   Returns 0, or -1 if the backend is incomplete or did not come up. */
+int physical_port_init(phys_port_t *port, const phys_backend_t *backend, void *ctx);
+
+// The port behind physical_init() and the functions without a port argument
+phys_port_t *physical_default_port(void);
+
+// physical_set_baudrate(), physical_sendv() and physical_receive() on a given port
+int physical_port_set_baudrate(phys_port_t *port, uint32_t baud);
+int physical_port_sendv(phys_port_t *port, const phys_iovec_t *iov, size_t iovcnt);
+int physical_port_receive(phys_port_t *port, uint8_t *buf, size_t max_len, uint32_t timeout_ms);
+
+/* Use backend for the default port instead of the one selected in
+   Kconfig.  Call before physical_init(); later calls fail.  Returns 0 or -1. */
+int physical_set_backend(const phys_backend_t *backend);
+
+// Backend of the default port
+const phys_backend_t *physical_get_backend(void);
+
+// Initialize physical layer: brings up the default port
 void physical_init(void);
 
-// Write len bytes to UART. Returns number of bytes written or negative on error
+/* Switch the UART to a new baud rate.  Waits for bytes already queued for
+   transmission to leave at the old rate first.  Returns 0 or negative on
+   error; media without a line rate accept any value */
+int physical_set_baudrate(uint32_t baud);
+
+// Write len bytes to the peer. Returns number of bytes written or negative on error
 int physical_send(const uint8_t *data, size_t len);
 
-// Read one byte from UART. Blocks until data is available. Returns 1 or negative on error
+/* Write iovcnt segments back to back without interleaving with other
+   senders. Returns total number of bytes written or negative on error */
+int physical_sendv(const phys_iovec_t *iov, size_t iovcnt);
+
+// Read one byte. Blocks until data is available. Returns 1 or negative on error
 int physical_receive_byte(uint8_t *byte);
 
+/* Read whatever is available, up to max_len bytes.  Waits up to
+   timeout_ms (PHYS_WAIT_FOREVER for no limit) for the first byte, then
+   returns without waiting for more.  Returns the number of bytes read,
+   0 on timeout or negative on error */
+int physical_receive(uint8_t *buf, size_t max_len, uint32_t timeout_ms);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,7 @@
 
 #pragma once
 #include <stdint.h>
+#include "rpc_codec.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -8,6 +9,12 @@ extern "C" {
 // Declarations of RPC functions. 
 void rpc_app_init(void);
 
+// "sum": two uint32 arguments in, their uint32 sum out (rpc_codec.h records)
+#define RPC_SUM_ARGS(X)    X(u32, a) X(u32, b)
+#define RPC_SUM_RESULT(X)  X(u32, sum)
+RPC_CODEC_STRUCT(rpc_sum_args, RPC_SUM_ARGS)
+RPC_CODEC_STRUCT(rpc_sum_result, RPC_SUM_RESULT)
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,31 @@
+/* On-target micro-benchmarks for the RPC stack (CONFIG_RPC_BENCH). */
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Run all benchmarks and print the results.  Blocks the calling task.
+void rpc_bench_run(void);
+
+// CRC-8: table-driven link_crc8() against the original bitwise loop
+void rpc_bench_crc8(void);
+
+/* End-to-end calls over a looped-back link.  Each prints calls/s, payload
+   bytes/s and p50/p99/p999 latency for CONFIG_RPC_BENCH_CALLS calls. */
+
+// "echo" with payloads from 1 B to 64 KB, as far as the frame size limits allow
+void rpc_bench_payload(void);
+
+// "sum" from 1, 2, 4 and 8 tasks at once (at most CONFIG_RPC_MAX_PENDING_CALLS)
+void rpc_bench_concurrency(void);
+
+/* 256-byte "echo" at each standard rate up to CONFIG_RPC_UART_MAX_BAUDRATE.
+   Loopback links with a baud rate only (UART), since only this side
+   switches. */
+void rpc_bench_baudrate(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,45 @@
+/* Server-side response cache for functions registered with
+   RPC_FLAG_CACHEABLE (CONFIG_RPC_CACHE_ENTRIES > 0).  An entry is keyed
+   by the function, the form of the reply header (the MSG_FLAG_* bits of
+   the request) and the request args.  It holds the response message as a
+   prebuilt link frame (link_prebuild()) whose request ID is patched per
+   reply, so a hit skips the handler, compression, framing and the CRC
+   pass.  Entries are served until their TTL runs out; when every slot is
+   taken the least recently used one makes room.  Used by transport.c
+   only. */
+
+#pragma once
+#include <stdint.h>
+#include "link_layer.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct rpc_cache_entry rpc_cache_entry_t;
+
+// Create the cache lock; transport_init() calls it
+void rpc_cache_init(void);
+
+/* Find a live entry for the key.  It stays valid, even if replaced or
+   dropped meanwhile, until rpc_cache_release().  Returns NULL on a miss. */
+rpc_cache_entry_t *rpc_cache_get(const void *func, uint8_t form, const uint8_t *args, uint16_t args_len);
+
+// The response frame of an entry from rpc_cache_get()
+const link_prebuilt_t *rpc_cache_frame(const rpc_cache_entry_t *entry);
+
+// Give back an entry from rpc_cache_get()
+void rpc_cache_release(rpc_cache_entry_t *entry);
+
+/* Store the response frame (a link_prebuild() block, which the cache
+   takes over in any case) for the key, to be served for ttl_ms.  An
+   older entry for the same key is replaced. */
+void rpc_cache_put(const void *func, uint8_t form, const uint8_t *args, uint16_t args_len,
+                   link_prebuilt_t *frame, uint32_t ttl_ms);
+
+// Drop every entry of func (NULL: all entries)
+void rpc_cache_drop(const void *func);
+
+#ifdef __cplusplus
+}
+#endif
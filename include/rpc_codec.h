@@ -0,0 +1,252 @@
+/* Compact binary encoding for RPC arguments and responses.
+   Values are written in order with no tags or padding:
+     u8/u16/u32/u64 - fixed width, little-endian
+     var            - unsigned LEB128 varint (1..5 bytes for 32 bits)
+     svar           - signed varint, zigzag mapped (-1 -> 1, 1 -> 2, ...)
+     bytes          - varint length followed by the raw bytes
+   The writer fills a caller-provided buffer and the reader walks one in
+   place, so neither allocates.  Both latch an error flag instead of
+   failing each call: encode or decode everything, then check it once.
+
+   Records of scalar fields can be described once with an X-macro and
+   get a struct plus encoder/decoder generated:
+       #define SUM_ARGS(X) X(u32, a) X(u32, b)
+       RPC_CODEC_STRUCT(sum_args, SUM_ARGS)
+   defines sum_args_t, sum_args_put(), sum_args_get() and the
+   constant sum_args_MAX_SIZE.  RPC_DEFINE_CALL / RPC_DEFINE_HANDLER in
+   transport.h turn such records into typed client and server stubs. */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct {
+    uint8_t  *buf;
+    uint16_t  cap;
+    uint16_t  len;       // bytes written so far
+    bool      overflow;  // a value did not fit; len stops growing
+} rpc_writer_t;
+
+typedef struct {
+    const uint8_t *buf;
+    uint16_t       len;
+    uint16_t       pos;    // bytes consumed so far
+    bool           error;  // ran past the end or hit a malformed varint
+} rpc_reader_t;
+
+// A length-prefixed byte string; when decoded, data points into the reader's buffer
+typedef struct {
+    const uint8_t *data;
+    uint16_t       len;
+} rpc_bytes_t;
+
+
+static inline void rpc_writer_init(rpc_writer_t *w, uint8_t *buf, uint16_t cap) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->overflow = false;
+}
+
+// Reserve n bytes at the end of the output; NULL (and overflow set) if they do not fit
+static inline uint8_t *rpc_put_reserve(rpc_writer_t *w, uint16_t n) {
+    if (w->overflow || n > (uint16_t)(w->cap - w->len)) {
+        w->overflow = true;
+        return NULL;
+    }
+    uint8_t *p = w->buf + w->len;
+    w->len = (uint16_t)(w->len + n);
+    return p;
+}
+
+static inline void rpc_put_u8(rpc_writer_t *w, uint8_t v) {
+    uint8_t *p = rpc_put_reserve(w, 1);
+    if (p) p[0] = v;
+}
+
+static inline void rpc_put_u16(rpc_writer_t *w, uint16_t v) {
+    uint8_t *p = rpc_put_reserve(w, 2);
+    if (!p) return;
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void rpc_put_u32(rpc_writer_t *w, uint32_t v) {
+    uint8_t *p = rpc_put_reserve(w, 4);
+    if (!p) return;
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline void rpc_put_u64(rpc_writer_t *w, uint64_t v) {
+    uint8_t *p = rpc_put_reserve(w, 8);
+    if (!p) return;
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline void rpc_put_var(rpc_writer_t *w, uint32_t v) {
+    uint8_t tmp[5];
+    uint16_t n = 0;
+    do {
+        tmp[n] = (uint8_t)(v & 0x7F);
+        v >>= 7;
+        if (v) tmp[n] |= 0x80;
+        n++;
+    } while (v);
+    uint8_t *p = rpc_put_reserve(w, n);
+    if (p) memcpy(p, tmp, n);
+}
+
+static inline void rpc_put_svar(rpc_writer_t *w, int32_t v) {
+    rpc_put_var(w, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+static inline void rpc_put_bytes(rpc_writer_t *w, rpc_bytes_t b) {
+    rpc_put_var(w, b.len);
+    uint8_t *p = rpc_put_reserve(w, b.len);
+    if (p && b.len > 0) memcpy(p, b.data, b.len);
+}
+
+// A C string as bytes, without its terminator
+static inline void rpc_put_str(rpc_writer_t *w, const char *s) {
+    const size_t n = strlen(s);
+    const rpc_bytes_t b = { (const uint8_t *)s, (uint16_t)((n < UINT16_MAX) ? n : UINT16_MAX) };
+    rpc_put_bytes(w, b);
+}
+
+
+static inline void rpc_reader_init(rpc_reader_t *r, const uint8_t *buf, uint16_t len) {
+    r->buf = buf;
+    r->len = len;
+    r->pos = 0;
+    r->error = false;
+}
+
+// True if everything decoded so far was valid and all input was consumed
+static inline bool rpc_reader_done(const rpc_reader_t *r) {
+    return !r->error && r->pos == r->len;
+}
+
+// Consume n bytes; NULL (and error set) if fewer remain
+static inline const uint8_t *rpc_get_take(rpc_reader_t *r, uint16_t n) {
+    if (r->error || n > (uint16_t)(r->len - r->pos)) {
+        r->error = true;
+        return NULL;
+    }
+    const uint8_t *p = r->buf + r->pos;
+    r->pos = (uint16_t)(r->pos + n);
+    return p;
+}
+
+/* The getters store 0 (or an empty string) on error, so a record decoded
+   from short input never holds stale values. */
+static inline bool rpc_get_u8(rpc_reader_t *r, uint8_t *v) {
+    const uint8_t *p = rpc_get_take(r, 1);
+    *v = p ? p[0] : 0;
+    return p != NULL;
+}
+
+static inline bool rpc_get_u16(rpc_reader_t *r, uint16_t *v) {
+    const uint8_t *p = rpc_get_take(r, 2);
+    *v = p ? (uint16_t)(p[0] | (p[1] << 8)) : 0;
+    return p != NULL;
+}
+
+static inline bool rpc_get_u32(rpc_reader_t *r, uint32_t *v) {
+    const uint8_t *p = rpc_get_take(r, 4);
+    uint32_t x = 0;
+    if (p) {
+        for (int i = 0; i < 4; i++) x |= (uint32_t)p[i] << (8 * i);
+    }
+    *v = x;
+    return p != NULL;
+}
+
+static inline bool rpc_get_u64(rpc_reader_t *r, uint64_t *v) {
+    const uint8_t *p = rpc_get_take(r, 8);
+    uint64_t x = 0;
+    if (p) {
+        for (int i = 0; i < 8; i++) x |= (uint64_t)p[i] << (8 * i);
+    }
+    *v = x;
+    return p != NULL;
+}
+
+static inline bool rpc_get_var(rpc_reader_t *r, uint32_t *v) {
+    uint32_t x = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        const uint8_t *p = rpc_get_take(r, 1);
+        if (!p) break;
+        x |= (uint32_t)(p[0] & 0x7F) << shift;
+        if (!(p[0] & 0x80)) {
+            *v = x;
+            return true;
+        }
+    }
+    r->error = true;  // truncated, or longer than 5 bytes
+    *v = 0;
+    return false;
+}
+
+static inline bool rpc_get_svar(rpc_reader_t *r, int32_t *v) {
+    uint32_t z = 0;
+    const bool ok = rpc_get_var(r, &z);
+    *v = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+    return ok;
+}
+
+static inline bool rpc_get_bytes(rpc_reader_t *r, rpc_bytes_t *b) {
+    uint32_t n = 0;
+    const uint8_t *p = NULL;
+    if (rpc_get_var(r, &n) && n <= UINT16_MAX) {
+        p = rpc_get_take(r, (uint16_t)n);
+    } else {
+        r->error = true;
+    }
+    b->data = p;
+    b->len  = p ? (uint16_t)n : 0;
+    return p != NULL;
+}
+
+
+// C type and largest encoded size of each scalar kind, for RPC_CODEC_STRUCT
+#define RPC_CODEC_CTYPE_u8    uint8_t
+#define RPC_CODEC_CTYPE_u16   uint16_t
+#define RPC_CODEC_CTYPE_u32   uint32_t
+#define RPC_CODEC_CTYPE_u64   uint64_t
+#define RPC_CODEC_CTYPE_var   uint32_t
+#define RPC_CODEC_CTYPE_svar  int32_t
+#define RPC_CODEC_SIZE_u8     1
+#define RPC_CODEC_SIZE_u16    2
+#define RPC_CODEC_SIZE_u32    4
+#define RPC_CODEC_SIZE_u64    8
+#define RPC_CODEC_SIZE_var    5
+#define RPC_CODEC_SIZE_svar   5
+
+#define RPC_CODEC_FIELD_(kind, field) RPC_CODEC_CTYPE_##kind field;
+#define RPC_CODEC_PUT_(kind, field)   rpc_put_##kind(w, v->field);
+#define RPC_CODEC_GET_(kind, field)   rpc_get_##kind(r, &v->field);
+#define RPC_CODEC_SIZE_(kind, field)  + RPC_CODEC_SIZE_##kind
+
+/* Define name_t with the fields listed by FIELDS(X), its encoder
+   name_put(), its decoder name_get() (true only if the input held
+   exactly one valid record) and name_MAX_SIZE. */
+#define RPC_CODEC_STRUCT(name, FIELDS)                                         \
+    typedef struct { FIELDS(RPC_CODEC_FIELD_) } name##_t;                      \
+    enum { name##_MAX_SIZE = 0 FIELDS(RPC_CODEC_SIZE_) };                      \
+    static inline void name##_put(rpc_writer_t *w, const name##_t *v) {        \
+        FIELDS(RPC_CODEC_PUT_)                                                 \
+    }                                                                          \
+    static inline bool name##_get(rpc_reader_t *r, name##_t *v) {              \
+        FIELDS(RPC_CODEC_GET_)                                                 \
+        return rpc_reader_done(r);                                             \
+    }
+
+#ifdef __cplusplus
+}
+#endif
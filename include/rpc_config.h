@@ -0,0 +1,203 @@
+/* Build-time tunables of the RPC stack.  Values come from Kconfig
+   (menuconfig -> "RPC protocol", see src/Kconfig.projbuild); the
+   defaults below apply when a symbol is missing from sdkconfig. */
+
+#pragma once
+#include "sdkconfig.h"
+
+
+// UART driver (phys_uart.c; phys_mem.c and phys_usb_jtag.c reuse the ring sizes)
+#ifndef CONFIG_RPC_UART_RX_BUFFER_SIZE
+#define CONFIG_RPC_UART_RX_BUFFER_SIZE 1024
+#endif
+
+#ifndef CONFIG_RPC_UART_TX_BUFFER_SIZE
+#define CONFIG_RPC_UART_TX_BUFFER_SIZE 1024
+#endif
+
+#ifndef CONFIG_RPC_UART_RTS_PIN
+#define CONFIG_RPC_UART_RTS_PIN 18
+#endif
+
+#ifndef CONFIG_RPC_UART_CTS_PIN
+#define CONFIG_RPC_UART_CTS_PIN 19
+#endif
+
+// UDP backend (phys_udp.c)
+#ifndef CONFIG_RPC_UDP_LOCAL_PORT
+#define CONFIG_RPC_UDP_LOCAL_PORT 5005
+#endif
+
+#ifndef CONFIG_RPC_UDP_PEER_ADDR
+#define CONFIG_RPC_UDP_PEER_ADDR ""
+#endif
+
+#ifndef CONFIG_RPC_UDP_PEER_PORT
+#define CONFIG_RPC_UDP_PEER_PORT 5005
+#endif
+
+#ifndef CONFIG_RPC_UDP_MTU
+#define CONFIG_RPC_UDP_MTU 1472
+#endif
+
+// Baud rate negotiation (link_layer.c)
+#ifndef CONFIG_RPC_UART_MAX_BAUDRATE
+#define CONFIG_RPC_UART_MAX_BAUDRATE 921600
+#endif
+
+#ifndef CONFIG_RPC_BAUD_FALLBACK_ERRORS
+#define CONFIG_RPC_BAUD_FALLBACK_ERRORS 8
+#endif
+
+// Receive-side framing limits (link_layer.c)
+#ifndef CONFIG_RPC_LINK_MAX_PAYLOAD
+#define CONFIG_RPC_LINK_MAX_PAYLOAD 8192
+#endif
+
+#ifndef CONFIG_RPC_LINK_BYTE_TIMEOUT_MS
+#define CONFIG_RPC_LINK_BYTE_TIMEOUT_MS 20
+#endif
+
+// Link-layer TX queue and sender task (link_layer.c)
+#ifndef CONFIG_RPC_TX_QUEUE_LEN
+#define CONFIG_RPC_TX_QUEUE_LEN 16
+#endif
+
+#ifndef CONFIG_RPC_TX_QUEUE_WAIT_MS
+#define CONFIG_RPC_TX_QUEUE_WAIT_MS 20
+#endif
+
+#ifndef CONFIG_RPC_TX_TASK_PRIORITY
+#define CONFIG_RPC_TX_TASK_PRIORITY 10
+#endif
+
+// Long payloads sent in parts (link_layer.c), 0 disables it
+#ifndef CONFIG_RPC_LINK_SPLIT_SIZE
+#define CONFIG_RPC_LINK_SPLIT_SIZE 0
+#endif
+
+// Reliable link mode (link_arq.c), 0 disables it
+#ifndef CONFIG_RPC_ARQ_WINDOW
+#define CONFIG_RPC_ARQ_WINDOW 0
+#endif
+
+// Bonded links (link_bond.c)
+#ifndef CONFIG_RPC_BOND_STRIPE_MIN
+#define CONFIG_RPC_BOND_STRIPE_MIN 256
+#endif
+
+#ifndef CONFIG_RPC_BOND_REORDER_MS
+#define CONFIG_RPC_BOND_REORDER_MS 50
+#endif
+
+#ifndef CONFIG_RPC_BOND_TASK_PRIORITY
+#define CONFIG_RPC_BOND_TASK_PRIORITY 10
+#endif
+
+#ifndef CONFIG_RPC_BOND_TASK_STACK_SIZE
+#define CONFIG_RPC_BOND_TASK_STACK_SIZE 3072
+#endif
+
+// Receive buffer of the RX task (transport.c)
+#ifndef CONFIG_RPC_RX_FRAME_SIZE
+#define CONFIG_RPC_RX_FRAME_SIZE 2048
+#endif
+
+// Reply collector for incoming batches (transport.c)
+#ifndef CONFIG_RPC_BATCH_REPLY_SIZE
+#define CONFIG_RPC_BATCH_REPLY_SIZE 512
+#endif
+
+// Response buffer of rpc_handler_t handlers, per task (transport.c)
+#ifndef CONFIG_RPC_RESP_BUFFER_SIZE
+#define CONFIG_RPC_RESP_BUFFER_SIZE 256
+#endif
+
+// Function registry (transport.c)
+#ifndef CONFIG_RPC_MAX_FUNCTIONS
+#define CONFIG_RPC_MAX_FUNCTIONS 32
+#endif
+
+#ifndef CONFIG_RPC_MAX_NAME_LEN
+#define CONFIG_RPC_MAX_NAME_LEN 23
+#endif
+
+// Payload compression threshold (transport.c), 0 disables compression
+#ifndef CONFIG_RPC_COMPRESS_MIN
+#define CONFIG_RPC_COMPRESS_MIN 64
+#endif
+
+// Response cache (rpc_cache.c), 0 entries disables it
+#ifndef CONFIG_RPC_CACHE_ENTRIES
+#define CONFIG_RPC_CACHE_ENTRIES 8
+#endif
+#ifndef CONFIG_RPC_CACHE_TTL_MS
+#define CONFIG_RPC_CACHE_TTL_MS 1000
+#endif
+#ifndef CONFIG_RPC_CACHE_MAX_SIZE
+#define CONFIG_RPC_CACHE_MAX_SIZE 512
+#endif
+
+// Addressing and routing (link_route.c)
+#ifndef CONFIG_RPC_NODE_ADDRESS
+#define CONFIG_RPC_NODE_ADDRESS 0
+#endif
+#ifndef CONFIG_RPC_ROUTES
+#define CONFIG_RPC_ROUTES 8
+#endif
+#ifndef CONFIG_RPC_ROUTE_HOPS
+#define CONFIG_RPC_ROUTE_HOPS 8
+#endif
+
+// Bulk transfers (rpc_xfer.c)
+#ifndef CONFIG_RPC_XFER_WINDOW
+#define CONFIG_RPC_XFER_WINDOW 4
+#endif
+#ifndef CONFIG_RPC_XFER_MAX_SINKS
+#define CONFIG_RPC_XFER_MAX_SINKS 4
+#endif
+#ifndef CONFIG_RPC_XFER_RETRIES
+#define CONFIG_RPC_XFER_RETRIES 3
+#endif
+#ifndef CONFIG_RPC_XFER_IDLE_MS
+#define CONFIG_RPC_XFER_IDLE_MS 10000
+#endif
+
+// Pending-call table (transport.c)
+#ifndef CONFIG_RPC_MAX_PENDING_CALLS
+#define CONFIG_RPC_MAX_PENDING_CALLS 8
+#endif
+
+// Static buffer pool (rpc_pool.c)
+#ifndef CONFIG_RPC_POOL_BLOCK_SIZE
+#define CONFIG_RPC_POOL_BLOCK_SIZE 256
+#endif
+
+#ifndef CONFIG_RPC_POOL_BLOCK_COUNT
+#define CONFIG_RPC_POOL_BLOCK_COUNT 16
+#endif
+
+// Handler worker pool (transport.c)
+#ifndef CONFIG_RPC_WORKER_COUNT
+#define CONFIG_RPC_WORKER_COUNT 2
+#endif
+
+#ifndef CONFIG_RPC_WORKER_CORE
+#define CONFIG_RPC_WORKER_CORE -1
+#endif
+
+#ifndef CONFIG_RPC_WORKER_PRIORITY
+#define CONFIG_RPC_WORKER_PRIORITY 8
+#endif
+
+#ifndef CONFIG_RPC_WORKER_STACK_SIZE
+#define CONFIG_RPC_WORKER_STACK_SIZE 4096
+#endif
+
+#ifndef CONFIG_RPC_WORKER_QUEUE_LEN
+#define CONFIG_RPC_WORKER_QUEUE_LEN 8
+#endif
+
+#ifndef CONFIG_RPC_BENCH_CALLS
+#define CONFIG_RPC_BENCH_CALLS 200
+#endif
@@ -0,0 +1,619 @@
+/* C++20 coroutine client over transport.h, header only.
+
+   An rpc::executor resumes the coroutines of the task that runs it, so
+   one task can keep as many calls in flight as the pending table holds,
+   each costing its awaiter in the coroutine frame rather than a task
+   stack.  A call sends from the coroutine, the completion callback (RX
+   or timer task) decodes the response straight into the awaiter and
+   hands it back to the executor; when every pending slot is taken the
+   call waits for one to free instead of failing with -3.
+
+       RPC_CORO_CODEC(rpc_sum_result)  // at global scope: a record as a result
+
+       rpc::task<> poll(rpc::client &rpc) {
+           auto sum = co_await rpc.call<uint32_t>("sum", uint32_t{1}, uint32_t{2});
+           if (sum) printf("%lu\n", (unsigned long)*sum);
+           auto echo = co_await rpc.call<rpc::response>("echo", std::string_view("hi"));
+       }
+
+       static void demo_task(void *) {
+           rpc::executor ex;
+           rpc::client rpc(ex);
+           for (int i = 0; i < 100; i++) ex.spawn(poll(rpc));
+           ex.run();
+       }
+
+   Arguments are encoded in order by rpc::codec<T> into the awaiter
+   itself (on the heap only when one has no fixed size): integers and
+   enums as fixed-width little endian of their size, bool as one byte,
+   strings and byte spans length-prefixed, as in rpc_codec.h.  Without
+   exceptions; failures come back in rpc::result. */
+
+#pragma once
+#if __cplusplus < 202002L
+#error "rpc_coro.hpp needs C++20"
+#endif
+
+#include <coroutine>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "transport.h"
+#include "rpc_codec.h"
+#include "rpc_config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+namespace rpc {
+
+/* Encoding of one value: put() appends it, get() takes it off the
+   reader, size() bounds its encoded length (max_size too, for types
+   whose length never changes). */
+template <class T> struct codec;
+
+template <std::integral T>
+struct codec<T> {
+    static constexpr size_t max_size = sizeof(T);
+    static size_t size(T) { return sizeof(T); }
+    static void put(rpc_writer_t *w, T v) {
+        if constexpr (sizeof(T) == 1)      rpc_put_u8(w, static_cast<uint8_t>(v));
+        else if constexpr (sizeof(T) == 2) rpc_put_u16(w, static_cast<uint16_t>(v));
+        else if constexpr (sizeof(T) == 4) rpc_put_u32(w, static_cast<uint32_t>(v));
+        else                               rpc_put_u64(w, static_cast<uint64_t>(v));
+    }
+    static bool get(rpc_reader_t *r, T *v) {
+        bool ok;
+        if constexpr (sizeof(T) == 1)      { uint8_t x;  ok = rpc_get_u8(r, &x);  *v = static_cast<T>(x); }
+        else if constexpr (sizeof(T) == 2) { uint16_t x; ok = rpc_get_u16(r, &x); *v = static_cast<T>(x); }
+        else if constexpr (sizeof(T) == 4) { uint32_t x; ok = rpc_get_u32(r, &x); *v = static_cast<T>(x); }
+        else                               { uint64_t x; ok = rpc_get_u64(r, &x); *v = static_cast<T>(x); }
+        return ok;
+    }
+};
+
+template <class T> requires std::is_enum_v<T>
+struct codec<T> {
+    using base = codec<std::underlying_type_t<T>>;
+    static constexpr size_t max_size = base::max_size;
+    static size_t size(T) { return max_size; }
+    static void put(rpc_writer_t *w, T v) { base::put(w, static_cast<std::underlying_type_t<T>>(v)); }
+    static bool get(rpc_reader_t *r, T *v) {
+        std::underlying_type_t<T> x;
+        const bool ok = base::get(r, &x);
+        *v = static_cast<T>(x);
+        return ok;
+    }
+};
+
+// Byte strings; decoded ones point into the reader's buffer
+template <>
+struct codec<rpc_bytes_t> {
+    static size_t size(rpc_bytes_t b) { return RPC_CODEC_SIZE_var + b.len; }
+    static void put(rpc_writer_t *w, rpc_bytes_t b) { rpc_put_bytes(w, b); }
+    static bool get(rpc_reader_t *r, rpc_bytes_t *b) { return rpc_get_bytes(r, b); }
+};
+
+template <>
+struct codec<std::string_view> {
+    static rpc_bytes_t bytes(std::string_view s) {
+        return { reinterpret_cast<const uint8_t *>(s.data()),
+                 static_cast<uint16_t>(s.size() < UINT16_MAX ? s.size() : UINT16_MAX) };
+    }
+    static size_t size(std::string_view s) { return codec<rpc_bytes_t>::size(bytes(s)); }
+    static void put(rpc_writer_t *w, std::string_view s) { rpc_put_bytes(w, bytes(s)); }
+    static bool get(rpc_reader_t *r, std::string_view *s) {
+        rpc_bytes_t b;
+        const bool ok = rpc_get_bytes(r, &b);
+        *s = std::string_view(reinterpret_cast<const char *>(b.data), b.len);
+        return ok;
+    }
+};
+
+template <>
+struct codec<const char *> {
+    static size_t size(const char *s) { return codec<std::string_view>::size(s); }
+    static void put(rpc_writer_t *w, const char *s) { codec<std::string_view>::put(w, s); }
+};
+
+template <>
+struct codec<std::span<const uint8_t>> {
+    static rpc_bytes_t bytes(std::span<const uint8_t> s) {
+        return { s.data(), static_cast<uint16_t>(s.size() < UINT16_MAX ? s.size() : UINT16_MAX) };
+    }
+    static size_t size(std::span<const uint8_t> s) { return codec<rpc_bytes_t>::size(bytes(s)); }
+    static void put(rpc_writer_t *w, std::span<const uint8_t> s) { rpc_put_bytes(w, bytes(s)); }
+    static bool get(rpc_reader_t *r, std::span<const uint8_t> *s) {
+        rpc_bytes_t b;
+        const bool ok = rpc_get_bytes(r, &b);
+        *s = std::span<const uint8_t>(b.data, b.len);
+        return ok;
+    }
+};
+
+// Several values one after the other
+template <class... Ts>
+struct codec<std::tuple<Ts...>> {
+    static size_t size(const std::tuple<Ts...> &v) {
+        return std::apply([](const Ts &...x) { return (codec<Ts>::size(x) + ... + size_t{0}); }, v);
+    }
+    static void put(rpc_writer_t *w, const std::tuple<Ts...> &v) {
+        std::apply([w](const Ts &...x) { (codec<Ts>::put(w, x), ...); }, v);
+    }
+    static bool get(rpc_reader_t *r, std::tuple<Ts...> *v) {
+        return std::apply([r](Ts &...x) { return (codec<Ts>::get(r, &x) && ...); }, *v);
+    }
+};
+
+/* Make an RPC_CODEC_STRUCT record usable as an argument or result.  Its
+   decoder wants the input to end with it, so a record is decoded only
+   as the last value. */
+#define RPC_CORO_CODEC(name)                                                   \
+    template <>                                                                \
+    struct rpc::codec<name##_t> {                                              \
+        static constexpr size_t max_size = name##_MAX_SIZE;                    \
+        static size_t size(const name##_t &) { return name##_MAX_SIZE; }       \
+        static void put(rpc_writer_t *w, const name##_t &v) { name##_put(w, &v); } \
+        static bool get(rpc_reader_t *r, name##_t *v) { return name##_get(r, v); } \
+    };
+
+
+/* A response kept past its callback: a heap copy, freed with the
+   object.  Views decoded from it are valid as long as it lives. */
+class response {
+public:
+    response() = default;
+    response(const response &) = delete;
+    response &operator=(const response &) = delete;
+    response(response &&o) noexcept : data_(std::exchange(o.data_, nullptr)), len_(std::exchange(o.len_, 0)) {}
+    response &operator=(response &&o) noexcept {
+        std::swap(data_, o.data_);
+        std::swap(len_, o.len_);
+        return *this;
+    }
+    ~response() { vPortFree(data_); }
+
+    const uint8_t *data() const { return data_; }
+    uint16_t size() const { return len_; }
+    std::span<const uint8_t> bytes() const { return { data_, len_ }; }
+
+    rpc_reader_t reader() const {
+        rpc_reader_t r;
+        rpc_reader_init(&r, data_, len_);
+        return r;
+    }
+
+    // Decode the whole response as these values; false if it holds anything else
+    template <class... Ts>
+    bool get(Ts &...out) const {
+        rpc_reader_t r = reader();
+        return (codec<Ts>::get(&r, &out) && ...) && rpc_reader_done(&r);
+    }
+
+    // Copy of len bytes at data, or false when out of memory
+    bool assign(const uint8_t *data, uint16_t len) {
+        uint8_t *copy = static_cast<uint8_t *>(pvPortMalloc(len > 0 ? len : 1));
+        if (!copy) return false;
+        if (len > 0) memcpy(copy, data, len);
+        vPortFree(data_);
+        data_ = copy;
+        len_  = len;
+        return true;
+    }
+
+private:
+    uint8_t *data_ = nullptr;
+    uint16_t len_  = 0;
+};
+
+
+/* Outcome of a call.  status is 0 when the peer answered and negative as
+   for transport_call() otherwise (-7 timeout, -8 out of memory, -10 a
+   response that does not decode as the result type); error is the
+   remote error code.  True only for a successful call. */
+template <class T>
+struct result {
+    int     status = 0;
+    uint8_t error  = 0;
+    T       value{};
+
+    explicit operator bool() const { return status == 0 && error == 0; }
+    T &operator*() { return value; }
+    const T &operator*() const { return value; }
+    T *operator->() { return &value; }
+    const T *operator->() const { return &value; }
+};
+
+template <>
+struct result<void> {
+    int     status = 0;
+    uint8_t error  = 0;
+    explicit operator bool() const { return status == 0 && error == 0; }
+};
+
+
+namespace detail {
+
+// Something an executor resumes: a call that completed, or a spawned task
+struct waiter {
+    waiter *next = nullptr;
+    std::coroutine_handle<> handle;
+    int (*send)(waiter *) = nullptr;  // (re)send a call held back for lack of a pending slot
+    int status = 0;
+};
+
+}  // namespace detail
+
+template <class T = void> class task;
+
+/* Runs coroutines in one task: run() (or run_once()) resumes each when
+   its call completes.  Coroutines of an executor only ever run in that
+   task, so they need no locking among themselves. */
+class executor {
+public:
+    executor() { portMUX_INITIALIZE(&lock_); }
+    executor(const executor &) = delete;
+    executor &operator=(const executor &) = delete;
+
+    /* Start a task in the executor's task; it is freed when it finishes.
+       May be called from any task.  False for a task that could not be
+       allocated. */
+    inline bool spawn(task<void> &&t);
+
+    [[noreturn]] void run() {
+        for (;;) run_once(portMAX_DELAY);
+    }
+
+    /* Resume what is ready, waiting up to wait ticks for something if
+       nothing is.  Returns the number of coroutines resumed. */
+    size_t run_once(TickType_t wait) {
+        task_ = xTaskGetCurrentTaskHandle();
+        resend();
+        detail::waiter *list = take_ready();
+        if (!list) {
+            (void)ulTaskNotifyTake(pdTRUE, held_ ? 1 : wait);  // held calls retry every tick
+            resend();
+            list = take_ready();
+        }
+        size_t n = 0;
+        while (list) {
+            detail::waiter *w = list;
+            list = w->next;
+            w->next = nullptr;
+            w->handle.resume();  // may free w
+            n++;
+        }
+        return n;
+    }
+
+    // Queue w to be resumed (completion callbacks, from any task)
+    void post(detail::waiter *w) {
+        w->next = nullptr;
+        portENTER_CRITICAL(&lock_);
+        if (ready_tail_) ready_tail_->next = w;
+        else             ready_ = w;
+        ready_tail_ = w;
+        portEXIT_CRITICAL(&lock_);
+        const TaskHandle_t task = task_;
+        if (task) (void)xTaskNotifyGive(task);
+    }
+
+    // Hold back a call that found no free pending slot (executor task only)
+    void hold(detail::waiter *w) {
+        w->next = nullptr;
+        if (held_tail_) held_tail_->next = w;
+        else            held_ = w;
+        held_tail_ = w;
+    }
+
+private:
+    detail::waiter *take_ready() {
+        portENTER_CRITICAL(&lock_);
+        detail::waiter *list = ready_;
+        ready_ = ready_tail_ = nullptr;
+        portEXIT_CRITICAL(&lock_);
+        return list;
+    }
+
+    // Send held calls in order until the pending table is full again
+    void resend() {
+        while (held_) {
+            detail::waiter *w = held_;
+            detail::waiter *next = w->next;  // a reply may post w before send() returns
+            const int rc = w->send(w);
+            if (rc == -3) return;
+            held_ = next;
+            if (!held_) held_tail_ = nullptr;
+            if (rc < 0) {
+                w->status = rc;
+                post(w);
+            }
+        }
+    }
+
+    portMUX_TYPE    lock_;                 // guards the ready list
+    detail::waiter *ready_      = nullptr;
+    detail::waiter *ready_tail_ = nullptr;
+    detail::waiter *held_       = nullptr;  // calls waiting for a pending slot
+    detail::waiter *held_tail_  = nullptr;
+    volatile TaskHandle_t task_ = nullptr;
+};
+
+
+namespace detail {
+
+struct promise_base {
+    std::coroutine_handle<> continuation;
+    waiter node;             // for executor::spawn()
+    bool   detached = false;
+
+    // Frames come from the FreeRTOS heap, like every other allocation here
+    static void *operator new(size_t n) noexcept { return pvPortMalloc(n); }
+    static void operator delete(void *p) noexcept { vPortFree(p); }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct final_awaiter {
+        bool await_ready() noexcept { return false; }
+        template <class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            promise_base &p = h.promise();
+            if (p.continuation) return p.continuation;
+            if (p.detached) h.destroy();
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    final_awaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { std::terminate(); }
+};
+
+template <class T>
+struct promise : promise_base {
+    std::optional<T> value;
+    task<T> get_return_object();
+    static task<T> get_return_object_on_allocation_failure() { return {}; }
+    template <class U> void return_value(U &&v) { value.emplace(std::forward<U>(v)); }
+};
+
+template <>
+struct promise<void> : promise_base {
+    inline task<void> get_return_object();
+    static inline task<void> get_return_object_on_allocation_failure();
+    void return_void() {}
+};
+
+}  // namespace detail
+
+
+/* A coroutine that starts when awaited (or spawned) and hands its
+   co_return value to the awaiting coroutine.  It must not be destroyed
+   while suspended in a call. */
+template <class T>
+class [[nodiscard]] task {
+public:
+    using promise_type = detail::promise<T>;
+    using handle_type  = std::coroutine_handle<promise_type>;
+
+    task() = default;
+    explicit task(handle_type h) : h_(h) {}
+    task(task &&o) noexcept : h_(std::exchange(o.h_, {})) {}
+    task &operator=(task &&o) noexcept {
+        std::swap(h_, o.h_);
+        return *this;
+    }
+    ~task() {
+        if (h_) h_.destroy();
+    }
+
+    // False if the frame could not be allocated; such a task must not be awaited
+    bool valid() const { return static_cast<bool>(h_); }
+
+    bool await_ready() const { return h_.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+        h_.promise().continuation = awaiting;
+        return h_;
+    }
+    T await_resume() {
+        if constexpr (!std::is_void_v<T>) return std::move(*h_.promise().value);
+    }
+
+    handle_type release() { return std::exchange(h_, {}); }
+
+private:
+    handle_type h_;
+};
+
+namespace detail {
+
+template <class T>
+task<T> promise<T>::get_return_object() {
+    return task<T>(task<T>::handle_type::from_promise(*this));
+}
+
+task<void> promise<void>::get_return_object() {
+    return task<void>(task<void>::handle_type::from_promise(*this));
+}
+
+task<void> promise<void>::get_return_object_on_allocation_failure() {
+    return {};
+}
+
+}  // namespace detail
+
+bool executor::spawn(task<void> &&t) {
+    auto h = t.release();
+    if (!h) return false;
+    h.promise().detached = true;
+    h.promise().node.handle = h;
+    post(&h.promise().node);
+    return true;
+}
+
+
+namespace detail {
+
+// Codec of an argument: string literals as const char *, others by their value type
+template <class T>
+using arg_codec = codec<std::conditional_t<std::is_array_v<T>, const std::remove_extent_t<T> *, std::decay_t<T>>>;
+
+template <class T> concept fixed_size = requires { arg_codec<T>::max_size; };
+
+// Inline argument bytes for a call whose arguments all have fixed sizes, 0 otherwise
+template <class... Args>
+constexpr size_t args_capacity() {
+    if constexpr ((fixed_size<Args> && ...)) return (arg_codec<Args>::max_size + ... + 0);
+    else return 0;
+}
+
+// Result types that would point into the response after its callback has returned
+template <class T> constexpr bool is_view = std::is_same_v<T, std::string_view> ||
+    std::is_same_v<T, rpc_bytes_t> || std::is_same_v<T, std::span<const uint8_t>>;
+
+struct no_value {};
+
+/* The awaitable of one call.  It lives in the coroutine frame while the
+   call is in flight: the callback decodes into it and posts it. */
+template <class Ret, size_t Cap>
+class call_op : public waiter {
+    static_assert(!is_view<Ret>, "decode views from an rpc::response, which owns the bytes");
+    using value_type = std::conditional_t<std::is_void_v<Ret>, no_value, Ret>;
+
+public:
+    template <class... Args>
+    call_op(executor &ex, const transport_call_opts_t &opts, uint32_t timeout_ms,
+            const char *name, uint16_t func_id, const Args &...args)
+        : ex_(ex), opts_(opts), timeout_ms_(timeout_ms), name_(name), func_id_(func_id) {
+        send = &call_op::send_now;
+        const size_t need = (arg_codec<Args>::size(args) + ... + size_t{0});
+        if (need > UINT16_MAX) {
+            status = -1;
+            return;
+        }
+        uint8_t *buf = inline_;
+        if constexpr (Cap == 0) {
+            if (need > 0) {
+                buf = heap_ = static_cast<uint8_t *>(pvPortMalloc(need));
+                if (!heap_) {
+                    status = -8;
+                    return;
+                }
+            }
+        }
+        rpc_writer_t w;
+        rpc_writer_init(&w, buf, static_cast<uint16_t>(need));
+        (arg_codec<Args>::put(&w, args), ...);
+        args_     = buf;
+        args_len_ = w.len;
+        if (w.overflow) status = -1;
+    }
+    call_op(const call_op &) = delete;
+    call_op &operator=(const call_op &) = delete;
+    ~call_op() {
+        if constexpr (Cap == 0) vPortFree(heap_);
+    }
+
+    bool await_ready() const { return status != 0; }  // the args could not be encoded
+
+    bool await_suspend(std::coroutine_handle<> h) {
+        handle = h;
+        const int rc = send_now(this);
+        if (rc == -3) {
+            ex_.hold(this);
+            return true;
+        }
+        if (rc < 0) {
+            status = rc;
+            return false;
+        }
+        return true;  // the callback may already have posted it; it is resumed by run() only
+    }
+
+    result<Ret> await_resume() {
+        if constexpr (std::is_void_v<Ret>) return { status, error_ };
+        else return { status, error_, std::move(value_) };
+    }
+
+private:
+    static int send_now(waiter *w) {
+        call_op *self = static_cast<call_op *>(w);
+        return self->name_
+            ? transport_call_async_opt(&self->opts_, self->name_, self->args_, self->args_len_,
+                                       &call_op::done, self, self->timeout_ms_)
+            : transport_call_id_async_opt(&self->opts_, self->func_id_, self->args_, self->args_len_,
+                                          &call_op::done, self, self->timeout_ms_);
+    }
+
+    // Completion (RX or timer task): decode while the bytes are valid, then hand back
+    static void done(int status, uint8_t error_code, const uint8_t *data, uint16_t len, void *ctx) {
+        call_op *self = static_cast<call_op *>(ctx);
+        self->status = status;
+        self->error_ = error_code;
+        if (status == 0 && error_code == 0) {
+            if constexpr (std::is_same_v<Ret, response>) {
+                if (!self->value_.assign(data, len)) self->status = -8;
+            } else if constexpr (!std::is_void_v<Ret>) {
+                rpc_reader_t r;
+                rpc_reader_init(&r, data, len);
+                if (!codec<Ret>::get(&r, &self->value_) || !rpc_reader_done(&r)) self->status = -10;
+            }
+        }
+        self->ex_.post(self);
+    }
+
+    executor             &ex_;
+    transport_call_opts_t opts_;
+    uint32_t              timeout_ms_;
+    const char           *name_;      // NULL: by func_id_
+    uint16_t              func_id_;
+    uint8_t               error_ = 0;
+    value_type            value_{};
+    const uint8_t        *args_     = nullptr;
+    uint16_t              args_len_ = 0;
+    uint8_t              *heap_     = nullptr;
+    uint8_t               inline_[Cap > 0 ? Cap : 1];
+};
+
+}  // namespace detail
+
+
+/* Calls from the coroutines of an executor.  opts (link, priority,
+   deadline, see transport_call_opts_t) and timeout_ms apply to every
+   call made after they are set. */
+class client {
+public:
+    explicit client(executor &ex, rpc_link_t *link = nullptr, uint32_t timeout_ms = 1000)
+        : timeout_ms(timeout_ms), ex_(ex) {
+        opts.link = link;
+    }
+
+    transport_call_opts_t opts{};
+    uint32_t timeout_ms;
+
+    /* co_await call<Ret>(name, args...) -> result<Ret>.  name must stay
+       valid until the call completes (a literal, typically).  Ret may be
+       void (any response), rpc::response (the raw bytes) or any type
+       with a codec. */
+    template <class Ret, class... Args>
+    auto call(const char *name, const Args &...args) {
+        return detail::call_op<Ret, detail::args_capacity<Args...>()>(ex_, opts, timeout_ms, name, 0, args...);
+    }
+
+    // The same by function ID (transport_resolve())
+    template <class Ret, class... Args>
+    auto call_id(uint16_t func_id, const Args &...args) {
+        return detail::call_op<Ret, detail::args_capacity<Args...>()>(ex_, opts, timeout_ms, nullptr, func_id, args...);
+    }
+
+private:
+    executor &ex_;
+};
+
+}  // namespace rpc
@@ -0,0 +1,31 @@
+/* Small LZ77 codec for RPC payloads (see MSG_FLAG_COMPRESSED).
+   Both sides share a built-in dictionary of strings common in config
+   blobs and logs, so even short payloads find matches.  Needs no heap
+   and about 512 bytes of stack.
+
+   Stream format, a sequence of tokens:
+   [0x00..0x7F]            : literal run, tag + 1 bytes follow
+   [0x80..0xFF][dist LE16] : copy (tag & 0x7F) + 3 bytes from dist bytes back
+   Distances may reach back into the dictionary, which conceptually
+   precedes the data. */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Compress len bytes into dst.  Returns the compressed size, or 0 if it
+   would exceed cap (the caller then sends the data as it is). */
+size_t rpc_lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+/* Expand a compressed stream into dst.  Returns the number of bytes
+   written, or negative if the stream is malformed or needs more than
+   cap bytes. */
+int rpc_lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
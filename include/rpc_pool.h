@@ -0,0 +1,30 @@
+/* Fixed-size block pool for transport and link-layer buffers.
+   Blocks come from a static arena sized by Kconfig
+   (CONFIG_RPC_POOL_BLOCK_SIZE x CONFIG_RPC_POOL_BLOCK_COUNT), so the
+   hot path does not touch the FreeRTOS heap.  Requests larger than a
+   block, or made while the pool is empty, fall back to pvPortMalloc. */
+
+#pragma once
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Initialize the pool; link_init() and transport_init() call it, later calls do nothing
+void rpc_pool_init(void);
+
+/* Allocate at least size bytes.  Safe to call from tasks on either core
+   and from ISRs (as long as it does not fall back to the heap).
+   Returns NULL on failure. */
+void *rpc_pool_alloc(size_t size);
+
+// Release a buffer from rpc_pool_alloc(); NULL is ignored
+void rpc_pool_free(void *ptr);
+
+// Number of pool blocks currently free
+size_t rpc_pool_available(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,27 @@
+/* Counter helpers for the per-layer statistics (CONFIG_RPC_STATS).
+   Each layer lists its counters once as an X-macro of rpc_codec.h
+   fields, e.g.
+       #define LINK_STATS_FIELDS(X) X(var, frames_sent) X(var, crc_errors)
+   and keeps them in a struct of relaxed atomics:
+       static struct { LINK_STATS_FIELDS(RPC_STAT_FIELD_) } s_stats;
+   An increment is then a single uncontended atomic add on whichever core
+   the caller runs; RPC_STAT_LOAD_ copies them into the layer's public
+   snapshot record.  Used by the .c files only. */
+
+#pragma once
+#include <stdatomic.h>
+#include "rpc_config.h"
+
+
+#define RPC_STAT_ATOMIC_var  atomic_uint_least32_t
+#define RPC_STAT_ATOMIC_u64  atomic_uint_least64_t
+
+#define RPC_STAT_FIELD_(kind, field) RPC_STAT_ATOMIC_##kind field;
+#define RPC_STAT_LOAD_(kind, field)  out->field = atomic_load_explicit(&s_stats.field, memory_order_relaxed);
+
+#if CONFIG_RPC_STATS
+#define RPC_STAT_ADD(counter, n) ((void)atomic_fetch_add_explicit(&(counter), (n), memory_order_relaxed))
+#else
+#define RPC_STAT_ADD(counter, n) ((void)0)
+#endif
+#define RPC_STAT_INC(counter) RPC_STAT_ADD(counter, 1)
@@ -0,0 +1,83 @@
+/* Bulk transfer of objects larger than one frame (firmware images, log
+   dumps, calibration blobs) on top of the transport.
+
+   The receiver registers named sinks; the sender opens a transfer to one,
+   streams it in chunks as large as the receiver's frames allow and closes
+   it.  Up to CONFIG_RPC_XFER_WINDOW chunks are in flight at once as async
+   calls at RPC_PRIO_BULK, so the link stays busy instead of idling for
+   each round trip, and other calls still go ahead of the transfer.
+   Neither side holds the whole object: the sender reads it chunk by
+   chunk from a source callback and the receiver hands each chunk to the
+   sink as it arrives.
+
+   Built-in functions (registered with the first sink):
+   "__xfer_open"  args [total LE32][sink name]
+                  response [xfer_id LE16][chunk_max LE16], chunk_max being
+                  the most bytes one "__xfer_data" may carry
+   "__xfer_data"  args [xfer_id LE16][offset LE32][bytes...], empty response
+   "__xfer_close" args [xfer_id LE16][complete u8], empty response or the
+                  sink's error code
+
+   The sender resolves "__xfer_data" once and sends the chunks by ID.  A
+   chunk refused as busy or timed out is sent again, so a sink may see a
+   chunk more than once and, as chunks race in the worker tasks, out of
+   order: it must write each one at the offset it is given. */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "link_layer.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Error codes of the built-in functions, beside the ERR_* of transport.h
+#define RPC_XFER_ERR_NO_SINK   0x10  // no sink registered under that name
+#define RPC_XFER_ERR_STALE     0x11  // transfer ID not (or no longer) open
+#define RPC_XFER_ERR_RANGE     0x12  // chunk beyond the announced size
+
+#define RPC_XFER_OPEN_FUNCTION  "__xfer_open"
+#define RPC_XFER_DATA_FUNCTION  "__xfer_data"
+#define RPC_XFER_CLOSE_FUNCTION "__xfer_close"
+
+/* Receiving end of transfers.  The callbacks run in worker tasks (see
+   RPC_FLAG_DEFERRED), one at a time per sink, and return 0 or an error
+   code for the sender.  A sink takes one transfer at a time; one left
+   idle for CONFIG_RPC_XFER_IDLE_MS is aborted when the next opens. */
+typedef struct {
+    uint8_t (*open)(void *ctx, uint32_t total);  // a transfer of total bytes starts
+    uint8_t (*write)(void *ctx, uint32_t offset, const uint8_t *data, uint16_t len);
+    uint8_t (*close)(void *ctx, bool complete);  // complete: every byte was acknowledged
+    void *ctx;
+} rpc_xfer_sink_t;
+
+/* Register sink under name (copied; the struct must stay valid), and
+   the built-in functions with the first one.  Returns 0, -1 on bad
+   arguments, -2 when CONFIG_RPC_XFER_MAX_SINKS are registered, or the
+   transport_register_handler() error. */
+int rpc_xfer_register_sink(const char *name, const rpc_xfer_sink_t *sink);
+
+/* Source of a sent object: copy len bytes from offset into buf and
+   return 0, or nonzero to abort the transfer. */
+typedef int (*rpc_xfer_read_t)(void *ctx, uint32_t offset, uint8_t *buf, uint16_t len);
+
+/* Send total bytes from read to the sink name on the peer of link (NULL:
+   the default link) and wait until the sink has closed.  Every call of
+   the transfer waits up to timeout_ms for its reply; chunks are tried
+   CONFIG_RPC_XFER_RETRIES more times before the transfer is aborted.
+   Returns 0 when the receiver answered: *error_code is then 0 on
+   success, or the error the receiver refused or failed with.  Negative
+   on a local error: -1 bad arguments, -8 out of memory, -9 the peer
+   does not take transfers, -14 the source aborted, others as for
+   transport_call(). */
+int rpc_xfer_send(rpc_link_t *link, const char *name, uint32_t total,
+                  rpc_xfer_read_t read, void *ctx, uint8_t *error_code, uint32_t timeout_ms);
+
+// rpc_xfer_send() of a buffer in memory
+int rpc_xfer_send_buffer(rpc_link_t *link, const char *name, const uint8_t *data, uint32_t len,
+                         uint8_t *error_code, uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,12 +2,34 @@
    Message layout (transport layer):
    Request  : [type=0x0B][counter][name ASCIIZ][args...]
    Stream   : [type=0x0C][counter][name ASCIIZ][args...]
+   RequestId: [type=0x0D][counter][func_id LE16][args...]
+   Batch    : [type=0x2C][count]([len LE16][message])...
    Response : [type=0x16][counter][data...]
-   Error    : [type=0x21][counter][error_code] */
+   Error    : [type=0x21][counter][error_code]
+   Options  : [type=0x0E][opts_len]([tag][len][value...])...[message]
+   Cancel   : [type=0x18][counter][counter...]
+   Requests and their replies may set MSG_FLAG_WIDE_ID in the type byte,
+   in which case counter is a 16-bit little-endian request ID, and
+   MSG_FLAG_COMPRESSED, in which case args/data are
+   [raw_len LE16][rpc_lz stream] (see rpc_lz.h).  An options envelope
+   carries RPC_OPT_* TLVs for the request that follows it; it is only
+   sent to peers that announce RPC_CAP_OPTIONS, and unknown tags are
+   skipped.  A cancel lists requests whose caller gave up on them (all
+   of one ID width); it is never answered.
+
+   Every function below without a link argument works on the default
+   link (link_init()).  Further links (rpc_link_create(), rpc_link_bond())
+   are served after transport_attach() and addressed through the *_on()
+   variants, where a NULL link also means the default one.  Each link has
+   its own pending calls, capabilities and stream counters; registered
+   functions, workers and statistics are shared. */
 
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include "rpc_codec.h"
+#include "link_layer.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -15,12 +37,61 @@ extern "C" {
 
 // Message type constants 
 #define MSG_TYPE_REQUEST   0x0B
+#define MSG_TYPE_STREAM    0x0C  // fire-and-forget, counter is a sequence number
+#define MSG_TYPE_REQUEST_ID 0x0D  // compact request addressed by function ID
+#define MSG_TYPE_OPTIONS   0x0E  // envelope: call options, then a request
 #define MSG_TYPE_RESPONSE  0x16
+#define MSG_TYPE_CANCEL    0x18  // the caller no longer waits for these requests
 #define MSG_TYPE_ERROR     0x21
+#define MSG_TYPE_BATCH     0x2C  // several messages of the types above in one frame
+#define MSG_FLAG_WIDE_ID   0x80  // or-ed into the type: 16-bit request ID follows
+#define MSG_FLAG_COMPRESSED 0x40 // or-ed into the type: args/data are compressed
+#define MSG_FLAGS_MASK     (MSG_FLAG_WIDE_ID | MSG_FLAG_COMPRESSED)
+
+// Maximum number of messages queued in one transport_batch_t
+#define TRANSPORT_BATCH_MAX 32
 
 // Error codes carried by MSG_TYPE_ERROR
 #define ERR_FUNC_NOT_FOUND 1
 #define ERR_INTERNAL       2
+#define ERR_BUSY           3   // server dispatch queue full, retry later
+#define ERR_TOO_LARGE      4   // message exceeds the receiver's CONFIG_RPC_RX_FRAME_SIZE
+                               // (or a handler's CONFIG_RPC_RESP_BUFFER_SIZE)
+
+// Dispatch flags for transport_register_function_ex()
+#define RPC_FLAG_DEFERRED  0x00  // run in a worker task (default)
+#define RPC_FLAG_INLINE    0x01  // run in the RX task; handler must be fast
+#define RPC_FLAG_CACHEABLE 0x02  // same args, same response: cache it (rpc_cache.h)
+
+/* Built-in discovery function: args = function name (no terminator),
+   response = its numeric ID as little-endian uint16 */
+#define RPC_RESOLVE_FUNCTION "__resolve"
+
+/* Built-in capability query: no args, response = one byte of RPC_CAP_*
+   bits the peer supports */
+#define RPC_CAPS_FUNCTION  "__caps"
+#define RPC_CAP_COMPRESS   0x01  // understands MSG_FLAG_COMPRESSED payloads
+#define RPC_CAP_OPTIONS    0x02  // understands MSG_TYPE_OPTIONS envelopes
+#define RPC_CAP_CANCEL     0x04  // understands MSG_TYPE_CANCEL
+
+// Tags of the TLVs in an options envelope
+#define RPC_OPT_PRIORITY   0x01  // 1 byte, RPC_PRIO_*
+#define RPC_OPT_DEADLINE   0x02  // 1-4 bytes LE: ms the caller still waits for the reply
+
+// Longest options envelope a request carries: header, priority and a 4-byte deadline
+#define RPC_OPTIONS_MAX_LEN 11
+
+/* Call priorities.  They pick the link TX lane on both sides and the
+   worker queue the server runs the handler from: high goes ahead of
+   everything and is never split, bulk yields to all other traffic. */
+#define RPC_PRIO_NORMAL    0
+#define RPC_PRIO_HIGH      1
+#define RPC_PRIO_BULK      2
+
+/* Built-in statistics query (CONFIG_RPC_STATS): no args, response = one
+   rpc_stats record (below); args = a function name (no terminator),
+   response = its rpc_func_stats record or ERR_FUNC_NOT_FOUND */
+#define RPC_STATS_FUNCTION "__stats"
 
 
 /* Callback signature for registered RPC functions.
@@ -34,14 +105,106 @@ typedef void (*rpc_callback_t)(const uint8_t *args, uint16_t args_len,
                                uint8_t *error_code);
 
 
-// Initialize transport: creates internal mutex and spawns the RX task 
+/* Handler that writes its response straight into a buffer the transport
+   owns (CONFIG_RPC_RESP_BUFFER_SIZE bytes, one per worker and one for the
+   RX task), typically with the rpc_codec.h writer, so answering costs no
+   allocation.  Leaving resp empty sends an empty response; a write that
+   does not fit is answered with ERR_TOO_LARGE.
+   error_code - out error code (0 means success, resp is then ignored) */
+typedef void (*rpc_handler_t)(const uint8_t *args, uint16_t args_len,
+                              rpc_writer_t *resp, uint8_t *error_code);
+
+
+/* Completion callback for transport_call_async().
+   status     - 0 when a response/error was delivered, -7 on timeout,
+                -6 if the batch carrying the call could not be sent,
+                -15 if it was cancelled with transport_cancel()
+   error_code - remote error code (0 on success)
+   data       - response bytes, valid only for the duration of the callback
+   len        - number of bytes in data
+   ctx        - user pointer given to transport_call_async()
+   Runs in the RX task (or the timer task on timeout), so it must not block;
+   typically it copies what it needs and signals the owner with
+   xTaskNotify() or xEventGroupSetBits(). */
+typedef void (*transport_async_cb_t)(int status, uint8_t error_code,
+                                     const uint8_t *data, uint16_t len,
+                                     void *ctx);
+
+
+/* Per-call options for the transport_*_opt() calls; zero-initialise and
+   set what is needed.  A NULL options pointer means all defaults.
+   link        - where the call goes (NULL: the default link)
+   priority    - RPC_PRIO_*; travels to the peer only after
+                 transport_negotiate_caps() found RPC_CAP_OPTIONS
+   deadline_ms - if nonzero, the request is dropped instead of sent when
+                 it is still queued this long after the call started.  A
+                 sync call then waits out its timeout; if the deadline
+                 has already passed when the request is handed to the
+                 link, the call fails with -13 right away. */
+typedef struct {
+    rpc_link_t *link;
+    uint8_t     priority;
+    uint32_t    deadline_ms;
+} transport_call_opts_t;
+
+
+/* Client-side batch under construction.  Fill it with transport_batch_*()
+   and send it with transport_batch_commit(); the fields are internal. */
+typedef struct {
+    rpc_link_t *link;                        // NULL: the default link
+    uint8_t  *buf;                           // caller storage, frame built in place
+    uint16_t  cap;
+    uint16_t  len;
+    uint8_t   count;                         // messages queued in this batch
+    uint8_t   n_calls;
+    uint16_t  call_ids[TRANSPORT_BATCH_MAX]; // request IDs of the calls among them
+} transport_batch_t;
+
+
+// Initialize transport: creates internal mutex, spawns the RX and worker tasks 
 void transport_init(void);
 
+/* Serve another link as well: spawns its RX task and gives it its own
+   pending calls.  Attaching a link twice does nothing.
+   Returns 0 on success, -1 on a NULL link, -2 or -8 when out of memory,
+   or -3 if another task is attaching the default link right now. */
+int transport_attach(rpc_link_t *link);
+
 /* Register an RPC function by ASCII name; name is copied internally.
-   Returns 0 on success, negative on error. */
+   Lookup is a hash-table probe, so dispatch cost does not grow with the
+   number of functions (up to CONFIG_RPC_MAX_FUNCTIONS).  Registering an
+   existing name replaces its callback.
+   Returns 0 on success, negative on error (-2 registry full, -4 name
+   longer than CONFIG_RPC_MAX_NAME_LEN). */
 int transport_register_function(const char *name, rpc_callback_t callback);
 
-/* Perform a synchronous RPC call.
+/* Register an RPC function with explicit dispatch flags (RPC_FLAG_*).
+   transport_register_function() is equivalent to flags = RPC_FLAG_DEFERRED.
+   Deferred handlers run in CONFIG_RPC_WORKER_COUNT worker tasks; with no
+   workers configured every handler runs inline. */
+int transport_register_function_ex(const char *name, rpc_callback_t callback,
+                                   uint8_t flags);
+
+/* Register an rpc_handler_t under name, with RPC_FLAG_* dispatch flags.
+   Shares the registry with transport_register_function() and returns the
+   same codes; registering an existing name replaces its handler. */
+int transport_register_handler(const char *name, rpc_handler_t handler, uint8_t flags);
+
+/* Cache the responses of name for ttl_ms after each fill (RPC_FLAG_CACHEABLE
+   uses CONFIG_RPC_CACHE_TTL_MS); 0 stops caching it.  Only successful
+   responses are cached, keyed by the exact args, and repeats are
+   answered by the RX task without running the handler.
+   Returns 0, -9 if name is not registered, -1 without a cache
+   (CONFIG_RPC_CACHE_ENTRIES = 0). */
+int transport_set_cache_ttl(const char *name, uint32_t ttl_ms);
+
+/* Forget the cached responses of name (NULL: of every function), e.g.
+   after the data behind them changed. */
+void transport_cache_invalidate(const char *name);
+
+/* Perform a synchronous RPC call.  Safe to call from several tasks at
+   once: each call holds its own slot in the pending table until its
+   response, error or timeout.
    name        - function name (ASCIIZ)
    args        - raw arguments (can be NULL if args_len == 0)
    args_len    - number of bytes in args
@@ -49,11 +212,266 @@ int transport_register_function(const char *name, rpc_callback_t callback);
    resp_len    - out number of bytes in response
    error_code  - out error code (0 on success, nonzero on error)
    timeout_ms  - timeout for waiting a response
-   Returns 0 on success (a response/error was delivered), negative on error. */
+   Returns 0 on success (a response/error was delivered), negative on error
+   (-3 when all pending slots are taken, -7 on timeout). */
 int transport_call(const char *name, const uint8_t *args, uint16_t args_len,
                    uint8_t **response, uint16_t *resp_len,
                    uint8_t *error_code, uint32_t timeout_ms);
 
+/* Same as transport_call(), but the RX task copies the response straight
+   into buf (buf_cap bytes, may be on the caller's stack) instead of
+   handing over a heap copy.  *resp_len is the full response length;
+   when it exceeds buf_cap, buf holds the first buf_cap bytes and -12 is
+   returned.  Other return values as for transport_call(). */
+int transport_call_into(const char *name, const uint8_t *args, uint16_t args_len,
+                        uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                        uint8_t *error_code, uint32_t timeout_ms);
+
+/* Start an RPC call without waiting for the result.
+   The request is sent before returning; callback is invoked exactly once
+   with the response, the remote error or a timeout after timeout_ms.
+   Returns the non-negative request ID on success, negative on error
+   (-3 when all pending slots are taken, -2 if its timeout could not be
+   armed). */
+int transport_call_async(const char *name, const uint8_t *args, uint16_t args_len,
+                         transport_async_cb_t callback, void *ctx,
+                         uint32_t timeout_ms);
+
+/* Resolve a function name on the peer to its numeric ID, for use with
+   transport_call_id().  IDs are stable for the lifetime of the peer's
+   firmware, so resolve once and cache the result; re-resolve if a call
+   by ID fails with ERR_FUNC_NOT_FOUND (e.g. after the peer reboots into
+   different firmware).
+   Returns 0 on success, -9 if the peer has no such function, other
+   negative values as for transport_call(). */
+int transport_resolve(const char *name, uint16_t *func_id, uint32_t timeout_ms);
+
+/* Query the peer's capabilities and enable the common ones.  Until this
+   succeeds, nothing is sent compressed; afterwards args of at least
+   CONFIG_RPC_COMPRESS_MIN bytes are compressed when that makes them
+   shorter, and the peer compresses its responses to such calls.
+   Returns the common RPC_CAP_* bits, -9 if the peer predates "__caps",
+   other negative values as for transport_call(). */
+int transport_negotiate_caps(uint32_t timeout_ms);
+
+/* Same as transport_call(), but sends a compact MSG_TYPE_REQUEST_ID
+   message that carries a 2-byte function ID instead of the name. */
+int transport_call_id(uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                      uint8_t **response, uint16_t *resp_len,
+                      uint8_t *error_code, uint32_t timeout_ms);
+
+// Same as transport_call_into(), addressed by function ID.
+int transport_call_id_into(uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                           uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                           uint8_t *error_code, uint32_t timeout_ms);
+
+// Same as transport_call_async(), addressed by function ID.
+int transport_call_id_async(uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                            transport_async_cb_t callback, void *ctx,
+                            uint32_t timeout_ms);
+
+/* The calls above on a given link (NULL: the default one).  They return
+   -1 for a link that was not attached with transport_attach(). */
+int transport_call_on(rpc_link_t *link, const char *name, const uint8_t *args, uint16_t args_len,
+                      uint8_t **response, uint16_t *resp_len,
+                      uint8_t *error_code, uint32_t timeout_ms);
+int transport_call_into_on(rpc_link_t *link, const char *name, const uint8_t *args, uint16_t args_len,
+                           uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                           uint8_t *error_code, uint32_t timeout_ms);
+int transport_call_async_on(rpc_link_t *link, const char *name, const uint8_t *args, uint16_t args_len,
+                            transport_async_cb_t callback, void *ctx,
+                            uint32_t timeout_ms);
+int transport_call_id_on(rpc_link_t *link, uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                         uint8_t **response, uint16_t *resp_len,
+                         uint8_t *error_code, uint32_t timeout_ms);
+int transport_call_id_into_on(rpc_link_t *link, uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                              uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                              uint8_t *error_code, uint32_t timeout_ms);
+int transport_call_id_async_on(rpc_link_t *link, uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                               transport_async_cb_t callback, void *ctx,
+                               uint32_t timeout_ms);
+int transport_resolve_on(rpc_link_t *link, const char *name, uint16_t *func_id, uint32_t timeout_ms);
+int transport_negotiate_caps_on(rpc_link_t *link, uint32_t timeout_ms);
+
+/* The calls above with per-call options (opts may be NULL).  Return
+   values as for the plain calls, plus -13 when the deadline had passed
+   before the request was sent. */
+int transport_call_opt(const transport_call_opts_t *opts, const char *name,
+                       const uint8_t *args, uint16_t args_len,
+                       uint8_t **response, uint16_t *resp_len,
+                       uint8_t *error_code, uint32_t timeout_ms);
+int transport_call_into_opt(const transport_call_opts_t *opts, const char *name,
+                            const uint8_t *args, uint16_t args_len,
+                            uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                            uint8_t *error_code, uint32_t timeout_ms);
+int transport_call_async_opt(const transport_call_opts_t *opts, const char *name,
+                             const uint8_t *args, uint16_t args_len,
+                             transport_async_cb_t callback, void *ctx, uint32_t timeout_ms);
+int transport_call_id_opt(const transport_call_opts_t *opts, uint16_t func_id,
+                          const uint8_t *args, uint16_t args_len,
+                          uint8_t **response, uint16_t *resp_len,
+                          uint8_t *error_code, uint32_t timeout_ms);
+int transport_call_id_into_opt(const transport_call_opts_t *opts, uint16_t func_id,
+                               const uint8_t *args, uint16_t args_len,
+                               uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                               uint8_t *error_code, uint32_t timeout_ms);
+int transport_call_id_async_opt(const transport_call_opts_t *opts, uint16_t func_id,
+                                const uint8_t *args, uint16_t args_len,
+                                transport_async_cb_t callback, void *ctx, uint32_t timeout_ms);
+
+/* Give up on an async call (transport_call_async*() or batched) by the
+   ID it returned: its callback runs at once, in the calling task, with
+   status -15.  Calls that time out, sync or async, are given up on
+   the same way: in both cases a peer that announces RPC_CAP_CANCEL is sent a
+   MSG_TYPE_CANCEL, so it drops the request if it is still queued and
+   does not send the reply.
+   Returns 0, -1 for a link that is not attached, or -9 if the call is
+   no longer pending. */
+int transport_cancel(uint16_t id);
+int transport_cancel_on(rpc_link_t *link, uint16_t id);
+
+/* For a handler running in a worker task: true once its caller has
+   cancelled the call or stopped waiting for it (the RPC_OPT_DEADLINE it
+   came with, CONFIG_RPC_CALL_DEADLINES), so a long handler can stop
+   early.  Whatever the handler answers then is not sent.  Always false
+   in inline handlers and outside handlers. */
+bool transport_cancelled(void);
+
+/* Send a fire-and-forget MSG_TYPE_STREAM message to a registered function.
+   Returns as soon as the frame is sent; the remote handler runs as usual
+   but its response or error is discarded.  Each stream message carries
+   the next value of a sender-wide sequence counter.
+   Returns 0 on success, negative on error. */
+int transport_stream(const char *name, const uint8_t *args, uint16_t args_len);
+
+// transport_stream() on a given link (NULL: the default one)
+int transport_stream_on(rpc_link_t *link, const char *name, const uint8_t *args, uint16_t args_len);
+
+/* Stream messages received from the default link's peer so far, and how many were lost:
+   gaps in the sequence counter plus messages that arrived but could not
+   be dispatched (unknown function, full worker queue).  Register
+   high-rate stream handlers with RPC_FLAG_INLINE to avoid the latter.
+   Either pointer may be NULL. */
+void transport_stream_stats(uint32_t *received, uint32_t *lost);
+
+/* Transport statistics since boot (CONFIG_RPC_STATS):
+   calls          - calls started: sync, async and batched
+   timeouts       - calls that gave up waiting for their reply (-7)
+   late_responses - responses and errors that found no waiting call
+   busy           - calls refused because every pending slot was taken (-3)
+   busy_replies   - requests this side answered with ERR_BUSY
+   expired        - calls refused because their deadline had passed (-13)
+   cache_hits     - requests answered from the response cache
+   cancels        - calls the peer was told to drop (MSG_TYPE_CANCEL)
+   abandoned      - requests this side dropped unrun, or left unanswered,
+                    because they were cancelled or past their deadline */
+#define TRANSPORT_STATS_FIELDS(X)                                              \
+    X(var, calls) X(var, timeouts) X(var, late_responses)                      \
+    X(var, busy) X(var, busy_replies) X(var, expired)    \
+    X(var, cache_hits) X(var, cancels) X(var, abandoned)
+RPC_CODEC_STRUCT(transport_stats, TRANSPORT_STATS_FIELDS)
+
+/* Per-function statistics: handler runs, and microseconds spent inside
+   the handler (esp_timer_get_time(), which all cores share, so a handler
+   that migrates between cores is still timed right; time the task was
+   preempted counts too). */
+#define RPC_FUNC_STATS_FIELDS(X)  X(var, calls) X(u64, handler_us)
+RPC_CODEC_STRUCT(rpc_func_stats, RPC_FUNC_STATS_FIELDS)
+
+/* Everything "__stats" reports without args: the link counters followed
+   by the transport counters.  New counters are only ever appended. */
+#define RPC_STATS_FIELDS(X) LINK_STATS_FIELDS(X) TRANSPORT_STATS_FIELDS(X)
+RPC_CODEC_STRUCT(rpc_stats, RPC_STATS_FIELDS)
+
+// Copy the current transport counters (all zero without CONFIG_RPC_STATS)
+void transport_get_stats(transport_stats_t *out);
+
+// Counters of a registered function.  Returns 0, or -9 if there is no such function.
+int transport_get_function_stats(const char *name, rpc_func_stats_t *out);
+
+/* Fetch the peer's link and transport counters through "__stats".
+   Returns 0, -9 if the peer does not provide them, -10 on a malformed
+   response, other negative values as for transport_call(). */
+int transport_get_peer_stats(rpc_stats_t *out, uint32_t timeout_ms);
+
+/* Batching: pack several calls into one link-layer frame so small calls
+   share one header, CRC pass and UART write.  buf/cap is the caller's
+   storage for the frame (each entry costs 6 + name length + args bytes,
+   plus 2 bytes overall).  The server answers the inline handlers of a
+   batch with one batched frame; deferred handlers reply individually.
+   Typical use:
+       transport_batch_begin(&b, buf, sizeof(buf));
+       transport_batch_call_async(&b, "sum", a, 8, done, ctx, 1000);
+       transport_batch_call_async(&b, "sum", c, 8, done, ctx, 1000);
+       transport_batch_commit(&b); */
+void transport_batch_begin(transport_batch_t *batch, uint8_t *buf, uint16_t cap);
+
+// Start a batch for a given link (NULL: the default one)
+void transport_batch_begin_on(transport_batch_t *batch, rpc_link_t *link, uint8_t *buf, uint16_t cap);
+
+/* Queue an async call; its pending slot is taken (and its timeout starts)
+   now, the request leaves with the commit.  Returns the request ID, -3
+   when all pending slots are taken, -11 when the batch is full. */
+int transport_batch_call_async(transport_batch_t *batch, const char *name,
+                               const uint8_t *args, uint16_t args_len,
+                               transport_async_cb_t callback, void *ctx,
+                               uint32_t timeout_ms);
+
+// Queue a stream message.  Returns 0, or -11 when the batch is full.
+int transport_batch_stream(transport_batch_t *batch, const char *name,
+                           const uint8_t *args, uint16_t args_len);
+
+/* Send the batch as one frame and reset it for reuse.  On a send error
+   every queued call completes immediately with status -6.
+   Returns 0 on success, negative on error. */
+int transport_batch_commit(transport_batch_t *batch);
+
+
+/* Typed stubs over RPC_CODEC_STRUCT records (rpc_codec.h).
+   RPC_DEFINE_CALL(fn, "name", args, result) defines
+       int fn(const args_t *in, result_t *out, uint8_t *error_code, uint32_t timeout_ms)
+   which encodes in on the stack, calls "name" with
+   transport_call_into() and decodes the response from the stack too
+   (-10 if it is not one result record).  RPC_DEFINE_HANDLER(fn, impl, args, result) defines an
+   rpc_handler_t fn that decodes the args (ERR_INTERNAL if malformed),
+   calls void impl(const args_t *in, result_t *out, uint8_t *error_code)
+   and encodes out on success. */
+#define RPC_DEFINE_CALL(fn, name, args, result)                                \
+    static inline int fn(const args##_t *in, result##_t *out,                  \
+                         uint8_t *error_code, uint32_t timeout_ms) {           \
+        uint8_t args_buf[args##_MAX_SIZE];                                     \
+        rpc_writer_t w;                                                        \
+        rpc_writer_init(&w, args_buf, sizeof(args_buf));                       \
+        args##_put(&w, in);                                                    \
+        uint8_t resp[result##_MAX_SIZE];                                       \
+        uint16_t resp_len = 0;                                                 \
+        int rc = transport_call_into(name, args_buf, w.len, resp, sizeof(resp),\
+                                     &resp_len, error_code, timeout_ms);       \
+        if (rc == -12) rc = -10;                                               \
+        if (rc == 0 && *error_code == 0) {                                     \
+            rpc_reader_t r;                                                    \
+            rpc_reader_init(&r, resp, resp_len);                               \
+            if (!result##_get(&r, out)) rc = -10;                              \
+        }                                                                      \
+        return rc;                                                             \
+    }
+
+#define RPC_DEFINE_HANDLER(fn, impl, args, result)                             \
+    static void fn(const uint8_t *args_data, uint16_t args_len,                \
+                   rpc_writer_t *resp, uint8_t *error_code) {                  \
+        rpc_reader_t r;                                                        \
+        rpc_reader_init(&r, args_data, args_len);                              \
+        args##_t in;                                                           \
+        if (!args##_get(&r, &in)) {                                            \
+            *error_code = ERR_INTERNAL;                                        \
+            return;                                                            \
+        }                                                                      \
+        result##_t out;                                                        \
+        memset(&out, 0, sizeof(out));                                          \
+        impl(&in, &out, error_code);                                           \
+        if (*error_code == 0) result##_put(resp, &out);                        \
+    }
+
 
 #ifdef __cplusplus
 }
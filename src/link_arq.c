@@ -0,0 +1,411 @@
+/* Selective-repeat ARQ for the link layer.  The sender keeps every
+   sequenced frame in a window slot until a cumulative ACK covers it and
+   resends single frames on a NAK or when their retransmission timeout
+   runs out; the timeout follows the measured round-trip time (RFC 6298
+   smoothing, Karn's rule for retransmitted frames).  The receiver
+   delivers frames in sequence order, holding early ones until the gap
+   before them is filled.  All state lives in the link's link_arq_t. */
+
+#include "link_arq.h"
+#include "link_layer.h"
+#include "rpc_config.h"
+#include "rpc_pool.h"
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/timers.h>
+#include <esp_timer.h>
+#include <esp_random.h>
+
+
+#define ARQ_WINDOW CONFIG_RPC_ARQ_WINDOW
+#if ARQ_WINDOW & (ARQ_WINDOW - 1)
+#error "CONFIG_RPC_ARQ_WINDOW must be a power of two"
+#endif
+
+// Retransmission timeout bounds and the initial value before any sample
+#define ARQ_MIN_RTO_US      20000
+#define ARQ_MAX_RTO_US    1000000
+#define ARQ_INITIAL_RTO_US 200000
+
+// Period of the timer that looks for expired frames
+#define ARQ_SWEEP_MS 10
+
+#if ARQ_WINDOW > 0
+static void arq_sweep(TimerHandle_t timer);
+#endif
+
+
+void link_arq_init(link_arq_t *a, rpc_link_t *link) {
+    memset(a, 0, sizeof(*a));
+    a->link = link;
+#if ARQ_WINDOW > 0
+    a->tx_syn   = true;
+    a->rto_us   = ARQ_INITIAL_RTO_US;
+    a->tx_room  = xSemaphoreCreateCounting(ARQ_WINDOW, ARQ_WINDOW);
+    a->tx_lock  = xSemaphoreCreateMutex();
+    a->tx_timer = xTimerCreate("arq_rto", pdMS_TO_TICKS(ARQ_SWEEP_MS), pdTRUE, a, arq_sweep);
+
+    // A random start keeps a rebooted sender from replaying old numbers
+    a->tx_base = a->tx_next = (uint8_t)esp_random();
+    a->tx_session = esp_random();
+#endif
+}
+
+
+bool link_arq_enabled(const link_arq_t *a) {
+#if ARQ_WINDOW > 0
+    return a->tx_lock != NULL;
+#else
+    (void)a;
+    return false;
+#endif
+}
+
+
+// Send [LINK_CTRL_MARKER][op][seq]; never sequenced itself
+static void send_ack_nak(link_arq_t *a, uint8_t op, uint8_t seq) {
+    const uint8_t frame[3] = { LINK_CTRL_MARKER, op, seq };
+    const phys_iovec_t seg = { frame, sizeof(frame) };
+    (void)rpc_link_send_framev(a->link, &seg, 1, LINK_TX_URGENT | LINK_TX_UNSEQ);
+}
+
+
+// Session number of a SYN frame, after its 3-byte header
+static uint32_t get_session(const uint8_t *frame) {
+    return (uint32_t)frame[3] | ((uint32_t)frame[4] << 8) | ((uint32_t)frame[5] << 16) |
+           ((uint32_t)frame[6] << 24);
+}
+
+
+#if ARQ_WINDOW > 0
+// (Re)transmit a window slot (a->tx_lock held)
+static void transmit(link_arq_t *a, link_arq_tx_slot_t *slot, uint8_t flags) {
+    const phys_iovec_t seg = { slot->frame, slot->len };
+    slot->sent_us = esp_timer_get_time();
+    (void)rpc_link_send_framev(a->link, &seg, 1, flags | LINK_TX_UNSEQ);
+}
+
+
+static void put_session(uint8_t *frame, uint32_t session) {
+    frame[3] = (uint8_t)(session & 0xFF);
+    frame[4] = (uint8_t)((session >> 8) & 0xFF);
+    frame[5] = (uint8_t)((session >> 16) & 0xFF);
+    frame[6] = (uint8_t)((session >> 24) & 0xFF);
+}
+
+
+/* Turn a slot's frame into a SYN, which needs room for the session
+   number (a->tx_lock held).  Left as it is when the pool is out of
+   blocks; the next SYNC tries again. */
+static void make_syn(link_arq_t *a, link_arq_tx_slot_t *slot) {
+    const uint16_t len = (uint16_t)(slot->len + (LINK_ARQ_SYN_HDR_LEN - LINK_ARQ_HDR_LEN));
+    uint8_t *frame = (uint8_t *)rpc_pool_alloc(len);
+    if (!frame) return;
+    memcpy(frame, slot->frame, LINK_ARQ_HDR_LEN);
+    frame[2] |= LINK_ARQ_FLAG_SYN;
+    put_session(frame, a->tx_session);
+    memcpy(frame + LINK_ARQ_SYN_HDR_LEN, slot->frame + LINK_ARQ_HDR_LEN, slot->len - LINK_ARQ_HDR_LEN);
+    rpc_pool_free(slot->frame);
+    slot->frame = frame;
+    slot->len   = len;
+}
+
+
+// Fold a round-trip sample into the timeout (a->tx_lock held)
+static void rtt_sample(link_arq_t *a, int64_t r) {
+    if (a->srtt_us == 0) {
+        a->srtt_us   = r;
+        a->rttvar_us = r / 2;
+    } else {
+        const int64_t err = (a->srtt_us > r) ? a->srtt_us - r : r - a->srtt_us;
+        a->rttvar_us = (3 * a->rttvar_us + err) / 4;
+        a->srtt_us   = (7 * a->srtt_us + r) / 8;
+    }
+    int64_t rto = a->srtt_us + 4 * a->rttvar_us;
+    if (rto < ARQ_MIN_RTO_US) rto = ARQ_MIN_RTO_US;
+    if (rto > ARQ_MAX_RTO_US) rto = ARQ_MAX_RTO_US;
+    a->rto_us = rto;
+}
+#endif
+
+
+int link_arq_send(link_arq_t *a, const phys_iovec_t *iov, size_t iovcnt, uint8_t flags, bool may_wait) {
+#if ARQ_WINDOW > 0
+    /* Room for the session number is decided before the lock: a frame
+       with room goes out as a SYN, one without leaves tx_syn for the next */
+    const bool    room_syn = a->tx_syn;
+    const uint8_t hdr_len  = room_syn ? LINK_ARQ_SYN_HDR_LEN : LINK_ARQ_HDR_LEN;
+    size_t length = hdr_len;
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (!iov[i].base && iov[i].len > 0) {
+            return -1;
+        }
+        length += iov[i].len;
+    }
+    if (length > 0xFFFF) {
+        return -1;
+    }
+
+    // The window is the back-pressure: no slot, no send
+    bool counted = true;
+    if (xSemaphoreTake(a->tx_room, may_wait ? pdMS_TO_TICKS(CONFIG_RPC_TX_QUEUE_WAIT_MS) : 0) != pdTRUE) {
+        if (may_wait) return -2;
+        counted = false;  // over the window, checked against LINK_ARQ_RX_SLOTS below
+    }
+    uint8_t *frame = (uint8_t *)rpc_pool_alloc(length);
+    if (!frame) {
+        if (counted) xSemaphoreGive(a->tx_room);
+        return -3;
+    }
+    uint8_t *p = frame + hdr_len;
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (iov[i].len > 0) memcpy(p, iov[i].base, iov[i].len);
+        p += iov[i].len;
+    }
+
+    xSemaphoreTake(a->tx_lock, portMAX_DELAY);
+    if (!counted && (uint8_t)(a->tx_next - a->tx_base) >= LINK_ARQ_RX_SLOTS) {
+        xSemaphoreGive(a->tx_lock);
+        rpc_pool_free(frame);
+        return -2;
+    }
+    const uint8_t seq = a->tx_next++;
+    frame[0] = LINK_ARQ_MARKER;
+    frame[1] = seq;
+    frame[2] = 0;
+    if (room_syn) {
+        frame[2] = LINK_ARQ_FLAG_SYN;
+        put_session(frame, a->tx_session);
+        a->tx_syn = false;
+    }
+
+    link_arq_tx_slot_t *slot = &a->tx[seq % LINK_ARQ_RX_SLOTS];
+    slot->frame   = frame;
+    slot->len     = (uint16_t)length;
+    slot->tries   = 1;
+    slot->counted = counted;
+    // Sent under the lock so frames leave in sequence order
+    transmit(a, slot, flags & (LINK_TX_URGENT | LINK_TX_NOWAIT));
+
+    /* A frame the TX queue refused is resent by the sweep like a lost
+       one.  The timer runs free while frames are in flight: starting an
+       active one would push its expiry back on every send. */
+    if (!a->tx_timer_on) a->tx_timer_on = (xTimerStart(a->tx_timer, 0) == pdPASS);
+    xSemaphoreGive(a->tx_lock);
+    return 0;
+#else
+    (void)a;
+    (void)iov;
+    (void)iovcnt;
+    (void)flags;
+    (void)may_wait;
+    return -1;
+#endif
+}
+
+
+#if ARQ_WINDOW > 0
+/* Timer callback: resend frames whose timeout ran out, doubling the
+   timeout for every further attempt.  Like the transport's async sweep it
+   never blocks on the lock; a busy lock postpones it to the next period. */
+static void arq_sweep(TimerHandle_t timer) {
+    link_arq_t *a = (link_arq_t *)pvTimerGetTimerID(timer);
+    if (xSemaphoreTake(a->tx_lock, 0) != pdTRUE) return;
+
+    const int64_t now = esp_timer_get_time();
+    for (uint8_t seq = a->tx_base; seq != a->tx_next; seq++) {
+        link_arq_tx_slot_t *slot = &a->tx[seq % LINK_ARQ_RX_SLOTS];
+        if (!slot->frame) continue;
+
+        int64_t rto = a->rto_us << ((slot->tries < 6) ? slot->tries - 1 : 5);
+        if (rto > ARQ_MAX_RTO_US) rto = ARQ_MAX_RTO_US;
+        if (now - slot->sent_us < rto) continue;
+
+        if (slot->tries < UINT8_MAX) slot->tries++;
+        a->retransmits++;
+        transmit(a, slot, LINK_TX_URGENT);
+    }
+    // Stopped under the lock, so a send that follows queues its start after the stop
+    if (a->tx_base == a->tx_next) {
+        (void)xTimerStop(timer, 0);
+        a->tx_timer_on = false;
+    }
+    xSemaphoreGive(a->tx_lock);
+}
+#endif
+
+
+void link_arq_control(link_arq_t *a, uint8_t op, const uint8_t *frame, uint16_t len) {
+#if ARQ_WINDOW > 0
+    if (len < 3) return;
+    const uint8_t seq = frame[2];
+    const int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(a->tx_lock, portMAX_DELAY);
+    const uint8_t in_flight = (uint8_t)(a->tx_next - a->tx_base);
+    if (op == LINK_CTRL_ARQ_ACK) {
+        // Cumulative: everything before seq has arrived
+        uint8_t acked = (uint8_t)(seq - a->tx_base);
+        if (acked > in_flight) acked = 0;  // stale or bogus ACK
+        int64_t sample = -1;
+        for (; acked > 0; acked--, a->tx_base++) {
+            link_arq_tx_slot_t *slot = &a->tx[a->tx_base % LINK_ARQ_RX_SLOTS];
+            if (!slot->frame) continue;
+            // Karn: only frames sent once give an unambiguous sample
+            sample = (slot->tries == 1) ? now - slot->sent_us : -1;
+            rpc_pool_free(slot->frame);
+            slot->frame = NULL;
+            if (slot->counted) xSemaphoreGive(a->tx_room);
+        }
+        if (sample >= 0) rtt_sample(a, sample);
+    } else if (op == LINK_CTRL_ARQ_SYNC) {
+        /* The peer has not joined our stream (its first frame was lost,
+           or it rebooted): make the oldest frame it has not acknowledged
+           the start of the stream.  Requests it sent before joining all
+           arrive ahead of the ACK that moves tx_base past that frame. */
+        if (in_flight == 0) {
+            a->tx_syn = true;
+        } else {
+            link_arq_tx_slot_t *slot = &a->tx[a->tx_base % LINK_ARQ_RX_SLOTS];
+            if (slot->frame && !(slot->frame[2] & LINK_ARQ_FLAG_SYN)) make_syn(a, slot);
+            if (slot->frame) {
+                if (slot->tries < UINT8_MAX) slot->tries++;
+                a->retransmits++;
+                transmit(a, slot, LINK_TX_URGENT);
+            }
+        }
+    } else if (op == LINK_CTRL_ARQ_NAK) {
+        if ((uint8_t)(seq - a->tx_base) < in_flight) {
+            link_arq_tx_slot_t *slot = &a->tx[seq % LINK_ARQ_RX_SLOTS];
+            if (slot->frame) {
+                if (slot->tries < UINT8_MAX) slot->tries++;
+                a->retransmits++;
+                transmit(a, slot, LINK_TX_URGENT);
+            }
+        }
+    }
+    xSemaphoreGive(a->tx_lock);
+#else
+    (void)a;
+    (void)op;
+    (void)frame;
+    (void)len;
+#endif
+}
+
+
+// Drop held frames and restart delivery at seq
+static void rx_reset(link_arq_t *a, uint8_t seq) {
+    for (size_t i = 0; i < LINK_ARQ_RX_SLOTS; i++) {
+        rpc_pool_free(a->rx_hold[i].data);
+        a->rx_hold[i].data = NULL;
+    }
+    a->rx_deliver  = seq;
+    a->rx_next     = seq;
+    a->rx_nak_sent = false;
+    a->rx_synced   = true;
+}
+
+
+// The frame at a->rx_next arrived: move past it and any held after it, then ACK
+static void advance_next(link_arq_t *a) {
+    do {
+        a->rx_next++;
+    } while ((uint8_t)(a->rx_next - a->rx_deliver) < LINK_ARQ_RX_SLOTS &&
+             a->rx_hold[a->rx_next % LINK_ARQ_RX_SLOTS].data);
+    a->rx_nak_sent = false;
+    send_ack_nak(a, LINK_CTRL_ARQ_ACK, a->rx_next);
+}
+
+
+int link_arq_receive(link_arq_t *a, uint8_t *buffer, uint16_t length, uint16_t buffer_size,
+                     uint16_t *out_len) {
+    const uint16_t have = (length < buffer_size) ? length : buffer_size;
+    if (have < LINK_ARQ_HDR_LEN) return -1;
+
+    const uint8_t seq   = buffer[1];
+    const uint8_t flags = buffer[2];
+    const uint8_t hdr_len = (flags & LINK_ARQ_FLAG_SYN) ? LINK_ARQ_SYN_HDR_LEN : LINK_ARQ_HDR_LEN;
+    if (have < hdr_len) return -1;
+
+    /* A SYN of another session starts a new stream (the peer rebooted, or
+       we did); one of ours is resent or flagged late and changes nothing.
+       Frames of a stream we have not joined are dropped: joining at any
+       other number could ACK frames before it that never arrived. */
+    const uint32_t session = (flags & LINK_ARQ_FLAG_SYN) ? get_session(buffer) : 0;
+    if ((flags & LINK_ARQ_FLAG_SYN) && (!a->rx_syn_seen || session != a->rx_session)) {
+        a->rx_syn_seen = true;
+        a->rx_session  = session;
+        rx_reset(a, seq);
+    } else if (!a->rx_synced) {
+        send_ack_nak(a, LINK_CTRL_ARQ_SYNC, seq);
+        return -1;
+    }
+
+    const uint8_t off  = (uint8_t)(seq - a->rx_deliver);
+    const uint8_t span = (uint8_t)(a->rx_next - a->rx_deliver);  // received, not yet handed up
+    if (off >= LINK_ARQ_RX_SLOTS || off < span || a->rx_hold[seq % LINK_ARQ_RX_SLOTS].data) {
+        // Duplicate (our ACK was lost) or far outside the window
+        send_ack_nak(a, LINK_CTRL_ARQ_ACK, a->rx_next);
+        return -1;
+    }
+
+    const uint16_t payload_len = (uint16_t)(length - hdr_len);
+    if (off == 0 && span == 0) {
+        /* Next in order with nothing waiting before it: hand it up straight
+           from the buffer.  Frames held behind it follow on later calls.
+           One cut short by the buffer is still acknowledged, as sending
+           it again would not make it fit. */
+        memmove(buffer, buffer + hdr_len, have - hdr_len);
+        a->rx_deliver++;
+        advance_next(a);
+        *out_len = payload_len;
+        return (length <= buffer_size) ? 0 : -4;
+    }
+
+    // Early (or queued behind held frames): keep a copy until its turn
+    if (length > buffer_size) return -1;  // a partial frame cannot be held
+    uint8_t *copy = (uint8_t *)rpc_pool_alloc(payload_len > 0 ? payload_len : 1);
+    if (!copy) return -1;
+    memcpy(copy, buffer + hdr_len, payload_len);
+    a->rx_hold[seq % LINK_ARQ_RX_SLOTS].data = copy;
+    a->rx_hold[seq % LINK_ARQ_RX_SLOTS].len  = payload_len;
+
+    if (seq == a->rx_next) {
+        advance_next(a);
+    } else if (!a->rx_nak_sent) {
+        // Gap before this frame: ask for the missing one now
+        send_ack_nak(a, LINK_CTRL_ARQ_NAK, a->rx_next);
+        a->rx_nak_sent = true;
+    }
+    return -1;
+}
+
+
+bool link_arq_next_held(link_arq_t *a, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len) {
+    if (a->rx_deliver == a->rx_next) return false;
+
+    const size_t i = a->rx_deliver % LINK_ARQ_RX_SLOTS;
+    const uint16_t len = a->rx_hold[i].len;
+    memcpy(buffer, a->rx_hold[i].data, (len < buffer_size) ? len : buffer_size);
+    *out_len = len;
+    rpc_pool_free(a->rx_hold[i].data);
+    a->rx_hold[i].data = NULL;
+    a->rx_deliver++;
+    return true;
+}
+
+
+void link_arq_rx_error(link_arq_t *a) {
+    if (a->rx_synced && !a->rx_nak_sent) {
+        send_ack_nak(a, LINK_CTRL_ARQ_NAK, a->rx_next);
+        a->rx_nak_sent = true;
+    }
+}
+
+
+void link_arq_stats(const link_arq_t *a, uint32_t *retransmits, uint32_t *srtt_us) {
+    if (retransmits) *retransmits = a->retransmits;
+    if (srtt_us)     *srtt_us     = (uint32_t)a->srtt_us;
+}
@@ -0,0 +1,267 @@
+/* Channel bonding over two member links (see link_bond.h).  Each member
+   keeps its own framing, RX task and (optionally) ARQ; this file only
+   cuts messages into fragments on the way out and puts them back
+   together, in sequence order, on the way in. */
+
+#include "link_bond.h"
+#include "link_layer.h"
+#include "rpc_config.h"
+#include "rpc_pool.h"
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+
+// Unbonded frames waiting for the consumer
+#define BOND_PLAIN_QUEUE_LEN 4
+
+// An unbonded frame from a member, pool allocated
+typedef struct {
+    uint16_t len;    // full frame length
+    uint16_t have;   // bytes kept in data (less if the member truncated it)
+    uint8_t  data[];
+} bond_plain_t;
+
+// Bit mask of a message that arrived complete
+#define FULL_MASK(count) ((uint8_t)((1u << (count)) - 1))
+
+static void bond_rx_task(void *arg);
+
+
+int link_bond_init(link_bond_t *bond, rpc_link_t *a, rpc_link_t *b) {
+    memset(bond, 0, sizeof(*bond));
+    bond->members[0] = (link_bond_member_t){ bond, a };
+    bond->members[1] = (link_bond_member_t){ bond, b };
+    portMUX_INITIALIZE(&bond->tx_lock);
+
+    bond->rx_lock  = xSemaphoreCreateMutex();
+    bond->rx_ready = xSemaphoreCreateBinary();
+    bond->rx_plain = xQueueCreate(BOND_PLAIN_QUEUE_LEN, sizeof(bond_plain_t *));
+    if (!bond->rx_lock || !bond->rx_ready || !bond->rx_plain) {
+        return -1;
+    }
+    for (size_t i = 0; i < LINK_BOND_MEMBERS; i++) {
+        if (xTaskCreate(bond_rx_task, "bond_rx", CONFIG_RPC_BOND_TASK_STACK_SIZE, &bond->members[i],
+                        CONFIG_RPC_BOND_TASK_PRIORITY, NULL) != pdPASS) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+int link_bond_send(link_bond_t *bond, const phys_iovec_t *iov, size_t iovcnt, uint8_t flags,
+                   int64_t deadline_us) {
+    if ((!iov && iovcnt > 0) || iovcnt > LINK_MAX_IOV - 1) {
+        return -1;
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (!iov[i].base && iov[i].len > 0) {
+            return -1;
+        }
+        length += iov[i].len;
+    }
+    if (length > 0xFFFF) {
+        return -1;
+    }
+
+    portENTER_CRITICAL(&bond->tx_lock);
+    const uint8_t seq   = bond->tx_seq++;
+    const uint8_t first = bond->tx_turn;
+    bond->tx_turn = (uint8_t)((first + 1) % LINK_BOND_MEMBERS);
+    portEXIT_CRITICAL(&bond->tx_lock);
+
+    const uint8_t count  = (length >= CONFIG_RPC_BOND_STRIPE_MIN) ? LINK_BOND_MEMBERS : 1;
+    const size_t  stripe = (length + count - 1) / count;
+    for (uint8_t idx = 0; idx < count; idx++) {
+        const size_t off = idx * stripe;
+        const size_t len = (length - off < stripe) ? length - off : stripe;
+        const uint8_t hdr[LINK_BOND_HDR_LEN] = {
+            LINK_BOND_MARKER, seq, (uint8_t)((idx << 4) | count),
+            (uint8_t)(length & 0xFF), (uint8_t)((length >> 8) & 0xFF),
+        };
+        phys_iovec_t seg[LINK_MAX_IOV];
+        seg[0] = (phys_iovec_t){ hdr, sizeof(hdr) };
+        const size_t n = 1 + link_iov_slice(iov, iovcnt, off, len, &seg[1]);
+
+        // A lost half makes the receiver give up on the message after its reorder timeout
+        const int rc = rpc_link_send_framev_until(bond->members[(first + idx) % LINK_BOND_MEMBERS].link,
+                                                  seg, n, flags, deadline_us);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+
+// Free a reassembly slot (rx_lock held)
+static void slot_free(link_bond_slot_t *slot) {
+    rpc_pool_free(slot->data);
+    slot->data = NULL;
+}
+
+
+/* File a received fragment (member task).  Both sides start at sequence
+   number 0, so the first messages may arrive in any order.  Fragments of
+   messages the receiver has given up on are dropped; one too far ahead
+   of the window (this side restarted, or a long outage) moves the window
+   up to it. */
+static void bond_store(link_bond_t *bond, const uint8_t *frame, uint16_t len) {
+    if (len < LINK_BOND_HDR_LEN) return;
+    const uint8_t  seq   = frame[1];
+    const uint8_t  idx   = (uint8_t)(frame[2] >> 4);
+    const uint8_t  count = (uint8_t)(frame[2] & 0x0F);
+    const uint16_t total = (uint16_t)(frame[3] | (frame[4] << 8));
+    if (count == 0 || count > 8 || idx >= count) return;
+
+    const size_t stripe = ((size_t)total + count - 1) / count;
+    const size_t off    = idx * stripe;
+    const size_t flen   = (off >= total) ? 0 : ((total - off < stripe) ? total - off : stripe);
+    if ((size_t)(len - LINK_BOND_HDR_LEN) != flen) return;
+
+    xSemaphoreTake(bond->rx_lock, portMAX_DELAY);
+    uint8_t ahead = (uint8_t)(seq - bond->rx_next);
+    if (ahead >= LINK_BOND_SLOTS) {
+        if (ahead >= 256 - LINK_BOND_SLOTS) {
+            // Late piece of a message already given up on
+            xSemaphoreGive(bond->rx_lock);
+            return;
+        }
+        const uint8_t next = (uint8_t)(seq - (LINK_BOND_SLOTS - 1));
+        for (; bond->rx_next != next; bond->rx_next++) {
+            slot_free(&bond->rx[bond->rx_next % LINK_BOND_SLOTS]);
+        }
+        bond->rx_stalled = false;
+    }
+
+    link_bond_slot_t *slot = &bond->rx[seq % LINK_BOND_SLOTS];
+    if (slot->data && (slot->total != total || slot->count != count)) {
+        slot_free(slot);  // leftover of an older message in the same slot
+    }
+    if (!slot->data) {
+        slot->data = (uint8_t *)rpc_pool_alloc(total > 0 ? total : 1);
+        slot->total = total;
+        slot->count = count;
+        slot->got   = 0;
+    }
+    bool complete = false;
+    if (slot->data && !(slot->got & (1u << idx))) {
+        if (flen > 0) memcpy(slot->data + off, frame + LINK_BOND_HDR_LEN, flen);
+        slot->got |= (uint8_t)(1u << idx);
+        complete = (slot->got == FULL_MASK(count));
+    }
+    xSemaphoreGive(bond->rx_lock);
+
+    if (complete) xSemaphoreGive(bond->rx_ready);
+}
+
+
+/* Queue an unbonded frame for the consumer (member task).  A consumer
+   that falls behind by CONFIG_RPC_BOND_REORDER_MS loses the frame, so
+   the member keeps filing the bonded fragments behind it. */
+static void bond_pass(link_bond_t *bond, const uint8_t *frame, uint16_t len, uint16_t have) {
+    bond_plain_t *plain = (bond_plain_t *)rpc_pool_alloc(sizeof(bond_plain_t) + have);
+    if (!plain) return;
+    plain->len  = len;
+    plain->have = have;
+    memcpy(plain->data, frame, have);
+    if (xQueueSend(bond->rx_plain, &plain, pdMS_TO_TICKS(CONFIG_RPC_BOND_REORDER_MS)) != pdTRUE) {
+        rpc_pool_free(plain);
+        return;
+    }
+    xSemaphoreGive(bond->rx_ready);
+}
+
+
+// Receives the frames of one member and files them
+static void bond_rx_task(void *arg) {
+    link_bond_member_t *member = (link_bond_member_t *)arg;
+    uint8_t *buf = (uint8_t *)pvPortMalloc(CONFIG_RPC_RX_FRAME_SIZE);
+    if (!buf) {
+        vTaskDelete(NULL);
+        return;
+    }
+
+    for (;;) {
+        uint16_t len = 0;
+        const int rc = rpc_link_receive_frame(member->link, buf, CONFIG_RPC_RX_FRAME_SIZE, &len);
+        if ((rc != 0 && rc != -4) || len == 0) continue;
+
+        const uint16_t have = (len < CONFIG_RPC_RX_FRAME_SIZE) ? len : CONFIG_RPC_RX_FRAME_SIZE;
+        if (buf[0] != LINK_BOND_MARKER) {
+            bond_pass(member->bond, buf, len, have);
+        } else if (rc == 0) {
+            bond_store(member->bond, buf, len);
+        }
+        // a truncated fragment cannot be reassembled: dropped
+    }
+}
+
+
+/* Hand up the message at rx_next if it is complete (rx_lock held).  If
+   it is not while a later one is, it is given up after
+   CONFIG_RPC_BOND_REORDER_MS.  Returns false if nothing is ready. */
+static bool bond_next(link_bond_t *bond, uint8_t *buffer, uint16_t buffer_size,
+                      uint16_t *out_len, int *rc) {
+    for (;;) {
+        link_bond_slot_t *slot = &bond->rx[bond->rx_next % LINK_BOND_SLOTS];
+        if (slot->data && slot->got == FULL_MASK(slot->count)) {
+            memcpy(buffer, slot->data, (slot->total < buffer_size) ? slot->total : buffer_size);
+            *out_len = slot->total;
+            *rc = (slot->total <= buffer_size) ? 0 : -4;
+            slot_free(slot);
+            bond->rx_next++;
+            bond->rx_stalled = false;
+            return true;
+        }
+
+        bool later = false;
+        for (uint8_t i = 1; i < LINK_BOND_SLOTS && !later; i++) {
+            const link_bond_slot_t *s = &bond->rx[(uint8_t)(bond->rx_next + i) % LINK_BOND_SLOTS];
+            later = (s->data && s->got == FULL_MASK(s->count));
+        }
+        const TickType_t now = xTaskGetTickCount();
+        if (!later) {
+            bond->rx_stalled = false;
+            return false;
+        }
+        if (!bond->rx_stalled) {
+            bond->rx_stalled = true;
+            bond->rx_stall_since = now;
+            return false;
+        }
+        if (now - bond->rx_stall_since < pdMS_TO_TICKS(CONFIG_RPC_BOND_REORDER_MS)) {
+            return false;
+        }
+        slot_free(slot);
+        bond->rx_next++;
+        bond->rx_stalled = false;
+    }
+}
+
+
+int link_bond_receive(link_bond_t *bond, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len) {
+    for (;;) {
+        bond_plain_t *plain = NULL;
+        if (xQueueReceive(bond->rx_plain, &plain, 0) == pdTRUE) {
+            memcpy(buffer, plain->data, (plain->have < buffer_size) ? plain->have : buffer_size);
+            *out_len = plain->len;
+            const int rc = (plain->len <= buffer_size) ? 0 : -4;
+            rpc_pool_free(plain);
+            return rc;
+        }
+
+        int rc = 0;
+        xSemaphoreTake(bond->rx_lock, portMAX_DELAY);
+        const bool ready = bond_next(bond, buffer, buffer_size, out_len, &rc);
+        xSemaphoreGive(bond->rx_lock);
+        if (ready) {
+            return rc;
+        }
+        (void)xSemaphoreTake(bond->rx_ready, pdMS_TO_TICKS(CONFIG_RPC_BOND_REORDER_MS));
+    }
+}
@@ -1,37 +1,525 @@
 // This file implements the link-layer framing logic.  
 
 #include "link_layer.h"
+#include "link_arq.h"
+#include "link_bond.h"
+#include "link_route.h"
 #include "physical.h"
+#include "rpc_config.h"
+#include "rpc_pool.h"
+#include "rpc_stats.h"
 #include <string.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
 
 
-// Compute CRC-8 using polynomial x^8 + x^2 + x + 1 (0x07)
-static uint8_t crc8_calc(const uint8_t *data, size_t length) {
-    uint8_t crc = 0;
+// Standard rates baud negotiation chooses from, ascending
+static const uint32_t s_baud_rates[] = {
+    PHYS_UART_BAUDRATE, 230400, 460800, 921600, 1500000, 2000000, 3000000,
+};
+#define BAUD_RATE_COUNT (sizeof(s_baud_rates) / sizeof(s_baud_rates[0]))
+
+// Error burst window for the fallback to PHYS_UART_BAUDRATE
+#define BAUD_ERROR_WINDOW_MS 1000
+
+// Bytes skipped while hunting for a start byte that count as one error
+#define STRAY_BYTES_PER_ERROR 32
+
+#if CONFIG_RPC_TX_QUEUE_LEN > 0
+// A fully framed packet waiting for the sender task (pool allocated)
+typedef struct {
+    size_t  len;
+    int64_t deadline_us;   // dropped if still queued then; 0: never
+    uint8_t data[];
+} tx_frame_t;
+
+// Lane for errors and short responses; drained before tx_normal
+#define TX_URGENT_QUEUE_LEN (CONFIG_RPC_TX_QUEUE_LEN / 4 + 1)
+#endif
+
+#if CONFIG_RPC_LINK_SPLIT_SIZE > 0
+// Parts one payload is split into at most; longer payloads get longer parts
+#define PART_MAX_COUNT 255
+#endif
+
+/* Split payloads joined at the same time.  The normal lane overtakes the
+   bulk one, so the parts of a normal payload can arrive in the middle of
+   a bulk one; urgent payloads are never split. */
+#define PART_RX_SLOTS  2
+
+// A split payload being put back together (RX task only; see LINK_PART_MARKER)
+typedef struct {
+    uint8_t *data;           // allocated on the first part, as big as the caller's buffer
+    uint16_t cap;
+    uint32_t len;            // bytes received so far, including any beyond cap
+    bool     active;
+    uint8_t  seq;
+    uint8_t  next;           // index of the part expected next
+    uint8_t  count;
+} part_rx_t;
+
+// One link: a medium (or the members of a bond) and everything above it
+struct rpc_link {
+    phys_port_t *phys;       // &own_phys, or the default port for the default link
+    phys_port_t  own_phys;
+    link_bond_t *bond;       // set for a bonded link, which has no medium of its own
+    link_route_view_t *view; // set for a view of a remote node (rpc_link_remote())
+    void        *context;    // rpc_link_set_context()
+    uint8_t      address;    // of this node on the link, 0: none
+    bool         routed;     // read by the routing task (link_route_start())
+
+    uint32_t baud_current;
+    uint32_t baud_cap;                 // lowered after a fallback
+    SemaphoreHandle_t baud_accepted;   // given when BAUD_ACCEPT arrives
+    volatile bool baud_waiting;        // a proposal of ours is outstanding
+    uint32_t baud_agreed;
+
+#if CONFIG_RPC_TX_QUEUE_LEN > 0
+    QueueHandle_t tx_urgent;
+    QueueHandle_t tx_normal;
+    QueueHandle_t tx_bulk;             // LINK_TX_BULK frames, drained last
+    TaskHandle_t  tx_task;
+#endif
+#if CONFIG_RPC_LINK_SPLIT_SIZE > 0
+    SemaphoreHandle_t tx_split_lock;   // keeps the parts of one payload together
+    uint8_t tx_part_seq;
+#endif
+
+    // Task that calls rpc_link_receive_frame(); it must never wait for ARQ window room
+    TaskHandle_t rx_task;
+
+    // Receive error accounting (RX task only)
+    uint16_t   rx_errors;
+    uint16_t   rx_stray;
+    TickType_t rx_error_window;
+
+    /* Bytes fetched from the physical layer but not parsed yet.  Only the
+       RX task calls rpc_link_receive_frame(), so a single buffer is enough. */
+    uint8_t rx_chunk[LINK_RX_CHUNK];
+    size_t  rx_pos;
+    size_t  rx_len;
+
+    // Split payloads being put back together, keyed by their sequence number
+    part_rx_t rx_part[PART_RX_SLOTS];
+    uint8_t   rx_part_evict; // slot a new payload takes when none is free
+
+    link_arq_t arq;
+
+    // Counters behind rpc_link_get_stats(); retransmits come from link_arq.c
+    struct { LINK_STATS_FIELDS(RPC_STAT_FIELD_) } stats;
+};
+
+// The link behind link_init() and the functions without a link argument
+static rpc_link_t s_default_link;
+
+_Static_assert(LINK_PAYLOAD_HDR_MAX >= LINK_ARQ_SYN_HDR_LEN + LINK_ADDR_HDR_LEN + LINK_BOND_HDR_LEN,
+               "LINK_PAYLOAD_HDR_MAX must cover every header the link adds");
+
+
+/* CRC-8 lookup table for polynomial x^8 + x^2 + x + 1 (0x07), init 0,
+   no reflection.  Entry i is the CRC of the single byte i; kept in DRAM
+   so lookups from the RX path never wait on the flash cache. */
+static const DRAM_ATTR uint8_t crc8_table[256] = {
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+    0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65, 0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D,
+    0xE0, 0xE7, 0xEE, 0xE9, 0xFC, 0xFB, 0xF2, 0xF5, 0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+    0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85, 0xA8, 0xAF, 0xA6, 0xA1, 0xB4, 0xB3, 0xBA, 0xBD,
+    0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2, 0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA,
+    0xB7, 0xB0, 0xB9, 0xBE, 0xAB, 0xAC, 0xA5, 0xA2, 0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+    0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32, 0x1F, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0D, 0x0A,
+    0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42, 0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A,
+    0x89, 0x8E, 0x87, 0x80, 0x95, 0x92, 0x9B, 0x9C, 0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+    0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC, 0xC1, 0xC6, 0xCF, 0xC8, 0xDD, 0xDA, 0xD3, 0xD4,
+    0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C, 0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44,
+    0x19, 0x1E, 0x17, 0x10, 0x05, 0x02, 0x0B, 0x0C, 0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+    0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B, 0x76, 0x71, 0x78, 0x7F, 0x6A, 0x6D, 0x64, 0x63,
+    0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B, 0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13,
+    0xAE, 0xA9, 0xA0, 0xA7, 0xB2, 0xB5, 0xBC, 0xBB, 0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+    0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB, 0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3,
+};
+
+
+// Continue a CRC-8 over a block of bytes (one table lookup per byte)
+static inline uint8_t crc8_block(uint8_t crc, const uint8_t *data, size_t length) {
     for (size_t i = 0; i < length; i++) {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++) {
-            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
-        }
+        crc = crc8_table[crc ^ data[i]];
     }
     return crc;
 }
 
 
 /* Incrementally update a CRC-8 value with one byte.  Uses the same
-   polynomial (0x07) as crc8_calc(). */
-static uint8_t crc8_update(uint8_t crc, uint8_t byte) {
-    crc ^= byte;
-    for (int j = 0; j < 8; j++) {
-        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+   polynomial (0x07) as crc8_block(). */
+static inline uint8_t crc8_update(uint8_t crc, uint8_t byte) {
+    return crc8_table[crc ^ byte];
+}
+
+
+// Compute CRC-8 of a buffer, as used in the frame header and trailer
+uint8_t link_crc8(const uint8_t *data, size_t length) {
+    return crc8_block(0, data, length);
+}
+
+
+#if CONFIG_RPC_TX_QUEUE_LEN > 0
+/* Sender task of a link: writes queued frames to the physical layer,
+   urgent lane first, bulk lane last, and drops those whose deadline has
+   passed.  Woken by a notification for every frame queued. */
+static void link_tx_task(void *arg) {
+    rpc_link_t *link = (rpc_link_t *)arg;
+
+    for (;;) {
+        tx_frame_t *frame = NULL;
+        if (xQueueReceive(link->tx_urgent, &frame, 0) != pdTRUE &&
+            xQueueReceive(link->tx_normal, &frame, 0) != pdTRUE &&
+            xQueueReceive(link->tx_bulk, &frame, 0) != pdTRUE) {
+            (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (frame->deadline_us != 0 && esp_timer_get_time() > frame->deadline_us) {
+            RPC_STAT_INC(link->stats.deadline_drops);
+        } else {
+            const phys_iovec_t seg = { frame->data, frame->len };
+            (void)physical_port_sendv(link->phys, &seg, 1);
+        }
+        rpc_pool_free(frame);
     }
-    return crc;
+}
+#endif
+
+
+// Set up a link over an open port: its baud state, ARQ and TX queue
+static int link_setup(rpc_link_t *link, phys_port_t *phys) {
+    link->phys         = phys;
+    link->address      = CONFIG_RPC_NODE_ADDRESS;
+    link->baud_current = PHYS_UART_BAUDRATE;
+    link->baud_cap     = CONFIG_RPC_UART_MAX_BAUDRATE;
+    link->baud_accepted = xSemaphoreCreateBinary();
+    link_arq_init(&link->arq, link);
+    rpc_pool_init();
+    if (!link->baud_accepted) {
+        return -1;
+    }
+#if CONFIG_RPC_LINK_SPLIT_SIZE > 0
+    link->tx_split_lock = xSemaphoreCreateMutex();
+    if (!link->tx_split_lock) {
+        return -1;
+    }
+#endif
+
+#if CONFIG_RPC_TX_QUEUE_LEN > 0
+    link->tx_urgent = xQueueCreate(TX_URGENT_QUEUE_LEN, sizeof(tx_frame_t *));
+    link->tx_normal = xQueueCreate(CONFIG_RPC_TX_QUEUE_LEN, sizeof(tx_frame_t *));
+    link->tx_bulk   = xQueueCreate(CONFIG_RPC_TX_QUEUE_LEN, sizeof(tx_frame_t *));
+    if (link->tx_urgent && link->tx_normal && link->tx_bulk) {
+        (void)xTaskCreate(link_tx_task, "link_tx", 3072, link,
+                          CONFIG_RPC_TX_TASK_PRIORITY, &link->tx_task);
+    }
+#endif
+    return 0;
 }
 
 
 void link_init(void) {
-    // nothing to init here
+    (void)link_setup(&s_default_link, physical_default_port());
+}
+
+
+rpc_link_t *rpc_link_default(void) {
+    return &s_default_link;
+}
+
+
+rpc_link_t *rpc_link_create(const phys_backend_t *backend, void *phys_ctx) {
+    rpc_link_t *link = (rpc_link_t *)pvPortMalloc(sizeof(rpc_link_t));
+    if (!link) {
+        return NULL;
+    }
+    memset(link, 0, sizeof(*link));
+    if (physical_port_init(&link->own_phys, backend, phys_ctx) != 0 ||
+        link_setup(link, &link->own_phys) != 0) {
+        vPortFree(link);  // keeps whatever the backend allocated; creation is a boot-time step
+        return NULL;
+    }
+    return link;
+}
+
+
+rpc_link_t *rpc_link_bond(rpc_link_t *a, rpc_link_t *b) {
+    if (!a || !b || a == b || a->bond || b->bond) {
+        return NULL;
+    }
+    rpc_link_t *link = (rpc_link_t *)pvPortMalloc(sizeof(rpc_link_t));
+    link_bond_t *bond = (link_bond_t *)pvPortMalloc(sizeof(link_bond_t));
+    if (!link || !bond) {
+        vPortFree(link);
+        vPortFree(bond);
+        return NULL;
+    }
+    memset(link, 0, sizeof(*link));
+    if (link_bond_init(bond, a, b) != 0) {
+        vPortFree(link);
+        vPortFree(bond);
+        return NULL;
+    }
+    link->bond    = bond;
+    link->address = CONFIG_RPC_NODE_ADDRESS;
+    return link;
+}
+
+
+/* Have the routing task read link, unless it does already or the link
+   is attached: the transport's RX task routes inside
+   rpc_link_receive_frame() then, and a second reader would steal its
+   frames */
+static int route_start(rpc_link_t *link) {
+    if (link->routed || link->context) return 0;
+    if (link_route_start(link) != 0) return -1;
+    link->routed = true;
+    return 0;
+}
+
+
+rpc_link_t *rpc_link_remote(rpc_link_t *via, uint8_t node) {
+    if (!via || via->view || node == 0 || via->address == 0 || node == via->address) {
+        return NULL;
+    }
+    rpc_link_t *link = (rpc_link_t *)pvPortMalloc(sizeof(rpc_link_t));
+    link_route_view_t *view = (link_route_view_t *)pvPortMalloc(sizeof(link_route_view_t));
+    if (!link || !view) {
+        vPortFree(link);
+        vPortFree(view);
+        return NULL;
+    }
+    memset(link, 0, sizeof(*link));
+    // The routing task first: a published view is never taken back
+    if (route_start(via) != 0 || link_route_view_init(view, via, node) != 0) {
+        vPortFree(link);
+        vPortFree(view);
+        return NULL;
+    }
+    link->view = view;
+    return link;
+}
+
+
+int rpc_link_add_route(uint8_t node, rpc_link_t *via) {
+    if (!via || node == 0) {
+        return -1;
+    }
+    if (via->view) via = via->view->base;
+    const int rc = link_route_add(node, via);
+    return (rc == 0) ? route_start(via) : rc;
+}
+
+
+void rpc_link_set_address(rpc_link_t *link, uint8_t address) {
+    if (link->view) link = link->view->base;
+    link->address = address;
+}
+
+
+uint8_t rpc_link_get_address(const rpc_link_t *link) {
+    return link->view ? link->view->base->address : link->address;
+}
+
+
+void rpc_link_set_context(rpc_link_t *link, void *context) {
+    link->context = context;
+}
+
+
+void *rpc_link_get_context(const rpc_link_t *link) {
+    return link->context;
+}
+
+
+size_t rpc_link_tx_queued(rpc_link_t *link) {
+    if (link->view) {
+        return rpc_link_tx_queued(link->view->base);
+    }
+    if (link->bond) {
+        size_t n = 0;
+        for (size_t i = 0; i < LINK_BOND_MEMBERS; i++) n += rpc_link_tx_queued(link->bond->members[i].link);
+        return n;
+    }
+#if CONFIG_RPC_TX_QUEUE_LEN > 0
+    if (link->tx_task) {
+        return uxQueueMessagesWaiting(link->tx_urgent) + uxQueueMessagesWaiting(link->tx_normal) +
+               uxQueueMessagesWaiting(link->tx_bulk);
+    }
+#endif
+    return 0;
+}
+
+
+size_t link_tx_queued(void) {
+    return rpc_link_tx_queued(&s_default_link);
+}
+
+
+// Highest standard rate not above limit (the base rate at least)
+static uint32_t baud_floor(uint32_t limit) {
+    uint32_t rate = s_baud_rates[0];
+    for (size_t i = 1; i < BAUD_RATE_COUNT; i++) {
+        if (s_baud_rates[i] <= limit) rate = s_baud_rates[i];
+    }
+    return rate;
+}
+
+
+// Send the control frame [LINK_CTRL_MARKER][op][baud LE32]
+static int send_ctrl(rpc_link_t *link, uint8_t op, uint32_t baud) {
+    const uint8_t frame[6] = {
+        LINK_CTRL_MARKER, op,
+        (uint8_t)(baud & 0xFF), (uint8_t)((baud >> 8) & 0xFF),
+        (uint8_t)((baud >> 16) & 0xFF), (uint8_t)((baud >> 24) & 0xFF),
+    };
+    const phys_iovec_t seg = { frame, sizeof(frame) };
+    return rpc_link_send_framev(link, &seg, 1, LINK_TX_SYNC);
+}
+
+
+static void switch_baudrate(rpc_link_t *link, uint32_t baud) {
+    if (baud != link->baud_current && physical_port_set_baudrate(link->phys, baud) == 0) {
+        link->baud_current = baud;
+        link->rx_errors = 0;
+        link->rx_stray  = 0;
+    }
+}
+
+
+/* Handle a control frame (RX task).  A proposal is answered with the
+   highest rate both limits allow, sent at the current rate, after which
+   this side switches; the proposer switches when the answer arrives. */
+static void handle_ctrl(rpc_link_t *link, const uint8_t *frame, uint16_t len) {
+    if (len >= 2 && (frame[1] == LINK_CTRL_ARQ_ACK || frame[1] == LINK_CTRL_ARQ_NAK ||
+                     frame[1] == LINK_CTRL_ARQ_SYNC)) {
+        link_arq_control(&link->arq, frame[1], frame, len);
+        return;
+    }
+    if (len < 6) return;
+    const uint32_t baud = (uint32_t)frame[2] | ((uint32_t)frame[3] << 8) |
+                          ((uint32_t)frame[4] << 16) | ((uint32_t)frame[5] << 24);
+
+    switch (frame[1]) {
+    case LINK_CTRL_BAUD_PROPOSE: {
+        const uint32_t rate = baud_floor((baud < link->baud_cap) ? baud : link->baud_cap);
+        if (send_ctrl(link, LINK_CTRL_BAUD_ACCEPT, rate) == 0) switch_baudrate(link, rate);
+        break;
+    }
+    case LINK_CTRL_BAUD_ACCEPT:
+        if (!link->baud_waiting) break;
+        link->baud_waiting = false;
+        switch_baudrate(link, baud_floor((baud < link->baud_cap) ? baud : link->baud_cap));
+        link->baud_agreed = link->baud_current;
+        xSemaphoreGive(link->baud_accepted);
+        break;
+    default:
+        break;
+    }
+}
+
+
+/* Count a CRC or framing error (RX task).  Above the base rate, a burst
+   of them means the link cannot carry this speed: drop back to
+   PHYS_UART_BAUDRATE and offer at most the next lower rate from now on.
+   The peer follows once it sees this side's traffic arrive garbled. */
+static void note_rx_error(rpc_link_t *link) {
+    link_arq_rx_error(&link->arq);
+    if (link->baud_current == PHYS_UART_BAUDRATE) return;
+
+    const TickType_t now = xTaskGetTickCount();
+    if (now - link->rx_error_window >= pdMS_TO_TICKS(BAUD_ERROR_WINDOW_MS)) {
+        link->rx_error_window = now;
+        link->rx_errors = 0;
+    }
+    if (++link->rx_errors < CONFIG_RPC_BAUD_FALLBACK_ERRORS) return;
+
+    link->baud_cap = baud_floor(link->baud_current - 1);
+    switch_baudrate(link, PHYS_UART_BAUDRATE);
+}
+
+
+int rpc_link_negotiate_baudrate(rpc_link_t *link, uint32_t timeout_ms) {
+    if (link->view) {
+        return rpc_link_negotiate_baudrate(link->view->base, timeout_ms);
+    }
+    if (link->bond) {
+        // Each member agrees on its own rate; report the slowest
+        int slowest = 0;
+        for (size_t i = 0; i < LINK_BOND_MEMBERS; i++) {
+            const int rc = rpc_link_negotiate_baudrate(link->bond->members[i].link, timeout_ms);
+            if (rc < 0) return rc;
+            if (slowest == 0 || rc < slowest) slowest = rc;
+        }
+        return slowest;
+    }
+    if (!link->baud_accepted) {
+        return -1;
+    }
+    (void)xSemaphoreTake(link->baud_accepted, 0);  // drop a stale answer
+    link->baud_waiting = true;
+    if (send_ctrl(link, LINK_CTRL_BAUD_PROPOSE, link->baud_cap) != 0) {
+        link->baud_waiting = false;
+        return -3;
+    }
+    if (xSemaphoreTake(link->baud_accepted, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        link->baud_waiting = false;
+        return -5;
+    }
+    return (int)link->baud_agreed;
+}
+
+
+int link_negotiate_baudrate(uint32_t timeout_ms) {
+    return rpc_link_negotiate_baudrate(&s_default_link, timeout_ms);
+}
+
+
+uint32_t rpc_link_get_baudrate(const rpc_link_t *link) {
+    if (link->view) return rpc_link_get_baudrate(link->view->base);
+    return link->bond ? rpc_link_get_baudrate(link->bond->members[0].link) : link->baud_current;
+}
+
+
+uint32_t link_get_baudrate(void) {
+    return rpc_link_get_baudrate(&s_default_link);
+}
+
+
+#define LINK_STAT_LOAD_(kind, field) out->field = atomic_load_explicit(&link->stats.field, memory_order_relaxed);
+#define LINK_STAT_SUM_(kind, field)  out->field += part.field;
+
+void rpc_link_get_stats(const rpc_link_t *link, link_stats_t *out) {
+    if (!out) return;
+    if (link->view) {
+        rpc_link_get_stats(link->view->base, out);
+        return;
+    }
+    if (link->bond) {
+        memset(out, 0, sizeof(*out));
+        for (size_t i = 0; i < LINK_BOND_MEMBERS; i++) {
+            link_stats_t part;
+            rpc_link_get_stats(link->bond->members[i].link, &part);
+            LINK_STATS_FIELDS(LINK_STAT_SUM_)
+        }
+        // routing happens above the members
+        out->forwarded   += atomic_load_explicit(&link->stats.forwarded, memory_order_relaxed);
+        out->route_drops += atomic_load_explicit(&link->stats.route_drops, memory_order_relaxed);
+        return;
+    }
+    LINK_STATS_FIELDS(LINK_STAT_LOAD_)
+    link_arq_stats(&link->arq, &out->retransmits, NULL);
+}
+
+
+void link_get_stats(link_stats_t *out) {
+    rpc_link_get_stats(&s_default_link, out);
 }
 
 
@@ -40,63 +528,416 @@ int link_send_frame(const uint8_t *payload, uint16_t length) {
     if (!payload && length > 0) {
         return -1;
     }
+    const phys_iovec_t seg = { payload, length };
+    return rpc_link_send_framev(&s_default_link, &seg, 1, 0);
+}
+
 
-    // Frame structure:
-    // [0]     = LINK_START_BYTE
-    // [1]     = len_low
-    // [2]     = len_high
-    // [3]     = header_crc
-    // [4]     = LINK_DATA_START_BYTE
-    // [5..]   = payload (length bytes)
-    // [5+len] = full_crc
-    // [6+len] = LINK_STOP_BYTE
+int link_send_framev(const phys_iovec_t *iov, size_t iovcnt) {
+    return rpc_link_send_framev(&s_default_link, iov, iovcnt, 0);
+}
 
-    size_t frame_len = (size_t)length + 7; // 3 header + hdr_crc + data_start + payload + crc + stop
-    uint8_t *frame = (uint8_t *)pvPortMalloc(frame_len);   
+
+int link_send_framev_ex(const phys_iovec_t *iov, size_t iovcnt, uint8_t flags) {
+    return rpc_link_send_framev(&s_default_link, iov, iovcnt, flags);
+}
+
+
+#if CONFIG_RPC_TX_QUEUE_LEN > 0
+/* Copy the frame segments into one pool block and queue it for the
+   sender task.  Returns 0, or -2 if the lane stayed full. */
+static int queue_frame(rpc_link_t *link, const phys_iovec_t *seg, size_t n, size_t frame_len,
+                       uint8_t flags, int64_t deadline_us) {
+    tx_frame_t *frame = (tx_frame_t *)rpc_pool_alloc(sizeof(tx_frame_t) + frame_len);
     if (!frame) {
+        return -3;
+    }
+    frame->len = frame_len;
+    frame->deadline_us = deadline_us;
+    uint8_t *p = frame->data;
+    for (size_t i = 0; i < n; i++) {
+        memcpy(p, seg[i].base, seg[i].len);
+        p += seg[i].len;
+    }
+
+    QueueHandle_t lane = (flags & LINK_TX_URGENT) ? link->tx_urgent
+                       : (flags & LINK_TX_BULK)   ? link->tx_bulk : link->tx_normal;
+    const TickType_t wait = (flags & LINK_TX_NOWAIT) ? 0 : pdMS_TO_TICKS(CONFIG_RPC_TX_QUEUE_WAIT_MS);
+    if (xQueueSend(lane, &frame, wait) != pdTRUE) {
+        rpc_pool_free(frame);
         return -2;
     }
+    (void)xTaskNotifyGive(link->tx_task);
+    return 0;
+}
+#endif
+
+
+// Hand a complete frame to the sender task, or write it now
+static int write_frame(rpc_link_t *link, const phys_iovec_t *seg, size_t n, size_t frame_len,
+                       uint8_t flags, int64_t deadline_us) {
+#if CONFIG_RPC_TX_QUEUE_LEN > 0
+    if (link->tx_task && !(flags & LINK_TX_SYNC)) {
+        const int rc = queue_frame(link, seg, n, frame_len, flags, deadline_us);
+        if (rc == 0) RPC_STAT_INC(link->stats.frames_sent);
+        return rc;
+    }
+#else
+    (void)deadline_us;
+#endif
 
+    // Send via physical layer
+    int written = physical_port_sendv(link->phys, seg, n);
+    if (written != (int)frame_len) {
+        return -3;
+    }
+    RPC_STAT_INC(link->stats.frames_sent);
+    return 0;
+}
+
+
+#if CONFIG_RPC_LINK_COBS
+/* Byte-stuff a frame so LINK_START_BYTE appears only in front of it:
+   COBS with LINK_START_BYTE in the role of zero.  Each run of up to 254
+   other bytes is led by a code byte (run length + 1, XORed with
+   LINK_START_BYTE); a code below 0xFF also stands for one
+   LINK_START_BYTE after its run.  The first skip bytes of seg[0] are
+   left out.  Returns the encoded length, at most cobs_bound(input). */
+#define cobs_bound(length) ((length) + (length) / 254 + 1)
+
+static size_t cobs_encode(const phys_iovec_t *seg, size_t n, size_t skip, uint8_t *out) {
+    size_t code_pos = 0;
+    size_t o = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *p = (const uint8_t *)seg[i].base;
+        for (size_t j = skip; j < seg[i].len; j++) {
+            if (p[j] != LINK_START_BYTE) {
+                out[o++] = p[j];
+                if (++code != 0xFF) continue;
+            }
+            out[code_pos] = code ^ LINK_START_BYTE;
+            code_pos = o++;
+            code = 1;
+        }
+        skip = 0;
+    }
+    out[code_pos] = code ^ LINK_START_BYTE;
+    return o;
+}
+#endif
+
+
+/* Fill in the frame header for a payload of length bytes and return the
+   full CRC over it, to be continued over the payload.
+   Frame structure:
+   [0]     = LINK_START_BYTE
+   [1]     = len_low
+   [2]     = len_high
+   [3]     = header_crc
+   [4]     = LINK_DATA_START_BYTE
+   [5..]   = payload (length bytes)
+   [5+len] = full_crc
+   [6+len] = LINK_STOP_BYTE */
+static uint8_t frame_header(uint8_t header[5], size_t length) {
     // Populate header bytes and compute header CRC.
-    frame[0] = LINK_START_BYTE;
-    frame[1] = (uint8_t)(length & 0xFF);        // low byte
-    frame[2] = (uint8_t)((length >> 8) & 0xFF); // high byte
-    uint8_t hdr_crc = crc8_calc(frame, 3);
-    frame[3] = hdr_crc;
+    header[0] = LINK_START_BYTE;
+    header[1] = (uint8_t)(length & 0xFF);        // low byte
+    header[2] = (uint8_t)((length >> 8) & 0xFF); // high byte
+    uint8_t hdr_crc = crc8_block(0, header, 3);
+    header[3] = hdr_crc;
 
     // Start of data byte
-    frame[4] = LINK_DATA_START_BYTE;
+    header[4] = LINK_DATA_START_BYTE;
+
+    /* Full packet CRC covers start, len, hdr_crc, data_start and payload.
+       The CRC register after the first three bytes equals hdr_crc, so it
+       continues from there. */
+    return crc8_update(crc8_update(hdr_crc, hdr_crc), LINK_DATA_START_BYTE);
+}
+
 
-    // Copy payload if any
-    if (length > 0) {
-        memcpy(frame + 5, payload, length);
+/* Frame a payload of length bytes given as up to LINK_MAX_IOV + 1
+   segments (a part header in front of a full set) and write or queue it. */
+static int send_frame(rpc_link_t *link, const phys_iovec_t *iov, size_t iovcnt, size_t length,
+                      uint8_t flags, int64_t deadline_us) {
+    uint8_t header[5];
+    uint8_t full_crc = frame_header(header, length);
+
+    phys_iovec_t out[LINK_MAX_IOV + 3];
+    size_t n = 0;
+    out[n].base = header;
+    out[n].len  = sizeof(header);
+    n++;
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (iov[i].len == 0) continue;
+        full_crc = crc8_block(full_crc, (const uint8_t *)iov[i].base, iov[i].len);
+        out[n++] = iov[i];
     }
 
-    // Compute full packet CRC over all bytes up to and including payload (start, len, hdr_crc, data_start, payload).
-    uint8_t full_crc = 0;
-    for (size_t i = 0; i < (size_t)length + 5; i++) {
-        full_crc = crc8_update(full_crc, frame[i]);
+    // Trailer: full CRC and stop byte
+    uint8_t trailer[2] = { full_crc, LINK_STOP_BYTE };
+    out[n].base = trailer;
+    out[n].len  = sizeof(trailer);
+    n++;
+
+    const size_t frame_len = length + LINK_FRAME_OVERHEAD;
+#if CONFIG_RPC_LINK_COBS
+    // Wire copy: the start byte, then the rest of the frame stuffed
+    uint8_t *stuffed = (uint8_t *)rpc_pool_alloc(1 + cobs_bound(frame_len - 1));
+    if (!stuffed) {
+        return -3;
     }
-    frame[5 + length] = full_crc;
+    stuffed[0] = LINK_START_BYTE;
+    const phys_iovec_t wire = { stuffed, 1 + cobs_encode(out, n, 1, stuffed + 1) };
+    const int rc = write_frame(link, &wire, 1, wire.len, flags, deadline_us);
+    rpc_pool_free(stuffed);
+    return rc;
+#else
+    return write_frame(link, out, n, frame_len, flags, deadline_us);
+#endif
+}
 
-    // Stop byte
-    frame[6 + length] = LINK_STOP_BYTE;
 
-    // Send via physical layer
-    int written = physical_send(frame, frame_len);
-    vPortFree(frame);   
+link_prebuilt_t *link_prebuild(const phys_iovec_t *iov, size_t iovcnt, uint16_t patch_off, uint8_t patch_len) {
+    if ((!iov && iovcnt > 0) || patch_len > LINK_PATCH_MAX) {
+        return NULL;
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (!iov[i].base && iov[i].len > 0) {
+            return NULL;
+        }
+        length += iov[i].len;
+    }
+    if (length > CONFIG_RPC_LINK_MAX_PAYLOAD || (size_t)patch_off + patch_len > length) {
+        return NULL;
+    }
+
+    link_prebuilt_t *frame = (link_prebuilt_t *)pvPortMalloc(sizeof(link_prebuilt_t) + length + LINK_FRAME_OVERHEAD);
+    if (!frame) {
+        return NULL;
+    }
+    frame->len       = (uint16_t)(length + LINK_FRAME_OVERHEAD);
+    frame->patch_off = patch_off;
+    frame->patch_len = patch_len;
+
+    uint8_t crc = frame_header(frame->data, length);
+    uint8_t *p = frame->data + 5;
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (iov[i].len == 0) continue;
+        memcpy(p, iov[i].base, iov[i].len);
+        p += iov[i].len;
+    }
+    p[0] = crc8_block(crc, frame->data + 5, length);
+    p[1] = LINK_STOP_BYTE;
+
+    /* The CRC has init 0 and no final XOR, so flipping a payload bit
+       flips the CRC of that lone bit followed by the rest of the payload
+       as zeros; those are found once here. */
+    for (uint8_t j = 0; j < patch_len; j++) {
+        const size_t tail = length - patch_off - j - 1;
+        for (uint8_t b = 0; b < 8; b++) {
+            uint8_t delta = crc8_update(0, (uint8_t)(1u << b));
+            for (size_t k = 0; k < tail; k++) delta = crc8_update(delta, 0);
+            frame->crc_delta[j * 8 + b] = delta;
+        }
+    }
+    return frame;
+}
+
+
+int rpc_link_send_prebuilt(rpc_link_t *link, const link_prebuilt_t *frame, const uint8_t *patch,
+                           uint8_t flags) {
+    if (!frame || (!patch && frame->patch_len > 0)) {
+        return -1;
+    }
+#if CONFIG_RPC_LINK_COBS
+    (void)link;
+    (void)flags;
+    return -5;
+#else
+    if (link->bond || link->view || (!(flags & (LINK_TX_SYNC | LINK_TX_UNSEQ)) && link_arq_enabled(&link->arq))) {
+        return -5;
+    }
+#if CONFIG_RPC_LINK_SPLIT_SIZE > 0
+    if (frame->len - LINK_FRAME_OVERHEAD > CONFIG_RPC_LINK_SPLIT_SIZE &&
+        !(flags & (LINK_TX_URGENT | LINK_TX_SYNC | LINK_TX_UNSEQ))) {
+        return -5;
+    }
+#endif
+
+    const size_t off = 5 + frame->patch_off;
+    uint8_t crc = frame->data[frame->len - 2];
+    for (uint8_t j = 0; j < frame->patch_len; j++) {
+        const uint8_t flip = frame->data[off + j] ^ patch[j];
+        for (uint8_t b = 0; b < 8; b++) {
+            if (flip & (1u << b)) crc ^= frame->crc_delta[j * 8 + b];
+        }
+    }
+
+    const uint8_t trailer[2] = { crc, LINK_STOP_BYTE };
+    const size_t  rest = off + frame->patch_len;
+    const phys_iovec_t seg[4] = {
+        { frame->data,        off },
+        { patch,              frame->patch_len },
+        { frame->data + rest, frame->len - 2 - rest },
+        { trailer,            sizeof(trailer) },
+    };
+    return write_frame(link, seg, 4, frame->len, flags, 0);
+#endif
+}
+
+
+size_t link_iov_slice(const phys_iovec_t *iov, size_t iovcnt, size_t off, size_t len,
+                      phys_iovec_t *out) {
+    size_t n = 0;
+    for (size_t i = 0; i < iovcnt && len > 0; i++) {
+        if (off >= iov[i].len) {
+            off -= iov[i].len;
+            continue;
+        }
+        size_t take = iov[i].len - off;
+        if (take > len) take = len;
+        out[n].base = (const uint8_t *)iov[i].base + off;
+        out[n].len  = take;
+        n++;
+        len -= take;
+        off = 0;
+    }
+    return n;
+}
+
+
+// Sequence, then frame one payload (or one part of it)
+static int send_payload(rpc_link_t *link, const phys_iovec_t *iov, size_t iovcnt, size_t length,
+                        uint8_t flags, int64_t deadline_us) {
+    if (!(flags & (LINK_TX_SYNC | LINK_TX_UNSEQ)) && link_arq_enabled(&link->arq)) {
+        // Once sequenced a frame has to go out, so its deadline ends here
+        const bool may_wait = !(flags & LINK_TX_NOWAIT) && xTaskGetCurrentTaskHandle() != link->rx_task;
+        return link_arq_send(&link->arq, iov, iovcnt, flags, may_wait);
+    }
+    return send_frame(link, iov, iovcnt, length, flags, deadline_us);
+}
+
+
+#if CONFIG_RPC_LINK_SPLIT_SIZE > 0
+/* Send a long payload as parts of CONFIG_RPC_LINK_SPLIT_SIZE bytes, so
+   frames of the lanes ahead of it go out in between.  The parts of one
+   payload stay in order and are not mixed with those of another. */
+static int send_split(rpc_link_t *link, const phys_iovec_t *iov, size_t iovcnt, size_t length,
+                      uint8_t flags, int64_t deadline_us) {
+    size_t part = CONFIG_RPC_LINK_SPLIT_SIZE;
+    if ((length + part - 1) / part > PART_MAX_COUNT) {
+        part = (length + PART_MAX_COUNT - 1) / PART_MAX_COUNT;
+    }
+    const uint8_t count = (uint8_t)((length + part - 1) / part);
+
+    TickType_t wait = portMAX_DELAY;
+    if (deadline_us != 0) {
+        const int64_t left_us = deadline_us - esp_timer_get_time();
+        wait = (left_us > 0) ? pdMS_TO_TICKS(left_us / 1000) : 0;
+    }
+    if (xSemaphoreTake(link->tx_split_lock, wait) != pdTRUE) {
+        return -7;
+    }
+    const uint8_t seq = link->tx_part_seq++;
+
+    int rc = 0;
+    for (uint8_t idx = 0; idx < count && rc == 0; idx++) {
+        if (deadline_us != 0 && esp_timer_get_time() > deadline_us) {
+            rc = -7;  // the receiver drops the parts it already has
+            break;
+        }
+        const size_t off = idx * part;
+        const size_t len = (length - off < part) ? length - off : part;
+        const uint8_t hdr[LINK_PART_HDR_LEN] = { LINK_PART_MARKER, seq, idx, count };
+        phys_iovec_t seg[LINK_MAX_IOV + 1];
+        seg[0] = (phys_iovec_t){ hdr, sizeof(hdr) };
+        const size_t n = 1 + link_iov_slice(iov, iovcnt, off, len, &seg[1]);
+        rc = send_payload(link, seg, n, sizeof(hdr) + len, flags, deadline_us);
+    }
+    xSemaphoreGive(link->tx_split_lock);
+    return rc;
+}
+#endif
+
+
+int rpc_link_send_framev_until(rpc_link_t *link, const phys_iovec_t *iov, size_t iovcnt,
+                               uint8_t flags, int64_t deadline_us) {
+    if ((!iov && iovcnt > 0) || iovcnt > LINK_MAX_IOV) {
+        return -1;
+    }
+    if (link->view) {
+        return link_route_send(link->view, link->view->base->address, iov, iovcnt, flags, deadline_us);
+    }
+    if (link->bond) {
+        return link_bond_send(link->bond, iov, iovcnt, flags, deadline_us);
+    }
+
+    size_t length = 0;
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (!iov[i].base && iov[i].len > 0) {
+            return -1;
+        }
+        length += iov[i].len;
+    }
+    if (length > 0xFFFF) {
+        return -1;
+    }
+    if (deadline_us != 0 && esp_timer_get_time() > deadline_us) {
+        RPC_STAT_INC(link->stats.deadline_drops);
+        return -7;
+    }
+#if CONFIG_RPC_LINK_SPLIT_SIZE > 0
+    if (length > CONFIG_RPC_LINK_SPLIT_SIZE && !(flags & (LINK_TX_URGENT | LINK_TX_SYNC | LINK_TX_UNSEQ))) {
+        return send_split(link, iov, iovcnt, length, flags, deadline_us);
+    }
+#endif
+    return send_payload(link, iov, iovcnt, length, flags, deadline_us);
+}
+
 
-    return (written == (int)frame_len) ? 0 : -3;
+int rpc_link_send_framev(rpc_link_t *link, const phys_iovec_t *iov, size_t iovcnt, uint8_t flags) {
+    return rpc_link_send_framev_until(link, iov, iovcnt, flags, 0);
+}
+
+
+/* Header bytes of a rejected frame from its next start byte on, copied
+   to replay so they are parsed again: the real frame may begin inside a
+   garbled header.  Returns the number of bytes copied, at most n - 1. */
+static uint8_t rescan_header(const uint8_t *hdr, uint8_t n, uint8_t *replay) {
+#if CONFIG_RPC_LINK_COBS
+    // Stuffed frames never carry a start byte inside; nothing to find
+    (void)hdr;
+    (void)n;
+    (void)replay;
+    return 0;
+#else
+    for (uint8_t i = 1; i < n; i++) {
+        if (hdr[i] == LINK_START_BYTE) {
+            memcpy(replay, &hdr[i], n - i);
+            return (uint8_t)(n - i);
+        }
+    }
+    return 0;
+#endif
 }
 
 
 /* Receive a framed package.  Returns 0 on success, negative on error.
-   The state machine below processes bytes one at a time.  It will
+   Input is pulled from the physical layer in chunks; the state machine
+   below walks the chunk byte by byte for the header and trailer, and
+   copies payload bytes in bulk once the length is known.  It will
    discard invalid frames and continue searching for the next valid
-   start byte. */
-int link_receive_frame(uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len) {
-    if (!buffer || !out_len) {
-        return -1;
+   start byte: a rejected header (bad CRC, a length above
+   CONFIG_RPC_LINK_MAX_PAYLOAD, no data start byte) is searched again
+   from its second byte, and a frame whose bytes stop arriving for
+   CONFIG_RPC_LINK_BYTE_TIMEOUT_MS is dropped. */
+static int receive_frame(rpc_link_t *link, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len) {
+    link->rx_task = xTaskGetCurrentTaskHandle();
+    if (link_arq_next_held(&link->arq, buffer, buffer_size, out_len)) {
+        return 0;
     }
 
     // States for the receive state machine
@@ -114,21 +955,105 @@ int link_receive_frame(uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len)
     uint8_t byte = 0;
     uint16_t length = 0;
     uint16_t idx = 0;
-    uint8_t hdr[3];
+    uint8_t hdr[5];              // start, len_low, len_high, hdr_crc, data_start
     uint8_t hdr_crc_read = 0;
     uint8_t full_crc_calc = 0;
     uint8_t full_crc_read = 0;
 
+    // Rejected header bytes waiting to be parsed again (see rescan_header)
+    uint8_t replay[sizeof(hdr) - 1];
+    uint8_t replay_pos = 0;
+    uint8_t replay_len = 0;
+
+#if CONFIG_RPC_LINK_COBS
+    uint8_t cobs_left = 0;       // bytes left in the current stuffed run
+    bool    cobs_gap  = false;   // the run is followed by a LINK_START_BYTE
+#endif
+
     // Loop indefinitely until we return with a valid frame or error
     for (;;) {
-        if (physical_receive_byte(&byte) < 0) {
-            // No data available or I/O error
-            return -2;
+        if (replay_pos < replay_len) {
+            byte = replay[replay_pos++];
+        } else {
+            if (link->rx_pos >= link->rx_len) {
+                const uint32_t wait = (state == ST_WAIT_START || CONFIG_RPC_LINK_BYTE_TIMEOUT_MS == 0)
+                                      ? PHYS_WAIT_FOREVER : CONFIG_RPC_LINK_BYTE_TIMEOUT_MS;
+                const int got = physical_port_receive(link->phys, link->rx_chunk, sizeof(link->rx_chunk), wait);
+                if (got < 0) {
+                    // I/O error
+                    return -2;
+                }
+                if (got == 0) {
+                    // The sender went quiet mid-frame: give up on it
+                    RPC_STAT_INC(link->stats.framing_errors);
+                    note_rx_error(link);
+                    state = ST_WAIT_START;
+                    continue;
+                }
+                link->rx_pos = 0;
+                link->rx_len = (size_t)got;
+                continue;
+            }
+
+#if !CONFIG_RPC_LINK_COBS
+            if (state == ST_PAYLOAD) {
+                // Consume as much of the payload as this chunk holds
+                size_t n = link->rx_len - link->rx_pos;
+                if (n > (size_t)(length - idx)) {
+                    n = (size_t)(length - idx);
+                }
+                const uint8_t *src = &link->rx_chunk[link->rx_pos];
+                if (idx < buffer_size) {
+                    const size_t room = (size_t)(buffer_size - idx);
+                    memcpy(&buffer[idx], src, (n < room) ? n : room);
+                }
+                full_crc_calc = crc8_block(full_crc_calc, src, n);
+                idx = (uint16_t)(idx + n);
+                link->rx_pos += n;
+                if (idx >= length) {
+                    state = ST_FULL_CRC;
+                }
+                continue;
+            }
+#endif
+
+            byte = link->rx_chunk[link->rx_pos++];
+
+#if CONFIG_RPC_LINK_COBS
+            if (byte == LINK_START_BYTE) {
+                // Only ever sent in front of a frame: whatever came before is cut off
+                if (state != ST_WAIT_START) {
+                    RPC_STAT_INC(link->stats.framing_errors);
+                    note_rx_error(link);
+                    state = ST_WAIT_START;
+                }
+                cobs_left = 0;
+                cobs_gap  = false;
+            } else if (state != ST_WAIT_START) {
+                if (cobs_left > 0) {
+                    cobs_left--;
+                } else {
+                    // Code byte: starts the next run, ends the previous one
+                    const uint8_t code = byte ^ LINK_START_BYTE;
+                    const bool gap = cobs_gap;
+                    cobs_left = (uint8_t)(code - 1);
+                    cobs_gap  = (code != 0xFF);
+                    if (!gap) continue;
+                    byte = LINK_START_BYTE;
+                }
+            }
+#endif
         }
 
         switch (state) {
         case ST_WAIT_START:
-            if (byte == LINK_START_BYTE) {
+            if (byte != LINK_START_BYTE) {
+                RPC_STAT_INC(link->stats.stray_bytes);
+                if (++link->rx_stray >= STRAY_BYTES_PER_ERROR) {
+                    link->rx_stray = 0;
+                    note_rx_error(link);
+                }
+            } else {
                 // Reset CRC calculation and store header byte 0
                 full_crc_calc = 0;
                 full_crc_calc = crc8_update(full_crc_calc, byte);
@@ -151,15 +1076,24 @@ int link_receive_frame(uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len)
             state = ST_HDR_CRC;
             break;
 
-        case ST_HDR_CRC:
+        case ST_HDR_CRC: {
             hdr_crc_read = byte;
-            if (crc8_calc(hdr, 3) != hdr_crc_read) {
+            hdr[3] = byte;
+            const bool hdr_crc_ok = (crc8_block(0, hdr, 3) == hdr_crc_read);
+            if (!hdr_crc_ok || length > CONFIG_RPC_LINK_MAX_PAYLOAD) {
+                if (hdr_crc_ok) RPC_STAT_INC(link->stats.oversize_drops);
+                else            RPC_STAT_INC(link->stats.header_crc_errors);
+                note_rx_error(link);
+                replay_len = rescan_header(hdr, 4, replay);
+                if (replay_len > 0) RPC_STAT_INC(link->stats.resyncs);
+                replay_pos = 0;
                 state = ST_WAIT_START;
             } else {
                 full_crc_calc = crc8_update(full_crc_calc, hdr_crc_read);
                 state = ST_DATA_START;
             }
             break;
+        }
 
         case ST_DATA_START:
             if (byte == LINK_DATA_START_BYTE) {
@@ -167,37 +1101,64 @@ int link_receive_frame(uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len)
                 idx = 0;
                 state = (length == 0) ? ST_FULL_CRC : ST_PAYLOAD;
             } else {
+                RPC_STAT_INC(link->stats.framing_errors);
+                note_rx_error(link);
+                hdr[4] = byte;
+                replay_len = rescan_header(hdr, 5, replay);
+                if (replay_len > 0) RPC_STAT_INC(link->stats.resyncs);
+                replay_pos = 0;
                 state = ST_WAIT_START;
             }
             break;
 
         case ST_PAYLOAD:
-            if (idx < length) {
-                if (idx < buffer_size) {
-                    buffer[idx] = byte;
-                }
-                full_crc_calc = crc8_update(full_crc_calc, byte);
-                idx++;
-                if (idx >= length) {
-                    state = ST_FULL_CRC;
-                }
+            // One byte at a time only for stuffed frames; otherwise copied in bulk above
+            if (idx < buffer_size) {
+                buffer[idx] = byte;
+            }
+            full_crc_calc = crc8_update(full_crc_calc, byte);
+            if (++idx >= length) {
+                state = ST_FULL_CRC;
             }
             break;
 
         case ST_FULL_CRC:
             full_crc_read = byte;
-            if (length <= buffer_size && full_crc_calc == full_crc_read) {
+            if (full_crc_calc == full_crc_read) {
                 state = ST_STOP;
             } else {
+                RPC_STAT_INC(link->stats.crc_errors);
+                note_rx_error(link);
                 state = ST_WAIT_START;
             }
             break;
 
         case ST_STOP:
             if (byte == LINK_STOP_BYTE) {
+                RPC_STAT_INC(link->stats.frames_received);
+                if (length > buffer_size) RPC_STAT_INC(link->stats.oversize_drops);
+                if (length > 0 && length <= buffer_size && buffer[0] == LINK_CTRL_MARKER) {
+                    handle_ctrl(link, buffer, length);
+                    state = ST_WAIT_START;
+                    break;
+                }
+                if (length > 0 && buffer_size > 0 && buffer[0] == LINK_ARQ_MARKER) {
+                    // Sequenced frame: deliver in order, or hold/drop it
+                    const int rc = link_arq_receive(&link->arq, buffer, length, buffer_size, out_len);
+                    if (rc != -1) {
+                        return rc;  // 0, or -4: truncated
+                    }
+                    if (link_arq_next_held(&link->arq, buffer, buffer_size, out_len)) {
+                        return 0;
+                    }
+                    state = ST_WAIT_START;
+                    break;
+                }
                 *out_len = length;
-                return 0;
+                return (length <= buffer_size) ? 0 : -4; // -4: truncated
             }
+            RPC_STAT_INC(link->stats.framing_errors);
+            note_rx_error(link);
             state = ST_WAIT_START;
             break;
         }
@@ -205,3 +1166,115 @@ int link_receive_frame(uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len)
 
     return -3; // unreachable
 }
+
+
+/* Add a received part (in buffer, *out_len bytes) to the payload of its
+   sequence number being joined.  When it was the last one, the whole
+   payload is copied to buffer (up to buffer_size bytes), *out_len set to
+   its full length and true returned.  A part out of order, or one that
+   was truncated, drops its payload; a first part takes a free slot, or
+   else the occupied ones in turn. */
+static bool join_part(rpc_link_t *link, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len, int rc) {
+    const uint16_t len = *out_len;
+    if (len < LINK_PART_HDR_LEN || buffer_size < LINK_PART_HDR_LEN) {
+        return false;
+    }
+    const uint8_t seq   = buffer[1];
+    const uint8_t idx   = buffer[2];
+    const uint8_t count = buffer[3];
+
+    part_rx_t *p = NULL;
+    for (size_t i = 0; i < PART_RX_SLOTS; i++) {
+        if (link->rx_part[i].active && link->rx_part[i].seq == seq) p = &link->rx_part[i];
+    }
+    if (idx == 0) {
+        if (!p) {
+            for (size_t i = 0; i < PART_RX_SLOTS && !p; i++) {
+                if (!link->rx_part[i].active) p = &link->rx_part[i];
+            }
+        }
+        if (!p) {
+            p = &link->rx_part[link->rx_part_evict];
+            link->rx_part_evict = (uint8_t)((link->rx_part_evict + 1) % PART_RX_SLOTS);
+        }
+        if (p->cap < buffer_size) {
+            vPortFree(p->data);
+            p->data = (uint8_t *)pvPortMalloc(buffer_size);
+            p->cap  = p->data ? buffer_size : 0;
+        }
+        p->active = (p->data != NULL);
+        p->seq    = seq;
+        p->next   = 0;
+        p->count  = count;
+        p->len    = 0;
+    }
+    if (!p) {
+        return false;
+    }
+    if (rc != 0 || !p->active || idx != p->next || count != p->count) {
+        p->active = false;
+        return false;
+    }
+
+    const uint16_t n = (uint16_t)(len - LINK_PART_HDR_LEN);
+    if (p->len < p->cap) {
+        const uint32_t room = p->cap - p->len;
+        memcpy(&p->data[p->len], &buffer[LINK_PART_HDR_LEN], (n < room) ? n : room);
+    }
+    p->len += n;
+    if (++p->next < count) {
+        return false;
+    }
+
+    p->active = false;
+    uint32_t held = (p->len < p->cap) ? p->len : p->cap;
+    if (held > buffer_size) held = buffer_size;
+    memcpy(buffer, p->data, held);
+    *out_len = (uint16_t)p->len;
+    return true;
+}
+
+
+// The next whole payload of a link: a bonded message, or a frame with its split parts joined
+static int receive_payload(rpc_link_t *link, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len) {
+    if (link->bond) {
+        return link_bond_receive(link->bond, buffer, buffer_size, out_len);
+    }
+    for (;;) {
+        const int rc = receive_frame(link, buffer, buffer_size, out_len);
+        if ((rc != 0 && rc != -4) || *out_len == 0 || buffer_size == 0 || buffer[0] != LINK_PART_MARKER) {
+            return rc;
+        }
+        if (join_part(link, buffer, buffer_size, out_len, rc)) {
+            return (*out_len <= buffer_size) ? 0 : -4;
+        }
+    }
+}
+
+
+int rpc_link_receive_frame(rpc_link_t *link, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len) {
+    if (!buffer || !out_len) {
+        return -1;
+    }
+    if (link->view) {
+        return link_route_receive(link->view, buffer, buffer_size, out_len);
+    }
+    for (;;) {
+        const int rc = receive_payload(link, buffer, buffer_size, out_len);
+        if ((rc != 0 && rc != -4) || *out_len == 0 || buffer_size == 0 || buffer[0] != LINK_ADDR_MARKER) {
+            return rc;
+        }
+        // Addressed frames go to the view of their sender or on towards their node, never up from here
+        const uint16_t have = (*out_len < buffer_size) ? *out_len : buffer_size;
+        switch (link_route_input(link, link->address, buffer, *out_len, have)) {
+        case LINK_ROUTE_FORWARDED: RPC_STAT_INC(link->stats.forwarded);   break;
+        case LINK_ROUTE_DROPPED:   RPC_STAT_INC(link->stats.route_drops); break;
+        default: break;
+        }
+    }
+}
+
+
+int link_receive_frame(uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len) {
+    return rpc_link_receive_frame(&s_default_link, buffer, buffer_size, out_len);
+}
@@ -0,0 +1,172 @@
+/* Routing between nodes (see link_route.h).  Views and routes are set
+   up at boot and only read afterwards, so the receiving tasks look them
+   up without a lock; each is filled in before it is published. */
+
+#include "link_route.h"
+#include "link_layer.h"
+#include "rpc_config.h"
+#include "rpc_pool.h"
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+
+// Frames from one node waiting for the transport
+#define VIEW_QUEUE_LEN 4
+
+// A frame from the node of a view, pool allocated
+typedef struct {
+    uint16_t len;    // full payload length, header taken off
+    uint16_t have;   // bytes kept in data (less if the frame was truncated)
+    uint8_t  data[];
+} view_frame_t;
+
+typedef struct {
+    uint8_t     node;
+    rpc_link_t *via;
+} route_t;
+
+static link_route_view_t *volatile s_views = NULL;
+static route_t         s_routes[CONFIG_RPC_ROUTES];
+static volatile size_t s_route_count = 0;
+
+
+int link_route_view_init(link_route_view_t *view, rpc_link_t *base, uint8_t node) {
+    memset(view, 0, sizeof(*view));
+    view->base = base;
+    view->node = node;
+    view->rx   = xQueueCreate(VIEW_QUEUE_LEN, sizeof(view_frame_t *));
+    if (!view->rx) {
+        return -1;
+    }
+    view->next = s_views;
+    s_views = view;  // publishes the view
+    return 0;
+}
+
+
+int link_route_add(uint8_t node, rpc_link_t *via) {
+    for (size_t i = 0; i < s_route_count; i++) {
+        if (s_routes[i].node == node) {
+            s_routes[i].via = via;
+            return 0;
+        }
+    }
+    if (s_route_count >= CONFIG_RPC_ROUTES) {
+        return -2;
+    }
+    s_routes[s_route_count] = (route_t){ node, via };
+    s_route_count++;  // publishes the route
+    return 0;
+}
+
+
+/* Reads a link no one else receives from; everything arriving on it is
+   routed inside rpc_link_receive_frame(), so what comes back is an
+   unaddressed frame, which has no taker here. */
+static void route_rx_task(void *arg) {
+    rpc_link_t *base = (rpc_link_t *)arg;
+    const uint16_t size = CONFIG_RPC_RX_FRAME_SIZE + LINK_ADDR_HDR_LEN;
+    uint8_t *buf = (uint8_t *)pvPortMalloc(size);
+    if (!buf) {
+        vTaskDelete(NULL);
+        return;
+    }
+    for (;;) {
+        uint16_t len = 0;
+        (void)rpc_link_receive_frame(base, buf, size, &len);
+    }
+}
+
+
+int link_route_start(rpc_link_t *base) {
+    return (xTaskCreate(route_rx_task, "link_route", 3072, base, 10, NULL) == pdPASS) ? 0 : -1;
+}
+
+
+int link_route_send(link_route_view_t *view, uint8_t src, const phys_iovec_t *iov, size_t iovcnt,
+                    uint8_t flags, int64_t deadline_us) {
+    if ((!iov && iovcnt > 0) || iovcnt > LINK_MAX_IOV - 1) {
+        return -1;
+    }
+    const uint8_t hdr[LINK_ADDR_HDR_LEN] = { LINK_ADDR_MARKER, view->node, src, CONFIG_RPC_ROUTE_HOPS };
+    phys_iovec_t seg[LINK_MAX_IOV];
+    seg[0] = (phys_iovec_t){ hdr, sizeof(hdr) };
+    for (size_t i = 0; i < iovcnt; i++) seg[1 + i] = iov[i];
+    return rpc_link_send_framev_until(view->base, seg, 1 + iovcnt, flags, deadline_us);
+}
+
+
+int link_route_receive(link_route_view_t *view, uint8_t *buffer, uint16_t buffer_size, uint16_t *out_len) {
+    view_frame_t *frame = NULL;
+    (void)xQueueReceive(view->rx, &frame, portMAX_DELAY);
+    memcpy(buffer, frame->data, (frame->have < buffer_size) ? frame->have : buffer_size);
+    *out_len = frame->len;
+    const int rc = (frame->len <= buffer_size) ? 0 : -4;
+    rpc_pool_free(frame);
+    return rc;
+}
+
+
+// The link that leads to node: a route set for it, else the base of a view of it
+static rpc_link_t *next_hop(uint8_t node) {
+    for (size_t i = 0; i < s_route_count; i++) {
+        if (s_routes[i].node == node) return s_routes[i].via;
+    }
+    for (link_route_view_t *v = s_views; v; v = v->next) {
+        if (v->node == node) return v->base;
+    }
+    return NULL;
+}
+
+
+// Queue a frame for this node on the view of its sender (receiving task of from)
+static link_route_result_t deliver(rpc_link_t *from, const uint8_t *frame, uint16_t len, uint16_t have) {
+    link_route_view_t *view = s_views;
+    while (view && (view->base != from || view->node != frame[2])) view = view->next;
+    if (!view) {
+        return LINK_ROUTE_DROPPED;
+    }
+    const uint16_t n = (uint16_t)(have - LINK_ADDR_HDR_LEN);
+    view_frame_t *copy = (view_frame_t *)rpc_pool_alloc(sizeof(view_frame_t) + n);
+    if (!copy) {
+        return LINK_ROUTE_DROPPED;
+    }
+    copy->len  = (uint16_t)(len - LINK_ADDR_HDR_LEN);
+    copy->have = n;
+    memcpy(copy->data, frame + LINK_ADDR_HDR_LEN, n);
+    // A transport that falls behind loses frames rather than holding up the whole bus
+    if (xQueueSend(view->rx, &copy, pdMS_TO_TICKS(CONFIG_RPC_TX_QUEUE_WAIT_MS)) != pdTRUE) {
+        rpc_pool_free(copy);
+        return LINK_ROUTE_DROPPED;
+    }
+    return LINK_ROUTE_DELIVERED;
+}
+
+
+link_route_result_t link_route_input(rpc_link_t *from, uint8_t self, const uint8_t *frame,
+                                     uint16_t len, uint16_t have) {
+    if (have < LINK_ADDR_HDR_LEN) {
+        return LINK_ROUTE_DROPPED;
+    }
+    const uint8_t dst = frame[1];
+    if (self != 0 && dst == self) {
+        return deliver(from, frame, len, have);
+    }
+
+    rpc_link_t *via = next_hop(dst);
+    if (!via || via == from) {
+        return LINK_ROUTE_IGNORED;
+    }
+    if (have < len || frame[3] <= 1) {
+        return LINK_ROUTE_DROPPED;  // cut short by our buffer, or looping
+    }
+    // Store and forward: the payload goes out unchanged but for the hop count
+    const uint8_t hdr[LINK_ADDR_HDR_LEN] = { LINK_ADDR_MARKER, dst, frame[2], (uint8_t)(frame[3] - 1) };
+    const phys_iovec_t seg[2] = {
+        { hdr, sizeof(hdr) },
+        { frame + LINK_ADDR_HDR_LEN, (size_t)(len - LINK_ADDR_HDR_LEN) },
+    };
+    return (rpc_link_send_framev(via, seg, 2, 0) == 0) ? LINK_ROUTE_FORWARDED : LINK_ROUTE_DROPPED;
+}
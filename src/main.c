@@ -7,6 +7,8 @@
 #include "link_layer.h"
 #include "transport.h"
 #include "rpc_app.h"
+#include "rpc_bench.h"
+#include "rpc_config.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <string.h>
@@ -16,6 +18,12 @@
 // Forward declaration of the demo RPC client task. 
 static void rpc_client_demo(void *arg);
 
+// Number of async sum calls the demo keeps in flight at once
+#define DEMO_ASYNC_CALLS 4
+
+// Typed client stub for "sum": encodes rpc_sum_args_t, decodes rpc_sum_result_t
+RPC_DEFINE_CALL(call_sum, "sum", rpc_sum_args, rpc_sum_result)
+
 
 void app_main(void) {
     // Initialise lower layers and register application functions. 
@@ -24,11 +32,42 @@ void app_main(void) {
     transport_init();
     rpc_app_init();
 
+#if CONFIG_RPC_BAUD_INITIATOR
+    // Move off the base rate if the peer supports it; the peer answers from its RX task
+    const int baud = link_negotiate_baudrate(500);
+    if (baud > 0) printf("link running at %d baud\n", baud);
+    else          printf("baud negotiation failed (%d), staying at %d\n", baud, PHYS_UART_BAUDRATE);
+#endif
+
+    // Compress large payloads if the peer can expand them
+    const int caps = transport_negotiate_caps(500);
+    if (caps >= 0) printf("peer capabilities: 0x%02x\n", caps);
+
+#if CONFIG_RPC_BENCH
+    rpc_bench_run();
+#endif
+
     // Create a task to demonstrate RPC calls. 
     (void)xTaskCreate(rpc_client_demo, "rpc_demo", 4096, NULL, 5, NULL);
 }
 
 
+/* Completion callback for the async demo calls.  Runs in the RX task, so
+   it only prints and wakes the demo task. */
+static void demo_async_done(int status, uint8_t error_code,
+                            const uint8_t *data, uint16_t len, void *ctx) {
+    rpc_reader_t r;
+    rpc_sum_result_t result;
+    rpc_reader_init(&r, data, len);
+    if (status == 0 && error_code == 0 && rpc_sum_result_get(&r, &result)) {
+        printf("async sum response: %lu\n", (unsigned long)result.sum);
+    } else {
+        printf("async sum failed, status=%d err=%u\n", status, (unsigned)error_code);
+    }
+    (void)xTaskNotifyGive((TaskHandle_t)ctx);
+}
+
+
 // Demo task: call sum and echo against the local RPC server. 
 static void rpc_client_demo(void *arg) {
     (void)arg;
@@ -40,26 +79,12 @@ static void rpc_client_demo(void *arg) {
     uint16_t  resp_len  = 0;
     uint8_t   err       = 0;
 
-    // Example 1: call sum (adds 1 + 2).  Response is decimal string. 
-    uint8_t sum_args[8] = {1,0,0,0,  2,0,0,0};
-
-    if (transport_call("sum",
-                       sum_args, sizeof(sum_args),
-                       &response, &resp_len, &err,
-                       5000) == 0 && err == 0) {
-        // Copy response to a temporary null-terminated string for strtoul(). 
-        char *tmp = (char *)pvPortMalloc((size_t)resp_len + 1u);
-        if (tmp) {
-            memcpy(tmp, response, resp_len);
-            tmp[resp_len] = '\0';
-            unsigned long sum_result = strtoul(tmp, NULL, 10);
-            printf("sum response: %lu\n", sum_result);
-            vPortFree(tmp);
-        }
-        // Free the response buffer allocated by transport (FreeRTOS heap). 
-        vPortFree(response);
-        response = NULL;
+    // Example 1: call sum (adds 1 + 2) through its typed stub. 
+    const rpc_sum_args_t sum_args = { .a = 1, .b = 2 };
+    rpc_sum_result_t sum_result = { 0 };
 
+    if (call_sum(&sum_args, &sum_result, &err, 5000) == 0 && err == 0) {
+        printf("sum response: %lu\n", (unsigned long)sum_result.sum);
     } else {
         printf("sum call failed, err=%u\n", (unsigned)err);
     }
@@ -80,6 +105,25 @@ static void rpc_client_demo(void *arg) {
         printf("echo call failed, err=%u\n", (unsigned)err);
     }
 
+    // Example 3: fan out several sums at once from this single task. 
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    int started = 0;
+    for (uint8_t i = 0; i < DEMO_ASYNC_CALLS; i++) {
+        const rpc_sum_args_t in = { .a = i, .b = 10 };
+        uint8_t fan_args[rpc_sum_args_MAX_SIZE];
+        rpc_writer_t w;
+        rpc_writer_init(&w, fan_args, sizeof(fan_args));
+        rpc_sum_args_put(&w, &in);
+        if (transport_call_async("sum", fan_args, w.len,
+                                 demo_async_done, self, 5000) >= 0) {
+            started++;
+        }
+    }
+    // Each started call notifies exactly once (response, error or timeout). 
+    for (int i = 0; i < started; i++) {
+        (void)ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    }
+
     // End demo task. 
     vTaskDelete(NULL);
 }
@@ -0,0 +1,65 @@
+/* In-memory backend of the physical layer: bytes written to a port are
+   read back by the port itself, or by its peer once two ports are
+   paired, no hardware involved.  Shows the cost of the protocol code
+   alone, and lets one board call its own functions or run both ends of
+   a link. */
+
+#include "physical.h"
+#include "rpc_config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/stream_buffer.h>
+
+
+static phys_mem_t s_default_mem;
+
+/* Longest a write waits for the reader to make room.  A reader that has
+   stopped costs the writer this much per write, not forever; the rest
+   of the write is lost and the link resyncs on the next frame. */
+#define MEM_WRITE_WAIT_MS 100
+
+
+void phys_mem_pair(phys_mem_t *a, phys_mem_t *b) {
+    a->peer = b;
+    b->peer = a;
+}
+
+
+/* Sized like the two UART driver rings, so a sender can get that far
+   ahead of the RX task. */
+static int mem_init(void *ctx) {
+    phys_mem_t *m = (phys_mem_t *)ctx;
+    if (!m->rx) {
+        m->rx = xStreamBufferCreate(CONFIG_RPC_UART_RX_BUFFER_SIZE + CONFIG_RPC_UART_TX_BUFFER_SIZE, 1);
+    }
+    return m->rx ? 0 : -1;
+}
+
+/* Bytes for a peer that is not open yet are dropped, like on an
+   unconnected UART.  Returns fewer than len bytes if the reader did not
+   make room within MEM_WRITE_WAIT_MS. */
+static int mem_write(void *ctx, const uint8_t *data, size_t len) {
+    const phys_mem_t *m = (const phys_mem_t *)ctx;
+    const phys_mem_t *to = m->peer ? m->peer : m;
+    if (!to->rx) {
+        return (int)len;
+    }
+    return (int)xStreamBufferSend(to->rx, data, len, pdMS_TO_TICKS(MEM_WRITE_WAIT_MS));
+}
+
+static int mem_read(void *ctx, uint8_t *buf, size_t max_len, uint32_t timeout_ms) {
+    const phys_mem_t *m = (const phys_mem_t *)ctx;
+    const TickType_t wait = (timeout_ms == PHYS_WAIT_FOREVER) ? portMAX_DELAY
+                                                              : pdMS_TO_TICKS(timeout_ms);
+    return (int)xStreamBufferReceive(m->rx, buf, max_len, wait);
+}
+
+
+const phys_backend_t phys_mem_backend = {
+    .name         = "mem",
+    .default_ctx  = &s_default_mem,
+    .init         = mem_init,
+    .write        = mem_write,
+    .flush        = NULL,
+    .read         = mem_read,
+    .set_baudrate = NULL,  // nothing is clocked
+};
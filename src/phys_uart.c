@@ -0,0 +1,117 @@
+/* UART backend of the physical layer, on the ESP-IDF UART driver: one
+   port per phys_uart_config_t at 8N1, optional RTS/CTS flow control and
+   internal loopback (TX wired to RX inside the peripheral, for
+   benchmarks and single-board tests).  The default context is
+   PHYS_UART_NUM as configured in Kconfig. */
+
+#include "physical.h"
+#include "rpc_config.h"
+#include "driver/uart.h"
+#include "driver/gpio.h"
+#include <freertos/FreeRTOS.h>
+
+
+/* RTS is asserted once the hardware RX FIFO holds this many bytes, leaving
+   room for the peer to finish the character it is sending. */
+#define PHYS_RX_FLOW_THRESH 100
+
+
+static phys_uart_config_t s_default_uart = {
+    .uart_num = PHYS_UART_NUM,
+    .tx_pin   = PHYS_UART_TX_PIN,
+    .rx_pin   = PHYS_UART_RX_PIN,
+#if CONFIG_RPC_UART_FLOW_CTRL
+    .rts_pin  = CONFIG_RPC_UART_RTS_PIN,
+    .cts_pin  = CONFIG_RPC_UART_CTS_PIN,
+#else
+    .rts_pin  = UART_PIN_NO_CHANGE,
+    .cts_pin  = UART_PIN_NO_CHANGE,
+#endif
+#if CONFIG_RPC_PHYS_UART_LOOPBACK
+    .loopback = true,
+#endif
+};
+
+
+// Configure the UART for 8N1 and install the driver
+static int uart_init(void *ctx) {
+    const phys_uart_config_t *u = (const phys_uart_config_t *)ctx;
+    const bool flow_ctrl = (u->rts_pin >= 0 && u->cts_pin >= 0);
+
+    uart_config_t cfg = {
+        .baud_rate = PHYS_UART_BAUDRATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity    = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = flow_ctrl ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh = flow_ctrl ? PHYS_RX_FLOW_THRESH : 0,
+        .source_clk = UART_SCLK_APB,
+    };
+    uart_param_config(u->uart_num, &cfg);
+
+    uart_set_pin(u->uart_num, u->tx_pin, u->rx_pin,
+                 flow_ctrl ? u->rts_pin : UART_PIN_NO_CHANGE,
+                 flow_ctrl ? u->cts_pin : UART_PIN_NO_CHANGE);
+
+    const esp_err_t err = uart_driver_install(u->uart_num,
+                                              CONFIG_RPC_UART_RX_BUFFER_SIZE,  // RX ring buffer size
+                                              CONFIG_RPC_UART_TX_BUFFER_SIZE,  // TX ring (0: writes wait for the FIFO)
+                                              0, NULL, 0);
+
+    if (u->loopback) {
+        // TX wired to RX inside the peripheral; the pins stay idle
+        uart_set_loop_back(u->uart_num, true);
+    }
+    return (err == ESP_OK) ? 0 : -1;
+}
+
+static int uart_write(void *ctx, const uint8_t *data, size_t len) {
+    const phys_uart_config_t *u = (const phys_uart_config_t *)ctx;
+    return uart_write_bytes(u->uart_num, (const char *)data, len);
+}
+
+/* Blocks only for the first byte, then drains what the driver has
+   already buffered in a single call, so a burst costs two driver calls
+   instead of one per byte */
+static int uart_read(void *ctx, uint8_t *buf, size_t max_len, uint32_t timeout_ms) {
+    const phys_uart_config_t *u = (const phys_uart_config_t *)ctx;
+    const TickType_t wait = (timeout_ms == PHYS_WAIT_FOREVER) ? portMAX_DELAY
+                                                              : pdMS_TO_TICKS(timeout_ms);
+    int got = uart_read_bytes(u->uart_num, buf, 1, wait);
+    if (got <= 0) {
+        return (got == 0) ? 0 : -1;
+    }
+
+    size_t buffered = 0;
+    if (uart_get_buffered_data_len(u->uart_num, &buffered) == ESP_OK && buffered > 0) {
+        if (buffered > max_len - 1) {
+            buffered = max_len - 1;
+        }
+        const int more = uart_read_bytes(u->uart_num, buf + 1, (uint32_t)buffered, 0);
+        if (more > 0) {
+            got += more;
+        }
+    }
+    return got;
+}
+
+// Let the last frame leave at the old rate, then switch
+static int uart_baudrate(void *ctx, uint32_t baud) {
+    const phys_uart_config_t *u = (const phys_uart_config_t *)ctx;
+    esp_err_t err = uart_wait_tx_done(u->uart_num, portMAX_DELAY);
+    if (err == ESP_OK) {
+        err = uart_set_baudrate(u->uart_num, baud);
+    }
+    return (err == ESP_OK) ? 0 : -1;
+}
+
+
+const phys_backend_t phys_uart_backend = {
+    .name         = "uart",
+    .default_ctx  = &s_default_uart,
+    .init         = uart_init,
+    .write        = uart_write,
+    .flush        = NULL,
+    .read         = uart_read,
+    .set_baudrate = uart_baudrate,
+};
@@ -0,0 +1,161 @@
+/* UDP backend of the physical layer, for boards on the same network
+   (Wi-Fi or Ethernet, brought up by the application before
+   physical_init()).  The byte stream is carried in datagrams of up to
+   CONFIG_RPC_UDP_MTU bytes: each physical_sendv(), normally one link
+   frame, becomes one datagram, and longer writes are split.  The link
+   layer's CRC still checks every frame; a lost or reordered datagram
+   looks like a damaged frame, so use the reliable mode
+   (CONFIG_RPC_ARQ_WINDOW) on lossy networks.
+
+   Datagrams go to the port's peer_addr:peer_port (for the default
+   port CONFIG_RPC_UDP_PEER_ADDR:CONFIG_RPC_UDP_PEER_PORT).  With an
+   empty peer address, replies go to whoever sent the last datagram, so
+   a host tool can talk to the board without configuring it. */
+
+#include "physical.h"
+#include "rpc_config.h"
+#include <freertos/FreeRTOS.h>
+#include <lwip/sockets.h>
+#include <string.h>
+#include <stdbool.h>
+
+
+static phys_udp_t s_default_udp = {
+    .local_port = CONFIG_RPC_UDP_LOCAL_PORT,
+    .peer_addr  = CONFIG_RPC_UDP_PEER_ADDR,
+    .peer_port  = CONFIG_RPC_UDP_PEER_PORT,
+};
+
+
+static int udp_init(void *ctx) {
+    phys_udp_t *u = (phys_udp_t *)ctx;
+    u->tx_buf = (uint8_t *)pvPortMalloc(CONFIG_RPC_UDP_MTU);
+    u->rx_buf = (uint8_t *)pvPortMalloc(CONFIG_RPC_UDP_MTU);
+    u->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (!u->tx_buf || !u->rx_buf || u->sock < 0) {
+        goto fail;
+    }
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family      = AF_INET;
+    local.sin_port        = htons(u->local_port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(u->sock, (struct sockaddr *)&local, sizeof(local)) != 0) {
+        goto fail;
+    }
+
+    struct in_addr addr;
+    portMUX_INITIALIZE(&u->peer_lock);
+    u->peer_known  = (u->peer_addr && inet_pton(AF_INET, u->peer_addr, &addr) == 1);
+    u->peer_ip     = u->peer_known ? addr.s_addr : 0;
+    u->peer_port_n = htons(u->peer_port);
+    u->tx_len = 0;
+    u->rx_pos = u->rx_len = 0;
+    return 0;
+
+fail:
+    if (u->sock >= 0) close(u->sock);
+    u->sock = -1;
+    vPortFree(u->tx_buf);
+    vPortFree(u->rx_buf);
+    u->tx_buf = u->rx_buf = NULL;
+    return -1;
+}
+
+// Send the pending datagram; without a known peer it is dropped
+static int udp_flush(void *ctx) {
+    phys_udp_t *u = (phys_udp_t *)ctx;
+    if (u->tx_len == 0) {
+        return 0;
+    }
+    const size_t len = u->tx_len;
+    u->tx_len = 0;
+
+    struct sockaddr_in peer;
+    memset(&peer, 0, sizeof(peer));
+    peer.sin_family = AF_INET;
+    portENTER_CRITICAL(&u->peer_lock);
+    peer.sin_addr.s_addr = u->peer_ip;
+    peer.sin_port        = u->peer_port_n;
+    const bool known = u->peer_known;
+    portEXIT_CRITICAL(&u->peer_lock);
+    if (!known) {
+        return 0;  // like a UART with nothing attached
+    }
+    const ssize_t sent = sendto(u->sock, u->tx_buf, len, 0, (const struct sockaddr *)&peer, sizeof(peer));
+    return (sent == (ssize_t)len) ? 0 : -1;
+}
+
+static int udp_write(void *ctx, const uint8_t *data, size_t len) {
+    phys_udp_t *u = (phys_udp_t *)ctx;
+    size_t done = 0;
+    while (done < len) {
+        if (u->tx_len == CONFIG_RPC_UDP_MTU && udp_flush(u) != 0) {
+            return -1;
+        }
+        size_t n = CONFIG_RPC_UDP_MTU - u->tx_len;
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(&u->tx_buf[u->tx_len], &data[done], n);
+        u->tx_len += n;
+        done += n;
+    }
+    return (int)len;
+}
+
+/* Hand out the rest of the last datagram, or wait for the next one.
+   Datagrams longer than CONFIG_RPC_UDP_MTU are cut off by the socket. */
+static int udp_read(void *ctx, uint8_t *buf, size_t max_len, uint32_t timeout_ms) {
+    phys_udp_t *u = (phys_udp_t *)ctx;
+    while (u->rx_pos >= u->rx_len) {
+        if (timeout_ms != PHYS_WAIT_FOREVER) {
+            fd_set rfds;
+            FD_ZERO(&rfds);
+            FD_SET(u->sock, &rfds);
+            struct timeval tv = {
+                .tv_sec  = (long)(timeout_ms / 1000),
+                .tv_usec = (long)(timeout_ms % 1000) * 1000,
+            };
+            const int ready = select(u->sock + 1, &rfds, NULL, NULL, &tv);
+            if (ready <= 0) {
+                return (ready == 0) ? 0 : -1;
+            }
+        }
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        const ssize_t got = recvfrom(u->sock, u->rx_buf, CONFIG_RPC_UDP_MTU, 0,
+                                     (struct sockaddr *)&from, &from_len);
+        if (got < 0) {
+            return -1;
+        }
+        if (!u->peer_addr || u->peer_addr[0] == '\0') {
+            portENTER_CRITICAL(&u->peer_lock);
+            u->peer_ip     = from.sin_addr.s_addr;
+            u->peer_port_n = from.sin_port;
+            u->peer_known  = true;
+            portEXIT_CRITICAL(&u->peer_lock);
+        }
+        u->rx_pos = 0;
+        u->rx_len = (size_t)got;  // an empty datagram just waits again
+    }
+
+    size_t n = u->rx_len - u->rx_pos;
+    if (n > max_len) {
+        n = max_len;
+    }
+    memcpy(buf, &u->rx_buf[u->rx_pos], n);
+    u->rx_pos += n;
+    return (int)n;
+}
+
+
+const phys_backend_t phys_udp_backend = {
+    .name         = "udp",
+    .default_ctx  = &s_default_udp,
+    .init         = udp_init,
+    .write        = udp_write,
+    .flush        = udp_flush,
+    .read         = udp_read,
+    .set_baudrate = NULL,
+};
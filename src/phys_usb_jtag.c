@@ -0,0 +1,51 @@
+/* USB Serial/JTAG backend of the physical layer: the native USB port of
+   the ESP32-S3, -C3, -C6 and similar parts, which the host sees as a
+   CDC-ACM serial port.  USB runs at full speed whatever the host sets
+   as baud rate, so there is no rate to switch.  The port must not also
+   carry the console (CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG).  The chip has
+   a single such port, so the functions take no context. */
+
+#include "physical.h"
+#include "rpc_config.h"
+#include "soc/soc_caps.h"
+
+#if SOC_USB_SERIAL_JTAG_SUPPORTED
+
+#include "driver/usb_serial_jtag.h"
+#include <freertos/FreeRTOS.h>
+
+
+static int usb_jtag_init(void *ctx) {
+    (void)ctx;
+    usb_serial_jtag_driver_config_t cfg = {
+        .rx_buffer_size = CONFIG_RPC_UART_RX_BUFFER_SIZE,
+        .tx_buffer_size = (CONFIG_RPC_UART_TX_BUFFER_SIZE > 0) ? CONFIG_RPC_UART_TX_BUFFER_SIZE : 256,
+    };
+    return (usb_serial_jtag_driver_install(&cfg) == ESP_OK) ? 0 : -1;
+}
+
+static int usb_jtag_write(void *ctx, const uint8_t *data, size_t len) {
+    (void)ctx;
+    return usb_serial_jtag_write_bytes(data, len, portMAX_DELAY);
+}
+
+// The driver returns what its ring holds as soon as anything arrived
+static int usb_jtag_read(void *ctx, uint8_t *buf, size_t max_len, uint32_t timeout_ms) {
+    (void)ctx;
+    const TickType_t wait = (timeout_ms == PHYS_WAIT_FOREVER) ? portMAX_DELAY
+                                                              : pdMS_TO_TICKS(timeout_ms);
+    return usb_serial_jtag_read_bytes(buf, (uint32_t)max_len, wait);
+}
+
+
+const phys_backend_t phys_usb_jtag_backend = {
+    .name         = "usb_jtag",
+    .default_ctx  = NULL,  // there is only the one port
+    .init         = usb_jtag_init,
+    .write        = usb_jtag_write,
+    .flush        = NULL,
+    .read         = usb_jtag_read,
+    .set_baudrate = NULL,
+};
+
+#endif // SOC_USB_SERIAL_JTAG_SUPPORTED
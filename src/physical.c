@@ -1,52 +1,145 @@
-/* Physical layer implementation using ESP-IDF UART driver.
-   Provides initialization, blocking send and receive functions. */
+/* Physical layer front end.  Provides initialization and blocking
+   (scatter-gather) send and receive functions for each port on top of
+   its backend: phys_uart.c, phys_mem.c, phys_usb_jtag.c or phys_udp.c. */
 
 #include "physical.h"
-#include "driver/uart.h"
-#include "driver/gpio.h"
+#include "rpc_config.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 
 
-static bool s_uart_installed = false;
+// Backend selected in Kconfig ("Physical link")
+#if CONFIG_RPC_PHYS_MEM_LOOPBACK
+#define PHYS_DEFAULT_BACKEND phys_mem_backend
+#elif CONFIG_RPC_PHYS_USB_JTAG
+#define PHYS_DEFAULT_BACKEND phys_usb_jtag_backend
+#elif CONFIG_RPC_PHYS_UDP
+#define PHYS_DEFAULT_BACKEND phys_udp_backend
+#else
+#define PHYS_DEFAULT_BACKEND phys_uart_backend
+#endif
+
+// Port behind physical_init() and the functions without a port argument
+static phys_port_t s_default_port = { .backend = &PHYS_DEFAULT_BACKEND };
+
+
+int physical_set_backend(const phys_backend_t *backend) {
+    if (!backend || s_default_port.installed || !backend->init || !backend->write || !backend->read) {
+        return -1;
+    }
+    s_default_port.backend = backend;
+    return 0;
+}
+
+
+const phys_backend_t *physical_get_backend(void) {
+    return s_default_port.backend;
+}
+
+
+phys_port_t *physical_default_port(void) {
+    return &s_default_port;
+}
+
+
+// Create the port's TX mutex and bring up its backend
+int physical_port_init(phys_port_t *port, const phys_backend_t *backend, void *ctx) {
+    if (!port || !backend || !backend->init || !backend->write || !backend->read) {
+        return -1;
+    }
+    if (port->installed) {
+        return 0;
+    }
+    port->backend = backend;
+    port->ctx = ctx ? ctx : backend->default_ctx;
+    if (!port->tx_mutex) {
+        port->tx_mutex = xSemaphoreCreateMutex();
+    }
+    port->installed = (port->tx_mutex != NULL && backend->init(port->ctx) == 0);
+    return port->installed ? 0 : -1;
+}
 
-// Initialize UART with 8N1 configuration and install driver
-void physical_init(void) {
-    uart_config_t cfg = {
-        .baud_rate = PHYS_UART_BAUDRATE,
-        .data_bits = UART_DATA_8_BITS,
-        .parity    = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-        .source_clk = UART_SCLK_APB,
-    };
-    uart_param_config(PHYS_UART_NUM, &cfg);
 
-    uart_set_pin(PHYS_UART_NUM, PHYS_UART_TX_PIN, PHYS_UART_RX_PIN,
-                 UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+void physical_init(void) {
+    (void)physical_port_init(&s_default_port, s_default_port.backend, NULL);
+}
 
-    uart_driver_install(PHYS_UART_NUM,
-                        256,  // RX buffer size
-                        0,    // TX buffer size (send is synchronous)
-                        0, NULL, 0);
+/* Change the baud rate.  Holding the TX mutex keeps other senders out
+   while the last frame drains, so no frame is split across two rates */
+int physical_port_set_baudrate(phys_port_t *port, uint32_t baud) {
+    if (!port || !port->installed || baud == 0) {
+        return -1;
+    }
+    if (!port->backend->set_baudrate) {
+        return 0;  // nothing is clocked
+    }
+    xSemaphoreTake(port->tx_mutex, portMAX_DELAY);
+    const int rc = port->backend->set_baudrate(port->ctx, baud);
+    xSemaphoreGive(port->tx_mutex);
+    return rc;
+}
 
-    s_uart_installed = true;
+int physical_set_baudrate(uint32_t baud) {
+    return physical_port_set_baudrate(&s_default_port, baud);
 }
 
-// Send len bytes over UART. Blocks until all bytes are written
+// Send len bytes. Blocks until all bytes are written
 int physical_send(const uint8_t *data, size_t len) {
-    if (!s_uart_installed || !data) {
+    if (!data) {
+        return -1;
+    }
+    const phys_iovec_t seg = { data, len };
+    return physical_port_sendv(&s_default_port, &seg, 1);
+}
+
+/* Send several segments as one unit.  The backend copies each segment
+   straight from the caller's buffer, so no staging buffer is needed */
+int physical_port_sendv(phys_port_t *port, const phys_iovec_t *iov, size_t iovcnt) {
+    if (!port || !port->installed || (!iov && iovcnt > 0)) {
         return -1;
     }
-    const int written = uart_write_bytes(PHYS_UART_NUM, (const char *)data, len);
-    return written;
+    const phys_backend_t *backend = port->backend;
+    int total = 0;
+    xSemaphoreTake(port->tx_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (iov[i].len == 0) continue;
+        const int written = backend->write(port->ctx, (const uint8_t *)iov[i].base, iov[i].len);
+        if (written != (int)iov[i].len) {
+            total = -1;
+            break;
+        }
+        total += written;
+    }
+    if (total >= 0 && backend->flush && backend->flush(port->ctx) != 0) {
+        total = -1;
+    }
+    xSemaphoreGive(port->tx_mutex);
+    return total;
 }
 
-// Receive one byte over UART. Blocks until byte is available
+int physical_sendv(const phys_iovec_t *iov, size_t iovcnt) {
+    return physical_port_sendv(&s_default_port, iov, iovcnt);
+}
+
+// Receive one byte. Blocks until byte is available
 int physical_receive_byte(uint8_t *byte) {
-    if (!s_uart_installed || !byte) {
+    if (!byte) {
         return -1;
     }
-    int ret = uart_read_bytes(PHYS_UART_NUM, byte, 1, portMAX_DELAY);
+    int ret = physical_port_receive(&s_default_port, byte, 1, PHYS_WAIT_FOREVER);
     return (ret == 1) ? 1 : -1;
 }
+
+/* Receive up to max_len bytes.  Blocks only for the first byte, then
+   takes what the backend has already buffered */
+int physical_port_receive(phys_port_t *port, uint8_t *buf, size_t max_len, uint32_t timeout_ms) {
+    if (!port || !port->installed || !buf || max_len == 0) {
+        return -1;
+    }
+    return port->backend->read(port->ctx, buf, max_len, timeout_ms);
+}
+
+int physical_receive(uint8_t *buf, size_t max_len, uint32_t timeout_ms) {
+    return physical_port_receive(&s_default_port, buf, max_len, timeout_ms);
+}
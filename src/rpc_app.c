@@ -6,77 +6,29 @@
 #include <freertos/FreeRTOS.h>   
 #include <string.h>
 #include <stdint.h>
-#include <stdio.h>
 
 
-static void rpc_sum(const uint8_t *args, uint16_t args_len,
-                    uint8_t **resp_data, uint16_t *resp_len, uint8_t *error_code);
-
 static void rpc_echo(const uint8_t *args, uint16_t args_len,
                      uint8_t **resp_data, uint16_t *resp_len, uint8_t *error_code);
 
-// Register demo functions.  Ownership: transport layer keeps the registry. 
-void rpc_app_init(void) {
-    (void)transport_register_function("sum",  rpc_sum);
-    (void)transport_register_function("echo", rpc_echo);
+/* sum: add the two arguments.  The typed wrapper below decodes them and
+   encodes the result straight into the transport's response buffer. */
+static void sum_impl(const rpc_sum_args_t *in, rpc_sum_result_t *out, uint8_t *error_code) {
+    (void)error_code;
+    out->sum = in->a + in->b;
 }
 
+RPC_DEFINE_HANDLER(rpc_sum, sum_impl, rpc_sum_args, rpc_sum_result)
 
-/* sum: read two little-endian uint32_t arguments, compute sum,
-   format decimal ASCII into a heap buffer and return it. */
-static void rpc_sum(const uint8_t *args, uint16_t args_len,
-                    uint8_t **resp_data, uint16_t *resp_len, uint8_t *error_code) {
-    // Validate input contract 
-    if (!resp_data || !resp_len || !error_code) {
-        return; // caller misused API; nothing we can safely do 
-    }
-    if (args_len != 8 || !args) {
-        *error_code = ERR_INTERNAL;
-        *resp_data = NULL; *resp_len = 0;
-        return;
-    }
 
-    // Decode little-endian uint32_t values 
-    uint32_t a = (uint32_t)args[0]
-               | ((uint32_t)args[1] << 8)
-               | ((uint32_t)args[2] << 16)
-               | ((uint32_t)args[3] << 24);
-
-    uint32_t b = (uint32_t)args[4]
-               | ((uint32_t)args[5] << 8)
-               | ((uint32_t)args[6] << 16)
-               | ((uint32_t)args[7] << 24);
-
-    uint32_t result = a + b;
-
-    // Format decimal ASCII into a small stack buffer first 
-    char tmp[12]; // up to 10 digits for 32-bit unsigned + '\0' headroom 
-    int written = snprintf(tmp, sizeof(tmp), "%lu", (unsigned long)result);
-    if (written <= 0) {
-        *error_code = ERR_INTERNAL;
-        *resp_data = NULL; 
-        *resp_len = 0;
-        return;
-    }
-
-    // Allocate exact-size heap buffer 
-    char *buf = (char *)pvPortMalloc((size_t)written + 1u);
-    if (!buf) {
-        *error_code = ERR_INTERNAL;
-        *resp_data = NULL; 
-        *resp_len = 0;
-        return;
-    }
-
-    // Produce response payload 
-    memcpy(buf, tmp, (size_t)written);
-    buf[written] = '\0';
-
-    *resp_data  = (uint8_t *)buf;
-    *resp_len   = (uint16_t)written; 
-    *error_code = 0;
+/* Register demo functions.  Ownership: transport layer keeps the registry.
+   sum is cheap enough to run inline in the RX task. */
+void rpc_app_init(void) {
+    (void)transport_register_handler("sum", rpc_sum, RPC_FLAG_INLINE);
+    (void)transport_register_function("echo", rpc_echo);
 }
 
+
 // echo: copy input bytes to heap buffer and append '\0' sentinel. 
 static void rpc_echo(const uint8_t *args, uint16_t args_len,
                      uint8_t **resp_data, uint16_t *resp_len, uint8_t *error_code)
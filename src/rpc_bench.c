@@ -0,0 +1,306 @@
+/* On-target micro-benchmarks for the RPC stack.  Compiled in only when
+   CONFIG_RPC_BENCH is enabled; each benchmark prints its own results.
+   Cycle counts come from the CPU cycle counter, so run them with the
+   other tasks idle for stable numbers.
+
+   The end-to-end benchmarks call the local demo functions through the
+   whole stack, so they need the link looped back to this node: a wire
+   from TX to RX, or CONFIG_RPC_PHYS_UART_LOOPBACK / _MEM_LOOPBACK.  The
+   memory loopback takes the UART out of the numbers and leaves the cost
+   of the protocol code itself. */
+
+#include "rpc_bench.h"
+#include "rpc_config.h"
+
+#if CONFIG_RPC_BENCH
+
+#include "link_layer.h"
+#include "physical.h"
+#include "transport.h"
+#include "rpc_app.h"
+#include <esp_cpu.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Buffer size and repetitions for the CRC benchmark
+#define BENCH_CRC_LEN    1024
+#define BENCH_CRC_ROUNDS 64
+
+/* Room the echo request and response need besides the payload: transport
+   header, function name and the link's ARQ header. */
+#define BENCH_ECHO_OVERHEAD 16
+
+// Payload size of the baud rate sweep
+#define BENCH_BAUD_PAYLOAD 256
+
+// Most tasks the concurrency sweep runs at once
+#define BENCH_MAX_TASKS 8
+
+// The largest leaves room for the overhead in a 64 KB frame
+static const uint16_t s_payload_sizes[] = { 1, 16, 64, 256, 1024, 4096, 16384, 65000 };
+
+// Latency of each call of the current run, in microseconds
+static uint32_t s_lat_us[CONFIG_RPC_BENCH_CALLS];
+
+
+// Reference: the original bit-at-a-time CRC-8 (poly 0x07)
+static uint8_t crc8_bitwise(const uint8_t *data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+
+void rpc_bench_crc8(void) {
+    static uint8_t buf[BENCH_CRC_LEN];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (uint8_t)(i * 31u + 7u);
+    }
+
+    // volatile sinks keep the loops from being optimised away
+    volatile uint8_t sink_bitwise = 0;
+    volatile uint8_t sink_table   = 0;
+
+    uint32_t t0 = esp_cpu_get_cycle_count();
+    for (int r = 0; r < BENCH_CRC_ROUNDS; r++) {
+        sink_bitwise ^= crc8_bitwise(buf, sizeof(buf));
+    }
+    uint32_t t1 = esp_cpu_get_cycle_count();
+    for (int r = 0; r < BENCH_CRC_ROUNDS; r++) {
+        sink_table ^= link_crc8(buf, sizeof(buf));
+    }
+    uint32_t t2 = esp_cpu_get_cycle_count();
+
+    const uint32_t bytes = (uint32_t)BENCH_CRC_LEN * BENCH_CRC_ROUNDS;
+    printf("bench crc8: bitwise %.2f cyc/B, table %.2f cyc/B, results %s\n",
+           (double)(t1 - t0) / bytes, (double)(t2 - t1) / bytes,
+           (sink_bitwise == sink_table) ? "match" : "MISMATCH");
+}
+
+
+static int cmp_u32(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts lat and prints throughput and latency percentiles of one run
+static void report(const char *label, uint32_t *lat, uint32_t calls, uint32_t failed,
+                   uint64_t bytes, int64_t elapsed_us) {
+    if (calls == 0 || elapsed_us <= 0) {
+        printf("bench %s: no calls completed, %lu failed\n", label, (unsigned long)failed);
+        return;
+    }
+    qsort(lat, calls, sizeof(lat[0]), cmp_u32);
+    const uint32_t p50  = lat[(calls * 500u) / 1000u];
+    const uint32_t p99  = lat[(calls * 990u) / 1000u];
+    const uint32_t p999 = lat[(calls * 999u) / 1000u];
+    printf("bench %s: %lu calls/s, %lu B/s, p50 %lu us, p99 %lu us, p999 %lu us, %lu failed\n",
+           label,
+           (unsigned long)((uint64_t)calls * 1000000u / (uint64_t)elapsed_us),
+           (unsigned long)(bytes * 1000000u / (uint64_t)elapsed_us),
+           (unsigned long)p50, (unsigned long)p99, (unsigned long)p999,
+           (unsigned long)failed);
+}
+
+// Pseudo-random fill, so compression does not shrink the payload
+static void fill_payload(uint8_t *buf, uint32_t len) {
+    uint32_t x = 0x2545F491u;
+    for (uint32_t i = 0; i < len; i++) {
+        x = x * 1664525u + 1013904223u;
+        buf[i] = (uint8_t)(x >> 24);
+    }
+}
+
+/* Echo calls count payloads of len bytes and print the result under
+   label.  Bytes/s counts the payload in both directions. */
+static void run_echo(const char *label, const uint8_t *args, uint8_t *resp,
+                     uint16_t len, uint32_t count) {
+    // At 115200 baud a byte takes about 87 us each way
+    const uint32_t timeout_ms = 1000u + len / 2u;
+    uint32_t done = 0;
+    uint32_t failed = 0;
+
+    const int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t resp_len = 0;
+        uint8_t  err = 0;
+        const int64_t t0 = esp_timer_get_time();
+        const int rc = transport_call_into("echo", args, len, resp, len, &resp_len, &err, timeout_ms);
+        if (rc != 0 || err != 0 || resp_len != len || memcmp(args, resp, len) != 0) {
+            failed++;
+            continue;
+        }
+        s_lat_us[done++] = (uint32_t)(esp_timer_get_time() - t0);
+    }
+    report(label, s_lat_us, done, failed, (uint64_t)done * len * 2u, esp_timer_get_time() - start);
+}
+
+// Payloads the link and the RX task's frame buffer both take
+static bool payload_fits(uint32_t len) {
+    return len + BENCH_ECHO_OVERHEAD <= CONFIG_RPC_RX_FRAME_SIZE &&
+           len + BENCH_ECHO_OVERHEAD <= CONFIG_RPC_LINK_MAX_PAYLOAD;
+}
+
+void rpc_bench_payload(void) {
+    uint32_t max_len = 0;
+    for (size_t i = 0; i < sizeof(s_payload_sizes) / sizeof(s_payload_sizes[0]); i++) {
+        if (payload_fits(s_payload_sizes[i])) max_len = s_payload_sizes[i];
+    }
+    uint8_t *args = (uint8_t *)pvPortMalloc(max_len);
+    uint8_t *resp = (uint8_t *)pvPortMalloc(max_len);
+    if (!args || !resp) {
+        printf("bench payload: out of memory for %lu B buffers\n", (unsigned long)max_len);
+        vPortFree(args);
+        vPortFree(resp);
+        return;
+    }
+    fill_payload(args, max_len);
+
+    for (size_t i = 0; i < sizeof(s_payload_sizes) / sizeof(s_payload_sizes[0]); i++) {
+        const uint16_t len = s_payload_sizes[i];
+        char label[32];
+        snprintf(label, sizeof(label), "echo %u B", (unsigned)len);
+        if (!payload_fits(len)) {
+            printf("bench %s: skipped, frames are limited to %d B\n", label,
+                   (CONFIG_RPC_RX_FRAME_SIZE < CONFIG_RPC_LINK_MAX_PAYLOAD) ? CONFIG_RPC_RX_FRAME_SIZE
+                                                                           : CONFIG_RPC_LINK_MAX_PAYLOAD);
+            continue;
+        }
+        // Fewer rounds for large payloads, so the sweep ends in reasonable time
+        uint32_t count = CONFIG_RPC_BENCH_CALLS;
+        if (len > 1024) count = count * 1024u / len;
+        if (count < 4) count = 4;
+        run_echo(label, args, resp, len, count);
+    }
+    vPortFree(args);
+    vPortFree(resp);
+}
+
+
+// One task of the concurrency sweep: calls sum for its share of s_lat_us
+typedef struct {
+    uint32_t          first;
+    uint32_t          count;
+    uint32_t          done;
+    uint32_t          failed;
+    SemaphoreHandle_t finished;
+} bench_worker_t;
+
+static void bench_worker_task(void *arg) {
+    bench_worker_t *w = (bench_worker_t *)arg;
+    uint8_t args[rpc_sum_args_MAX_SIZE];
+    uint8_t resp[rpc_sum_result_MAX_SIZE];
+
+    for (uint32_t i = 0; i < w->count; i++) {
+        const rpc_sum_args_t in = { w->first + i, 1 };
+        rpc_writer_t wr;
+        rpc_writer_init(&wr, args, sizeof(args));
+        rpc_sum_args_put(&wr, &in);
+
+        uint16_t resp_len = 0;
+        uint8_t  err = 0;
+        const int64_t t0 = esp_timer_get_time();
+        const int rc = transport_call_into("sum", args, wr.len, resp, sizeof(resp), &resp_len, &err, 1000);
+        const uint32_t lat = (uint32_t)(esp_timer_get_time() - t0);
+
+        rpc_reader_t r;
+        rpc_sum_result_t out;
+        rpc_reader_init(&r, resp, resp_len);
+        if (rc != 0 || err != 0 || !rpc_sum_result_get(&r, &out) || out.sum != in.a + 1) {
+            w->failed++;
+            continue;
+        }
+        s_lat_us[w->first + w->done++] = lat;
+    }
+    xSemaphoreGive(w->finished);
+    vTaskDelete(NULL);
+}
+
+void rpc_bench_concurrency(void) {
+    static bench_worker_t workers[BENCH_MAX_TASKS];
+    SemaphoreHandle_t finished = xSemaphoreCreateCounting(BENCH_MAX_TASKS, 0);
+    if (!finished) return;
+
+    for (uint32_t tasks = 1; tasks <= BENCH_MAX_TASKS && tasks <= CONFIG_RPC_MAX_PENDING_CALLS; tasks *= 2) {
+        const uint32_t per_task = CONFIG_RPC_BENCH_CALLS / tasks;
+        uint32_t started = 0;
+        const int64_t start = esp_timer_get_time();
+        for (uint32_t t = 0; t < tasks; t++) {
+            workers[t] = (bench_worker_t){ t * per_task, per_task, 0, 0, finished };
+            if (xTaskCreate(bench_worker_task, "rpc_bench", 3072, &workers[t], 5, NULL) == pdPASS) {
+                started++;
+            }
+        }
+        for (uint32_t t = 0; t < started; t++) {
+            xSemaphoreTake(finished, portMAX_DELAY);
+        }
+        const int64_t elapsed = esp_timer_get_time() - start;
+
+        // Pack the latencies of all tasks to the front for the percentiles
+        uint32_t done = 0;
+        uint32_t failed = (tasks - started) * per_task;
+        for (uint32_t t = 0; t < started; t++) {
+            memmove(&s_lat_us[done], &s_lat_us[workers[t].first], workers[t].done * sizeof(s_lat_us[0]));
+            done   += workers[t].done;
+            failed += workers[t].failed;
+        }
+        char label[32];
+        snprintf(label, sizeof(label), "sum x%lu tasks", (unsigned long)tasks);
+        report(label, s_lat_us, done, failed,
+               (uint64_t)done * (rpc_sum_args_MAX_SIZE + rpc_sum_result_MAX_SIZE), elapsed);
+    }
+    vSemaphoreDelete(finished);
+}
+
+
+void rpc_bench_baudrate(void) {
+#if CONFIG_RPC_PHYS_UART_LOOPBACK || CONFIG_RPC_PHYS_MEM_LOOPBACK
+    static const uint32_t s_baud_rates[] = { 115200, 230400, 460800, 921600, 1500000, 2000000 };
+    static uint8_t args[BENCH_BAUD_PAYLOAD];
+    static uint8_t resp[BENCH_BAUD_PAYLOAD];
+    if (!physical_get_backend()->set_baudrate) {
+        printf("bench baudrate: skipped, the link has no baud rate\n");
+        return;
+    }
+    fill_payload(args, sizeof(args));
+
+    for (size_t i = 0; i < sizeof(s_baud_rates) / sizeof(s_baud_rates[0]); i++) {
+        const uint32_t baud = s_baud_rates[i];
+        if (baud > CONFIG_RPC_UART_MAX_BAUDRATE) break;
+        char label[40];
+        snprintf(label, sizeof(label), "echo %u B at %lu baud", (unsigned)sizeof(args), (unsigned long)baud);
+        if (physical_set_baudrate(baud) != 0) {
+            printf("bench %s: cannot set the rate\n", label);
+            continue;
+        }
+        run_echo(label, args, resp, sizeof(args), CONFIG_RPC_BENCH_CALLS);
+    }
+    (void)physical_set_baudrate(link_get_baudrate());
+#else
+    // Both ends would have to switch together; use link_negotiate_baudrate() instead
+    printf("bench baudrate: skipped, needs a loopback link (CONFIG_RPC_PHYS_*_LOOPBACK)\n");
+#endif
+}
+
+
+void rpc_bench_run(void) {
+    rpc_bench_crc8();
+    rpc_bench_payload();
+    rpc_bench_concurrency();
+    rpc_bench_baudrate();
+}
+
+#endif // CONFIG_RPC_BENCH
@@ -0,0 +1,199 @@
+/* Response cache (see rpc_cache.h).  The table is a handful of slots
+   searched linearly under one mutex; each entry is a heap block with the
+   request args inline and a reference count, so a sender can keep using
+   an entry that another task replaces or drops. */
+
+#include "rpc_cache.h"
+#include "rpc_config.h"
+#include <string.h>
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+
+#if CONFIG_RPC_CACHE_ENTRIES > 0
+
+struct rpc_cache_entry {
+    const void      *func;
+    link_prebuilt_t *frame;
+    TickType_t       stored;    // tick count when filled
+    TickType_t       ttl;       // ticks it is served for
+    uint32_t         used;      // LRU stamp, from s_clock
+    uint32_t         hash;      // FNV-1a of args
+    uint16_t         args_len;
+    uint8_t          form;
+    uint8_t          refs;      // one for the table, one per task using it
+    uint8_t          args[];
+};
+
+static rpc_cache_entry_t *s_slots[CONFIG_RPC_CACHE_ENTRIES];
+static SemaphoreHandle_t  s_lock = NULL;
+static uint32_t           s_clock = 0;
+
+
+static uint32_t args_hash(const uint8_t *args, uint16_t len) {
+    uint32_t hash = 2166136261u;
+    for (uint16_t i = 0; i < len; i++) {
+        hash = (hash ^ args[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+// Drop one reference, freeing the entry with the last (lock held)
+static void entry_unref(rpc_cache_entry_t *entry) {
+    if (--entry->refs == 0) {
+        vPortFree(entry->frame);
+        vPortFree(entry);
+    }
+}
+
+
+// Take entry out of slot i (lock held)
+static void slot_clear(size_t i) {
+    entry_unref(s_slots[i]);
+    s_slots[i] = NULL;
+}
+
+
+static bool entry_expired(const rpc_cache_entry_t *entry, TickType_t now) {
+    return now - entry->stored >= entry->ttl;
+}
+
+
+static bool entry_matches(const rpc_cache_entry_t *entry, const void *func, uint8_t form,
+                          const uint8_t *args, uint16_t args_len, uint32_t hash) {
+    return entry->func == func && entry->form == form && entry->hash == hash &&
+           entry->args_len == args_len && (args_len == 0 || memcmp(entry->args, args, args_len) == 0);
+}
+
+
+/* Slot for a new entry: the one holding the same key, else a free or
+   expired one, else the least recently used (lock held) */
+static size_t pick_slot(const rpc_cache_entry_t *entry) {
+    size_t free_slot = CONFIG_RPC_CACHE_ENTRIES;
+    size_t lru = 0;
+    for (size_t i = 0; i < CONFIG_RPC_CACHE_ENTRIES; i++) {
+        const rpc_cache_entry_t *old = s_slots[i];
+        if (!old || entry_expired(old, entry->stored)) {
+            if (free_slot == CONFIG_RPC_CACHE_ENTRIES) free_slot = i;
+            continue;
+        }
+        if (entry_matches(old, entry->func, entry->form, entry->args, entry->args_len, entry->hash)) {
+            return i;
+        }
+        if (!s_slots[lru] || (int32_t)(old->used - s_slots[lru]->used) < 0) lru = i;
+    }
+    return (free_slot < CONFIG_RPC_CACHE_ENTRIES) ? free_slot : lru;
+}
+
+
+void rpc_cache_init(void) {
+    if (!s_lock) s_lock = xSemaphoreCreateMutex();
+}
+
+
+rpc_cache_entry_t *rpc_cache_get(const void *func, uint8_t form, const uint8_t *args, uint16_t args_len) {
+    if (!s_lock) return NULL;
+    const uint32_t   hash = args_hash(args, args_len);
+    const TickType_t now  = xTaskGetTickCount();
+    rpc_cache_entry_t *hit = NULL;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_RPC_CACHE_ENTRIES && !hit; i++) {
+        rpc_cache_entry_t *entry = s_slots[i];
+        if (!entry || !entry_matches(entry, func, form, args, args_len, hash)) continue;
+        if (entry_expired(entry, now)) {
+            slot_clear(i);
+            break;
+        }
+        entry->used = ++s_clock;
+        entry->refs++;
+        hit = entry;
+    }
+    xSemaphoreGive(s_lock);
+    return hit;
+}
+
+
+const link_prebuilt_t *rpc_cache_frame(const rpc_cache_entry_t *entry) {
+    return entry->frame;
+}
+
+
+void rpc_cache_release(rpc_cache_entry_t *entry) {
+    if (!entry) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    entry_unref(entry);
+    xSemaphoreGive(s_lock);
+}
+
+
+void rpc_cache_put(const void *func, uint8_t form, const uint8_t *args, uint16_t args_len,
+                   link_prebuilt_t *frame, uint32_t ttl_ms) {
+    rpc_cache_entry_t *entry = NULL;
+    if (s_lock && frame && ttl_ms > 0) {
+        entry = (rpc_cache_entry_t *)pvPortMalloc(sizeof(rpc_cache_entry_t) + args_len);
+    }
+    if (!entry) {
+        vPortFree(frame);
+        return;
+    }
+    entry->func     = func;
+    entry->frame    = frame;
+    entry->stored   = xTaskGetTickCount();
+    entry->ttl      = pdMS_TO_TICKS(ttl_ms) ? pdMS_TO_TICKS(ttl_ms) : 1;
+    entry->hash     = args_hash(args, args_len);
+    entry->args_len = args_len;
+    entry->form     = form;
+    entry->refs     = 1;
+    if (args_len > 0) memcpy(entry->args, args, args_len);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const size_t victim = pick_slot(entry);
+    if (s_slots[victim]) slot_clear(victim);
+    entry->used = ++s_clock;
+    s_slots[victim] = entry;
+    xSemaphoreGive(s_lock);
+}
+
+
+void rpc_cache_drop(const void *func) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_RPC_CACHE_ENTRIES; i++) {
+        if (s_slots[i] && (!func || s_slots[i]->func == func)) slot_clear(i);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+#else  // CONFIG_RPC_CACHE_ENTRIES == 0: nothing is ever cached
+
+void rpc_cache_init(void) {}
+
+rpc_cache_entry_t *rpc_cache_get(const void *func, uint8_t form, const uint8_t *args, uint16_t args_len) {
+    (void)func; (void)form; (void)args; (void)args_len;
+    return NULL;
+}
+
+const link_prebuilt_t *rpc_cache_frame(const rpc_cache_entry_t *entry) {
+    (void)entry;
+    return NULL;
+}
+
+void rpc_cache_release(rpc_cache_entry_t *entry) {
+    (void)entry;
+}
+
+void rpc_cache_put(const void *func, uint8_t form, const uint8_t *args, uint16_t args_len,
+                   link_prebuilt_t *frame, uint32_t ttl_ms) {
+    (void)func; (void)form; (void)args; (void)args_len; (void)ttl_ms;
+    vPortFree(frame);
+}
+
+void rpc_cache_drop(const void *func) {
+    (void)func;
+}
+
+#endif
@@ -0,0 +1,143 @@
+/* Greedy LZ77 compressor with a single-entry hash chain, in the spirit of
+   LZ4's fast mode: one table lookup per input byte, matches verified
+   byte by byte.  Positions are "virtual": the dictionary occupies
+   [0, DICT_LEN) and the data follows it, so a match can start in either. */
+
+#include "rpc_lz.h"
+#include <string.h>
+
+
+#define LZ_MIN_MATCH  3
+#define LZ_MAX_MATCH  (0x7F + LZ_MIN_MATCH)
+#define LZ_MAX_RUN    0x80
+#define LZ_HASH_BITS  8
+#define LZ_NO_POS     0xFFFF
+
+
+/* Shared dictionary.  Changing it breaks compatibility with peers built
+   from an older tree, so only ever append to it together with a new
+   capability bit. */
+static const uint8_t s_dict[] =
+    "{\"name\":\"\",\"value\":\"\",\"type\":\"\",\"id\":0,\"enabled\":true,\"false\",null}"
+    "\"config\":{\"status\":\"ok\",\"error\":\"warning\":\"info\":\"debug\":"
+    "\r\n    0000000000 timeout retry interval=";
+#define DICT_LEN (sizeof(s_dict) - 1)
+
+
+// Byte at a virtual position: dictionary first, then data
+static inline uint8_t vbyte(const uint8_t *data, size_t pos) {
+    return (pos < DICT_LEN) ? s_dict[pos] : data[pos - DICT_LEN];
+}
+
+
+static inline size_t hash3(const uint8_t *data, size_t pos) {
+    const uint32_t v = (uint32_t)vbyte(data, pos) |
+                       ((uint32_t)vbyte(data, pos + 1) << 8) |
+                       ((uint32_t)vbyte(data, pos + 2) << 16);
+    return (size_t)((v * 2654435761u) >> (32 - LZ_HASH_BITS));
+}
+
+
+// Emit data[start, end) (virtual positions) as literal runs
+static size_t emit_literals(const uint8_t *data, size_t start, size_t end,
+                            uint8_t *dst, size_t out, size_t cap) {
+    while (start < end) {
+        size_t run = end - start;
+        if (run > LZ_MAX_RUN) run = LZ_MAX_RUN;
+        if (out + 1 + run > cap) return 0;
+        dst[out++] = (uint8_t)(run - 1);
+        memcpy(&dst[out], &data[start - DICT_LEN], run);
+        out += run;
+        start += run;
+    }
+    return out;
+}
+
+
+size_t rpc_lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    if (!src || !dst || len == 0 || DICT_LEN + len >= LZ_NO_POS) {
+        return 0;
+    }
+
+    uint16_t table[1u << LZ_HASH_BITS];
+    memset(table, 0xFF, sizeof(table));
+    for (size_t p = 0; p + LZ_MIN_MATCH <= DICT_LEN; p++) {
+        table[hash3(src, p)] = (uint16_t)p;
+    }
+
+    const size_t end = DICT_LEN + len;
+    size_t p = DICT_LEN;
+    size_t lit = p;   // first byte not yet emitted
+    size_t out = 0;
+
+    while (p + LZ_MIN_MATCH <= end) {
+        const size_t h = hash3(src, p);
+        const size_t cand = table[h];
+        table[h] = (uint16_t)p;
+
+        size_t mlen = 0;
+        if (cand != LZ_NO_POS) {
+            while (p + mlen < end && mlen < LZ_MAX_MATCH &&
+                   vbyte(src, cand + mlen) == src[p + mlen - DICT_LEN]) {
+                mlen++;
+            }
+        }
+        if (mlen < LZ_MIN_MATCH) {
+            p++;
+            continue;
+        }
+
+        out = emit_literals(src, lit, p, dst, out, cap);
+        if ((lit < p && out == 0) || out + 3 > cap) return 0;
+        const size_t dist = p - cand;
+        dst[out++] = (uint8_t)(0x80 | (mlen - LZ_MIN_MATCH));
+        dst[out++] = (uint8_t)(dist & 0xFF);
+        dst[out++] = (uint8_t)((dist >> 8) & 0xFF);
+
+        // Index the positions inside the match too, for later matches
+        for (size_t q = p + 1; q < p + mlen && q + LZ_MIN_MATCH <= end; q++) {
+            table[hash3(src, q)] = (uint16_t)q;
+        }
+        p += mlen;
+        lit = p;
+    }
+
+    if (lit < end) {
+        out = emit_literals(src, lit, end, dst, out, cap);
+    }
+    return out;
+}
+
+
+int rpc_lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    if (!src || (!dst && cap > 0)) {
+        return -1;
+    }
+
+    size_t in = 0;
+    size_t out = 0;
+    while (in < len) {
+        const uint8_t tag = src[in++];
+        if (tag < 0x80) {
+            const size_t run = (size_t)tag + 1;
+            if (in + run > len || out + run > cap) return -1;
+            memcpy(&dst[out], &src[in], run);
+            in += run;
+            out += run;
+            continue;
+        }
+
+        if (in + 2 > len) return -1;
+        const size_t mlen = (size_t)(tag & 0x7F) + LZ_MIN_MATCH;
+        const size_t dist = (size_t)src[in] | ((size_t)src[in + 1] << 8);
+        in += 2;
+        if (dist == 0 || dist > DICT_LEN + out || out + mlen > cap) return -1;
+
+        // Byte by byte: the source may overlap the bytes being written
+        size_t from = DICT_LEN + out - dist;
+        for (size_t i = 0; i < mlen; i++, from++) {
+            dst[out++] = (from < DICT_LEN) ? s_dict[from] : dst[from - DICT_LEN];
+        }
+    }
+    return (int)out;
+}
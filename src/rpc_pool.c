@@ -0,0 +1,92 @@
+/* Fixed-size block pool.  Free blocks form a singly linked list threaded
+   through their first word; a spinlock critical section guards the list,
+   which makes alloc/free safe across both cores and from ISRs. */
+
+#include "rpc_pool.h"
+#include "rpc_config.h"
+#include <freertos/FreeRTOS.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// Free-list link stored in the first bytes of each free block
+typedef struct pool_block {
+    struct pool_block *next;
+} pool_block_t;
+
+
+// Block size rounded up so every block stays pointer aligned
+#define POOL_BLOCK_SIZE  ((CONFIG_RPC_POOL_BLOCK_SIZE + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+
+static uint8_t s_arena[CONFIG_RPC_POOL_BLOCK_COUNT][POOL_BLOCK_SIZE] __attribute__((aligned(sizeof(void *))));
+static pool_block_t *s_free_list = NULL;
+static size_t s_free_count = 0;
+static bool s_pool_ready = false;
+static portMUX_TYPE s_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+// True if ptr points into the static arena
+static inline bool in_arena(const void *ptr) {
+    const uint8_t *p = (const uint8_t *)ptr;
+    return p >= &s_arena[0][0] && p < &s_arena[0][0] + sizeof(s_arena);
+}
+
+
+void rpc_pool_init(void) {
+    portENTER_CRITICAL_SAFE(&s_pool_lock);
+    if (s_pool_ready) {
+        // Already set up by another layer; blocks may be in use
+        portEXIT_CRITICAL_SAFE(&s_pool_lock);
+        return;
+    }
+    s_pool_ready = true;
+    s_free_list = NULL;
+    for (size_t i = 0; i < CONFIG_RPC_POOL_BLOCK_COUNT; i++) {
+        pool_block_t *block = (pool_block_t *)s_arena[i];
+        block->next = s_free_list;
+        s_free_list = block;
+    }
+    s_free_count = CONFIG_RPC_POOL_BLOCK_COUNT;
+    portEXIT_CRITICAL_SAFE(&s_pool_lock);
+}
+
+
+void *rpc_pool_alloc(size_t size) {
+    if (size <= POOL_BLOCK_SIZE) {
+        portENTER_CRITICAL_SAFE(&s_pool_lock);
+        pool_block_t *block = s_free_list;
+        if (block) {
+            s_free_list = block->next;
+            s_free_count--;
+        }
+        portEXIT_CRITICAL_SAFE(&s_pool_lock);
+        if (block) {
+            return block;
+        }
+    }
+    // Oversize request or pool exhausted
+    return pvPortMalloc(size);
+}
+
+
+void rpc_pool_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    if (!in_arena(ptr)) {
+        vPortFree(ptr);
+        return;
+    }
+    pool_block_t *block = (pool_block_t *)ptr;
+    portENTER_CRITICAL_SAFE(&s_pool_lock);
+    block->next = s_free_list;
+    s_free_list = block;
+    s_free_count++;
+    portEXIT_CRITICAL_SAFE(&s_pool_lock);
+}
+
+
+size_t rpc_pool_available(void) {
+    return s_free_count;
+}
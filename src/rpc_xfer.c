@@ -0,0 +1,365 @@
+/* Bulk transfers (see rpc_xfer.h).  The receiving side is a small table
+   of sinks, each with one transfer slot guarded by its own mutex; the
+   sending side runs a window of async "__xfer_data" calls from the
+   caller's task, with completions coming back through a queue. */
+
+#include "rpc_xfer.h"
+#include "transport.h"
+#include "rpc_codec.h"
+#include "rpc_config.h"
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+
+// Bytes in front of the data of a chunk: [xfer_id LE16][offset LE32]
+#define XFER_DATA_HDR      6
+
+/* Request bytes around a chunk's data: the longest options envelope, the
+   compact request header with a wide ID and the function ID, and
+   XFER_DATA_HDR */
+#define XFER_DATA_OVERHEAD (RPC_OPTIONS_MAX_LEN + 3 + 2 + XFER_DATA_HDR)
+
+// Most request bytes one chunk may take here, after the link's own headers
+#define XFER_RX_LIMIT      (((CONFIG_RPC_RX_FRAME_SIZE < CONFIG_RPC_LINK_MAX_PAYLOAD) ? \
+                             CONFIG_RPC_RX_FRAME_SIZE : CONFIG_RPC_LINK_MAX_PAYLOAD) - LINK_PAYLOAD_HDR_MAX)
+#define XFER_CHUNK_MAX     (XFER_RX_LIMIT - XFER_DATA_OVERHEAD)
+
+
+// A registered sink and its transfer, if one is open
+typedef struct {
+    char                   name[CONFIG_RPC_MAX_NAME_LEN + 1];
+    uint8_t                name_len;
+    const rpc_xfer_sink_t *sink;
+    SemaphoreHandle_t      lock;     // serializes the sink callbacks
+    bool                   open;
+    uint8_t                gen;      // high byte of the transfer ID, bumped per open
+    uint32_t               total;
+    TickType_t             active;   // last open or chunk
+} xfer_slot_t;
+
+static xfer_slot_t s_sinks[CONFIG_RPC_XFER_MAX_SINKS];
+static size_t      s_sink_count = 0;
+
+
+// Sink slot of a transfer ID with its lock taken, or NULL if the transfer is not open
+static xfer_slot_t *lock_transfer(uint16_t xfer_id) {
+    const size_t idx = xfer_id & 0xFF;
+    if (idx >= s_sink_count) return NULL;
+    xfer_slot_t *slot = &s_sinks[idx];
+    xSemaphoreTake(slot->lock, portMAX_DELAY);
+    if (!slot->open || slot->gen != (uint8_t)(xfer_id >> 8)) {
+        xSemaphoreGive(slot->lock);
+        return NULL;
+    }
+    return slot;
+}
+
+
+// "__xfer_open": [total LE32][sink name] -> [xfer_id LE16][chunk_max LE16]
+static void xfer_open(const uint8_t *args, uint16_t args_len, rpc_writer_t *resp, uint8_t *error_code) {
+    if (args_len < 4) {
+        *error_code = ERR_INTERNAL;
+        return;
+    }
+    rpc_reader_t r;
+    uint32_t total = 0;
+    rpc_reader_init(&r, args, 4);
+    (void)rpc_get_u32(&r, &total);
+    const char   *name     = (const char *)&args[4];
+    const uint16_t name_len = (uint16_t)(args_len - 4);
+
+    xfer_slot_t *slot = NULL;
+    for (size_t i = 0; i < s_sink_count && !slot; i++) {
+        if (s_sinks[i].name_len == name_len && memcmp(s_sinks[i].name, name, name_len) == 0) {
+            slot = &s_sinks[i];
+        }
+    }
+    if (!slot) {
+        *error_code = RPC_XFER_ERR_NO_SINK;
+        return;
+    }
+
+    xSemaphoreTake(slot->lock, portMAX_DELAY);
+    const TickType_t now = xTaskGetTickCount();
+    if (slot->open) {
+        if (now - slot->active < pdMS_TO_TICKS(CONFIG_RPC_XFER_IDLE_MS)) {
+            xSemaphoreGive(slot->lock);
+            *error_code = ERR_BUSY;
+            return;
+        }
+        // the sender of the old transfer went away
+        if (slot->sink->close) (void)slot->sink->close(slot->sink->ctx, false);
+        slot->open = false;
+    }
+    const uint8_t err = slot->sink->open ? slot->sink->open(slot->sink->ctx, total) : 0;
+    if (err == 0) {
+        slot->open   = true;
+        slot->gen++;
+        slot->total  = total;
+        slot->active = now;
+    }
+    const uint16_t xfer_id = (uint16_t)((slot->gen << 8) | (uint16_t)(slot - s_sinks));
+    xSemaphoreGive(slot->lock);
+
+    if (err != 0) {
+        *error_code = err;
+        return;
+    }
+    rpc_put_u16(resp, xfer_id);
+    rpc_put_u16(resp, XFER_CHUNK_MAX);
+}
+
+
+// "__xfer_data": [xfer_id LE16][offset LE32][bytes...]
+static void xfer_data(const uint8_t *args, uint16_t args_len, rpc_writer_t *resp, uint8_t *error_code) {
+    (void)resp;
+    rpc_reader_t r;
+    uint16_t xfer_id = 0;
+    uint32_t offset  = 0;
+    rpc_reader_init(&r, args, args_len);
+    (void)rpc_get_u16(&r, &xfer_id);
+    (void)rpc_get_u32(&r, &offset);
+    if (r.error) {
+        *error_code = ERR_INTERNAL;
+        return;
+    }
+    const uint16_t len = (uint16_t)(args_len - XFER_DATA_HDR);
+
+    xfer_slot_t *slot = lock_transfer(xfer_id);
+    if (!slot) {
+        *error_code = RPC_XFER_ERR_STALE;
+        return;
+    }
+    if (offset > slot->total || len > slot->total - offset) {
+        *error_code = RPC_XFER_ERR_RANGE;
+    } else {
+        *error_code  = slot->sink->write(slot->sink->ctx, offset, &args[XFER_DATA_HDR], len);
+        slot->active = xTaskGetTickCount();
+    }
+    xSemaphoreGive(slot->lock);
+}
+
+
+// "__xfer_close": [xfer_id LE16][complete u8]
+static void xfer_close(const uint8_t *args, uint16_t args_len, rpc_writer_t *resp, uint8_t *error_code) {
+    (void)resp;
+    rpc_reader_t r;
+    uint16_t xfer_id  = 0;
+    uint8_t  complete = 0;
+    rpc_reader_init(&r, args, args_len);
+    (void)rpc_get_u16(&r, &xfer_id);
+    (void)rpc_get_u8(&r, &complete);
+    if (!rpc_reader_done(&r)) {
+        *error_code = ERR_INTERNAL;
+        return;
+    }
+
+    xfer_slot_t *slot = lock_transfer(xfer_id);
+    if (!slot) {
+        *error_code = RPC_XFER_ERR_STALE;
+        return;
+    }
+    *error_code = slot->sink->close ? slot->sink->close(slot->sink->ctx, complete != 0) : 0;
+    slot->open  = false;
+    xSemaphoreGive(slot->lock);
+}
+
+
+int rpc_xfer_register_sink(const char *name, const rpc_xfer_sink_t *sink) {
+    if (!name || !sink || !sink->write) return -1;
+    const size_t nlen = strlen(name);
+    if (nlen == 0 || nlen > CONFIG_RPC_MAX_NAME_LEN) return -1;
+    if (s_sink_count >= CONFIG_RPC_XFER_MAX_SINKS) return -2;
+
+    if (s_sink_count == 0) {
+        int rc = transport_register_handler(RPC_XFER_OPEN_FUNCTION, xfer_open, RPC_FLAG_DEFERRED);
+        if (rc == 0) rc = transport_register_handler(RPC_XFER_DATA_FUNCTION, xfer_data, RPC_FLAG_DEFERRED);
+        if (rc == 0) rc = transport_register_handler(RPC_XFER_CLOSE_FUNCTION, xfer_close, RPC_FLAG_DEFERRED);
+        if (rc != 0) return rc;
+    }
+
+    xfer_slot_t *slot = &s_sinks[s_sink_count];
+    memset(slot, 0, sizeof(*slot));
+    slot->lock = xSemaphoreCreateMutex();
+    if (!slot->lock) return -2;
+    memcpy(slot->name, name, nlen);
+    slot->name_len = (uint8_t)nlen;
+    slot->sink = sink;
+    s_sink_count++;  // publishes the slot
+    return 0;
+}
+
+
+// Sender state of one chunk in the window
+enum { CHUNK_FREE, CHUNK_SENT, CHUNK_RETRY };
+
+typedef struct {
+    QueueHandle_t done;    // where its completion goes
+    uint32_t      offset;
+    uint16_t      len;
+    uint8_t       tries;   // resends so far
+    uint8_t       state;
+} xfer_chunk_t;
+
+// Completion of a chunk, queued by its callback
+typedef struct {
+    xfer_chunk_t *chunk;
+    int           status;
+    uint8_t       error;
+} xfer_done_t;
+
+
+// Async completion of a chunk (RX or timer task): hand it to the sender
+static void chunk_done(int status, uint8_t error_code, const uint8_t *data, uint16_t len, void *ctx) {
+    (void)data;
+    (void)len;
+    xfer_chunk_t *chunk = (xfer_chunk_t *)ctx;
+    const xfer_done_t done = { chunk, status, error_code };
+    (void)xQueueSend(chunk->done, &done, 0);  // holds one entry per chunk in flight
+}
+
+
+/* Stream the chunks of an open transfer, keeping up to
+   CONFIG_RPC_XFER_WINDOW in flight.  buf has room for a chunk with its
+   header, whose ID bytes are already set.  Returns 0 with *error_code
+   set on a remote error, negative on a local one. */
+static int xfer_stream(const transport_call_opts_t *opts, uint16_t data_id, uint16_t chunk_max,
+                       uint32_t total, rpc_xfer_read_t read, void *ctx, uint8_t *buf,
+                       QueueHandle_t done, uint8_t *error_code, uint32_t timeout_ms) {
+    xfer_chunk_t chunks[CONFIG_RPC_XFER_WINDOW];
+    memset(chunks, 0, sizeof(chunks));
+    for (size_t i = 0; i < CONFIG_RPC_XFER_WINDOW; i++) chunks[i].done = done;
+
+    uint32_t next = 0;
+    size_t   in_flight = 0;
+    int      rc = 0;
+    for (;;) {
+        // Fill the window: resends first come as they were left, then new chunks
+        for (size_t i = 0; i < CONFIG_RPC_XFER_WINDOW && rc == 0 && *error_code == 0; i++) {
+            xfer_chunk_t *chunk = &chunks[i];
+            if (chunk->state == CHUNK_SENT || (chunk->state == CHUNK_FREE && next >= total)) continue;
+            if (chunk->state == CHUNK_FREE) {
+                chunk->offset = next;
+                chunk->len    = (uint16_t)((total - next < chunk_max) ? total - next : chunk_max);
+                chunk->tries  = 0;
+                next += chunk->len;
+            }
+
+            for (int b = 0; b < 4; b++) buf[2 + b] = (uint8_t)(chunk->offset >> (8 * b));
+            if (read(ctx, chunk->offset, buf + XFER_DATA_HDR, chunk->len) != 0) {
+                rc = -14;
+                break;
+            }
+            const int id = transport_call_id_async_opt(opts, data_id, buf, (uint16_t)(XFER_DATA_HDR + chunk->len),
+                                                       chunk_done, chunk, timeout_ms);
+            if (id < 0) {
+                // no pending slot, or the link refused: try again once a chunk is back
+                chunk->state = CHUNK_RETRY;
+                if (++chunk->tries > CONFIG_RPC_XFER_RETRIES) rc = id;
+                break;
+            }
+            chunk->state = CHUNK_SENT;
+            in_flight++;
+        }
+
+        if (in_flight == 0) {
+            bool pending = false;
+            for (size_t i = 0; i < CONFIG_RPC_XFER_WINDOW; i++) pending |= (chunks[i].state != CHUNK_FREE);
+            if (rc != 0 || *error_code != 0 || (!pending && next >= total)) return rc;
+            vTaskDelay(1);
+            continue;
+        }
+
+        xfer_done_t d;
+        if (xQueueReceive(done, &d, portMAX_DELAY) != pdTRUE) continue;
+        in_flight--;
+        xfer_chunk_t *chunk = d.chunk;
+        if (d.status == 0 && d.error == 0) {
+            chunk->state = CHUNK_FREE;
+            continue;
+        }
+        const bool again = (d.status == -7) || (d.status == 0 && d.error == ERR_BUSY);
+        if (again && chunk->tries < CONFIG_RPC_XFER_RETRIES) {
+            chunk->tries++;
+            chunk->state = CHUNK_RETRY;
+            if (d.error == ERR_BUSY) vTaskDelay(1);  // let the receiver's workers catch up
+            continue;
+        }
+        chunk->state = CHUNK_FREE;
+        if (rc == 0 && *error_code == 0) {
+            if (d.status != 0) rc = d.status;
+            else               *error_code = d.error;
+        }
+    }
+}
+
+
+int rpc_xfer_send(rpc_link_t *link, const char *name, uint32_t total,
+                  rpc_xfer_read_t read, void *ctx, uint8_t *error_code, uint32_t timeout_ms) {
+    if (!name || !read || !error_code) return -1;
+    const size_t nlen = strlen(name);
+    if (nlen == 0 || nlen > CONFIG_RPC_MAX_NAME_LEN) return -1;
+    *error_code = 0;
+
+    uint16_t data_id = 0;
+    int rc = transport_resolve_on(link, RPC_XFER_DATA_FUNCTION, &data_id, timeout_ms);
+    if (rc != 0) return rc;
+
+    // Open: [total LE32][name] -> [xfer_id LE16][chunk_max LE16]
+    uint8_t open_args[4 + CONFIG_RPC_MAX_NAME_LEN];
+    for (int b = 0; b < 4; b++) open_args[b] = (uint8_t)(total >> (8 * b));
+    memcpy(&open_args[4], name, nlen);
+    uint8_t  resp[4];
+    uint16_t resp_len = 0;
+    rc = transport_call_into_on(link, RPC_XFER_OPEN_FUNCTION, open_args, (uint16_t)(4 + nlen),
+                                resp, sizeof(resp), &resp_len, error_code, timeout_ms);
+    if (rc == 0 && *error_code == ERR_FUNC_NOT_FOUND) return -9;
+    if (rc != 0 || *error_code != 0) return rc;
+    if (resp_len != sizeof(resp)) return -10;
+    const uint16_t xfer_id   = (uint16_t)(resp[0] | (resp[1] << 8));
+    const uint16_t chunk_max = (uint16_t)(resp[2] | (resp[3] << 8));
+    if (chunk_max == 0) return -10;
+
+    uint8_t      *buf  = (uint8_t *)pvPortMalloc(XFER_DATA_HDR + chunk_max);
+    QueueHandle_t done = xQueueCreate(CONFIG_RPC_XFER_WINDOW, sizeof(xfer_done_t));
+    if (buf && done) {
+        const transport_call_opts_t opts = { .link = link, .priority = RPC_PRIO_BULK };
+        buf[0] = (uint8_t)(xfer_id & 0xFF);
+        buf[1] = (uint8_t)(xfer_id >> 8);
+        rc = xfer_stream(&opts, data_id, chunk_max, total, read, ctx, buf, done, error_code, timeout_ms);
+    } else {
+        rc = -8;
+    }
+    vPortFree(buf);
+    if (done) vQueueDelete(done);
+
+    // Close, and abort on failure so the sink is free at once
+    const bool    complete     = (rc == 0 && *error_code == 0);
+    const uint8_t close_args[3] = { (uint8_t)(xfer_id & 0xFF), (uint8_t)(xfer_id >> 8), complete };
+    uint8_t  close_err = 0;
+    uint16_t close_len = 0;
+    const int close_rc = transport_call_into_on(link, RPC_XFER_CLOSE_FUNCTION, close_args, sizeof(close_args),
+                                                NULL, 0, &close_len, &close_err, timeout_ms);
+    if (complete) {
+        rc = close_rc;
+        *error_code = close_err;
+    }
+    return rc;
+}
+
+
+// Source reading from a buffer in memory
+static int read_buffer(void *ctx, uint32_t offset, uint8_t *buf, uint16_t len) {
+    memcpy(buf, (const uint8_t *)ctx + offset, len);
+    return 0;
+}
+
+
+int rpc_xfer_send_buffer(rpc_link_t *link, const char *name, const uint8_t *data, uint32_t len,
+                         uint8_t *error_code, uint32_t timeout_ms) {
+    if (!data && len > 0) return -1;
+    return rpc_xfer_send(link, name, len, read_buffer, (void *)data, error_code, timeout_ms);
+}
@@ -1,311 +1,2093 @@
 /* Implements the transport layer for RPC on top of the link layer.
    It builds request/response/error messages, dispatches incoming
-   requests to registered callbacks, and provides a synchronous call API.
+   requests to registered callbacks (inline in the RX task or through a
+   pool of worker tasks), and provides synchronous and async call APIs.
 
    Request  : [type=0x0B][counter][name ASCIIZ][args...]
    Stream   : [type=0x0C][counter][name ASCIIZ][args...]
+   RequestId: [type=0x0D][counter][func_id LE16][args...]
+   Batch    : [type=0x2C][count]([len LE16][message])...
    Response : [type=0x16][counter][data...]
-   Error    : [type=0x21][counter][error_code] */
+   Error    : [type=0x21][counter][error_code]
+   Cancel   : [type=0x18][counter][counter...]
+
+   With MSG_FLAG_WIDE_ID set in the type byte, counter is a 16-bit
+   little-endian request ID; replies mirror the width of the request.
+   With MSG_FLAG_COMPRESSED, args/data are [raw_len LE16][rpc_lz stream]. */
 
 #include "transport.h"
 #include "link_layer.h"
+#include "rpc_config.h"
+#include "rpc_pool.h"
+#include "rpc_lz.h"
+#include "rpc_cache.h"
+#include "rpc_stats.h"
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
+#include <freertos/timers.h>
 #include <string.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 // Maximum number of functions that can be registered
-#define MAX_FUNCTIONS 8
+#define MAX_FUNCTIONS   CONFIG_RPC_MAX_FUNCTIONS
+
+// Open-addressing table slots; twice the capacity keeps probe chains short
+#define REGISTRY_SLOTS  (2 * MAX_FUNCTIONS)
 
 
-// Function registry entry
+/* Function registry entry.  The name is stored inline with its hash and
+   length, so a lookup costs one hash pass over the incoming name and a
+   single memcmp on a hit. */
 typedef struct {
-    char *name;
-    rpc_callback_t callback;
+    rpc_callback_t callback;                 // heap-response callback, or
+    rpc_handler_t  handler;                  // writer handler; both NULL marks an empty slot
+    uint32_t hash;                           // FNV-1a of name
+    uint8_t  name_len;
+    uint8_t  flags;                          // RPC_FLAG_* dispatch flags
+    uint32_t cache_ttl_ms;                   // responses cached this long, 0: not cached
+    char     name[CONFIG_RPC_MAX_NAME_LEN + 1];
+    struct { RPC_FUNC_STATS_FIELDS(RPC_STAT_FIELD_) } stats;
 } rpc_entry_t;
 
 
-// Function registry storage
-static rpc_entry_t function_registry[MAX_FUNCTIONS];
+// Deferred request handed from the RX task to a worker
+typedef struct {
+    struct rpc_peer *peer;   // the link the request came in on
+    rpc_entry_t *entry;
+    uint16_t     id;         // request ID to answer
+    uint8_t      mflags;     // MSG_FLAG_* bits of the request
+    bool         reply;      // false for stream messages
+    atomic_bool  cancelled;  // set by the RX task on a MSG_TYPE_CANCEL
+    int64_t      expires_us; // caller stops waiting then (esp_timer_get_time()); 0: never
+    uint16_t     args_len;
+    uint8_t      args[];     // copied out of the RX buffer
+} rpc_job_t;
+
+
+// Replies collected while the RX task works through an incoming batch
+typedef struct {
+    uint8_t  *buf;           // ([len LE16][message])... without the batch header
+    uint16_t  cap;
+    uint16_t  len;
+    uint8_t   count;
+} reply_batch_t;
+
+
+// True if a registry slot holds a function
+static inline bool entry_used(const rpc_entry_t *entry) {
+    return entry->callback || entry->handler;
+}
+
+// Function registry storage (hash table, linear probing)
+static rpc_entry_t function_registry[REGISTRY_SLOTS];
 static size_t registry_count = 0;
 
-// Single outstanding call state
-static uint8_t current_counter = 0;          // last issued counter value
-static QueueHandle_t pending_queue = NULL;   // queue delivering a single response pointer
-static SemaphoreHandle_t pending_mutex;      // protects pending_queue and current_counter
+// Maximum number of calls that may be outstanding at the same time
+#define MAX_PENDING_CALLS CONFIG_RPC_MAX_PENDING_CALLS
+
+// Period of the timer that expires asynchronous calls
+#define ASYNC_SWEEP_MS    10
+
+// Replies up to this many bytes go out on the link's urgent TX lane
+#define URGENT_MESSAGE_MAX 16
+
+/* The priority a request came with travels to its reply in the low bits
+   of mflags, which no MSG_FLAG_* uses */
+#define MFLAG_PRIO_MASK   0x03
+
+
+/* Pending call slot: one per outstanding call.  Synchronous callers wait
+   on the slot's done semaphore, which lives as long as the table; the RX
+   task fills in the result fields (or the caller's into buffer) before
+   giving it.  Asynchronous callers get callback instead. */
+typedef struct {
+    bool                 in_use;
+    bool                 completed; // result fields below are valid
+    bool                 wide;      // request went out with a 16-bit ID
+    uint16_t             id;        // request ID the matching response/error carries
+    SemaphoreHandle_t    done;      // given once the result is in place
+    int                  status;    // 0, or -8 if the response could not be stored
+    uint8_t              error;     // remote error code
+    uint8_t             *response;  // heap copy handed over to the caller
+    bool                 use_into;  // response goes to into, not a heap copy
+    uint8_t             *into;      // caller's buffer (transport_call_into())
+    uint16_t             into_cap;
+    uint16_t             resp_len;  // full response length, even when truncated
+    transport_async_cb_t callback;  // completion callback for async calls
+    void                *cb_ctx;    // user pointer passed to callback
+    TickType_t           deadline;  // tick at which an async call times out
+} pending_slot_t;
+
+
+// Features this side offers through "__caps"; expanding compressed
+// payloads is always supported, even with CONFIG_RPC_COMPRESS_MIN = 0,
+// and so are options envelopes and cancels
+#define RPC_LOCAL_CAPS (RPC_CAP_COMPRESS | RPC_CAP_OPTIONS | RPC_CAP_CANCEL)
+
+// Width of the request IDs this side sends (replies mirror the request)
+#if CONFIG_RPC_NARROW_REQUEST_ID
+#define CLIENT_WIDE_IDS false
+#else
+#define CLIENT_WIDE_IDS true
+#endif
+
+static atomic_uint next_request_id = 0;      // source of request IDs, shared by all peers
+
+/* Per-link state: everything that belongs to one peer.  The registry,
+   the workers and the statistics are shared by all links. */
+typedef struct rpc_peer {
+    rpc_link_t       *link;
+    pending_slot_t    pending_table[MAX_PENDING_CALLS];  // keyed by the request ID
+    SemaphoreHandle_t pending_mutex;         // protects pending_table
+    TimerHandle_t     async_timer;           // expires async calls past their deadline
+    bool              async_timer_on;        // started and not stopped since (pending_mutex)
+
+    // Capabilities the peer reported through "__caps" (RPC_CAP_* bits)
+    uint8_t caps;
+
+    // Response buffer for handlers run in the link's RX task (allocated by it)
+    uint8_t *rx_resp_buf;
+
+    // Stream messages: sender sequence and receiver gap tracking
+    portMUX_TYPE stream_lock;
+    uint8_t  stream_tx_seq;                  // counter of the next stream message sent
+    uint8_t  stream_rx_expected;             // counter the next stream message should carry
+    bool     stream_rx_synced;               // false until the first stream message arrives
+    uint32_t stream_rx_count;
+    uint32_t stream_rx_lost;
+} rpc_peer_t;
+
+// State of the default link, which the functions without a link argument use
+static rpc_peer_t default_peer;
+
+// Makes claiming a link in transport_attach() one step, and protects s_default_reserved
+static portMUX_TYPE s_attach_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool         s_default_reserved = false;  // default_peer is taken by an attach
+
+// Counters behind transport_get_stats()
+static struct { TRANSPORT_STATS_FIELDS(RPC_STAT_FIELD_) } s_stats;
+
+/* Requests waiting for a worker task, one queue per RPC_PRIO_*, and the
+   number queued in all of them (NULL when all handlers run inline) */
+static QueueHandle_t     dispatch_queue[RPC_PRIO_BULK + 1];
+static SemaphoreHandle_t dispatch_jobs = NULL;
+
+/* Requests handed to the workers and not finished yet, where a
+   MSG_TYPE_CANCEL finds them: at most every queue full and one running
+   per worker */
+#define MAX_JOBS ((RPC_PRIO_BULK + 1) * CONFIG_RPC_WORKER_QUEUE_LEN + CONFIG_RPC_WORKER_COUNT)
+static rpc_job_t   *s_jobs[MAX_JOBS];
+static portMUX_TYPE s_jobs_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// A worker task and the job it runs, for transport_cancelled()
+typedef struct {
+    TaskHandle_t     task;
+    const rpc_job_t *volatile job;
+} worker_slot_t;
+
+#define WORKER_SLOTS ((CONFIG_RPC_WORKER_COUNT > 0) ? CONFIG_RPC_WORKER_COUNT : 1)
+static worker_slot_t s_workers[WORKER_SLOTS];
 
-// RX task prototype
+// RX task, worker task and timer prototypes
 static void transport_receiver_task(void *arg);
+static void transport_worker_task(void *arg);
+static void async_sweep(TimerHandle_t timer);
+static void rpc_resolve(const uint8_t *args, uint16_t args_len,
+                        rpc_writer_t *resp, uint8_t *error_code);
+static void rpc_caps(const uint8_t *args, uint16_t args_len,
+                     rpc_writer_t *resp, uint8_t *error_code);
+#if CONFIG_RPC_STATS
+static void rpc_stats_query(const uint8_t *args, uint16_t args_len,
+                            rpc_writer_t *resp, uint8_t *error_code);
+#endif
 
 
-// Initialize transport: create mutex and spawn the RX task
+// Peer state of link, or NULL if it is not attached (NULL link: the default one)
+static rpc_peer_t *peer_of(rpc_link_t *link) {
+    return (rpc_peer_t *)rpc_link_get_context(link ? link : rpc_link_default());
+}
+
+
+/* Initialize transport: the built-in functions and the handler workers,
+   shared by all links, then the default link */
 void transport_init(void) {
-    pending_mutex = xSemaphoreCreateMutex();
-    (void)xTaskCreate(transport_receiver_task, "rpc_rx", 4096, NULL, 10, NULL);
+    rpc_pool_init();
+    rpc_cache_init();
+
+    // Built-in functions
+    (void)transport_register_handler(RPC_RESOLVE_FUNCTION, rpc_resolve, RPC_FLAG_INLINE);
+    (void)transport_register_handler(RPC_CAPS_FUNCTION, rpc_caps, RPC_FLAG_INLINE);
+#if CONFIG_RPC_STATS
+    (void)transport_register_handler(RPC_STATS_FUNCTION, rpc_stats_query, RPC_FLAG_INLINE);
+#endif
+
+#if CONFIG_RPC_WORKER_COUNT > 0
+    bool queues = true;
+    for (size_t p = 0; p <= RPC_PRIO_BULK; p++) {
+        dispatch_queue[p] = xQueueCreate(CONFIG_RPC_WORKER_QUEUE_LEN, sizeof(rpc_job_t *));
+        queues = queues && dispatch_queue[p];
+    }
+    if (queues) {
+        dispatch_jobs = xSemaphoreCreateCounting((RPC_PRIO_BULK + 1) * CONFIG_RPC_WORKER_QUEUE_LEN, 0);
+    }
+    const BaseType_t core = (CONFIG_RPC_WORKER_CORE < 0) ? tskNO_AFFINITY : CONFIG_RPC_WORKER_CORE;
+    for (int i = 0; i < CONFIG_RPC_WORKER_COUNT && dispatch_jobs; i++) {
+        (void)xTaskCreatePinnedToCore(transport_worker_task, "rpc_wk",
+                                      CONFIG_RPC_WORKER_STACK_SIZE, &s_workers[i],
+                                      CONFIG_RPC_WORKER_PRIORITY, NULL, core);
+    }
+#endif
+    (void)transport_attach(rpc_link_default());
 }
 
 
-// Register a function by name; copies name and stores callback
-int transport_register_function(const char *name, rpc_callback_t callback) {
-    if (!name || !callback) return -1;
-    if (registry_count >= MAX_FUNCTIONS) return -2;
+// Delete what transport_attach() created for peer, and free it
+static void peer_free(rpc_peer_t *peer) {
+    if (peer->async_timer) (void)xTimerDelete(peer->async_timer, portMAX_DELAY);
+    if (peer->pending_mutex) vSemaphoreDelete(peer->pending_mutex);
+    for (size_t i = 0; i < MAX_PENDING_CALLS; i++) {
+        if (peer->pending_table[i].done) vSemaphoreDelete(peer->pending_table[i].done);
+    }
+    if (peer != &default_peer) vPortFree(peer);
+}
 
-    size_t nlen = strlen(name);
-    char *copy = (char *)pvPortMalloc(nlen + 1);
-    if (!copy) return -3;
 
-    memcpy(copy, name, nlen);
-    copy[nlen] = '\0';
+/* Serve a link: create its pending table, mutex and async timeout
+   timer and its RX task, then claim the link.  The peer is published
+   only once it is complete, so peer_of() never returns one that is
+   being built, and nothing is taken back after it is published.  The
+   RX task waits for the outcome of the claim; if another caller won,
+   it frees its own peer and ends.  Two callers of the default link
+   would share default_peer, so that one is reserved up front. */
+int transport_attach(rpc_link_t *link) {
+    if (!link) return -1;
+    if (rpc_link_get_context(link)) return 0;  // already attached
+
+    const bool is_default = (link == rpc_link_default());
+    if (is_default) {
+        portENTER_CRITICAL(&s_attach_lock);
+        const bool taken = s_default_reserved;
+        s_default_reserved = true;
+        portEXIT_CRITICAL(&s_attach_lock);
+        if (taken) return rpc_link_get_context(link) ? 0 : -3;  // -3: still being set up
+    }
+    rpc_peer_t *peer = is_default ? &default_peer : (rpc_peer_t *)pvPortMalloc(sizeof(rpc_peer_t));
+    if (!peer) return -8;
+
+    memset(peer, 0, sizeof(*peer));
+    peer->link = link;
+    portMUX_INITIALIZE(&peer->stream_lock);
+
+    bool ok = (peer->pending_mutex = xSemaphoreCreateMutex()) != NULL;
+    for (size_t i = 0; i < MAX_PENDING_CALLS; i++) {
+        ok = (peer->pending_table[i].done = xSemaphoreCreateBinary()) != NULL && ok;
+    }
+    peer->async_timer = xTimerCreate("rpc_tmo", pdMS_TO_TICKS(ASYNC_SWEEP_MS), pdTRUE, peer, async_sweep);
+    TaskHandle_t rx_task = NULL;
+    ok = ok && peer->async_timer &&
+         xTaskCreate(transport_receiver_task, "rpc_rx", 4096, peer, 10, &rx_task) == pdPASS;
+    if (!ok) {
+        peer_free(peer);
+        portENTER_CRITICAL(&s_attach_lock);
+        if (is_default) s_default_reserved = false;
+        portEXIT_CRITICAL(&s_attach_lock);
+        return -2;
+    }
 
-    function_registry[registry_count].name = copy;
-    function_registry[registry_count].callback = callback;
-    registry_count++;
+    // Claimed under the lock, so two callers never both serve the link
+    portENTER_CRITICAL(&s_attach_lock);
+    const bool claimed = (rpc_link_get_context(link) == NULL);
+    if (claimed) rpc_link_set_context(link, peer);
+    portEXIT_CRITICAL(&s_attach_lock);
+    (void)xTaskNotifyGive(rx_task);  // the task frees the peer if the claim was lost
     return 0;
 }
 
 
-// Find a registered function by (name, length) pair
-static rpc_entry_t *find_function(const char *name, uint8_t name_len) {
-    for (size_t i = 0; i < registry_count; i++) {
-        if (strlen(function_registry[i].name) == name_len &&
-            strncmp(function_registry[i].name, name, name_len) == 0) {
-            return &function_registry[i];
+// FNV-1a hash step; the RX task folds it into its scan for the name terminator
+#define NAME_HASH_INIT 2166136261u
+static inline uint32_t name_hash_step(uint32_t hash, uint8_t c) {
+    return (hash ^ c) * 16777619u;
+}
+
+
+static uint32_t name_hash(const char *name, size_t name_len) {
+    uint32_t hash = NAME_HASH_INIT;
+    for (size_t i = 0; i < name_len; i++) {
+        hash = name_hash_step(hash, (uint8_t)name[i]);
+    }
+    return hash;
+}
+
+
+/* Probe for name: returns its entry, or the empty slot where it would go
+   (NULL if the table has neither). */
+static rpc_entry_t *probe_registry(const char *name, uint8_t name_len, uint32_t hash) {
+    size_t idx = hash % REGISTRY_SLOTS;
+    for (size_t n = 0; n < REGISTRY_SLOTS; n++) {
+        rpc_entry_t *entry = &function_registry[idx];
+        if (!entry_used(entry)) {
+            return entry;
+        }
+        if (entry->hash == hash && entry->name_len == name_len &&
+            memcmp(entry->name, name, name_len) == 0) {
+            return entry;
         }
+        if (++idx == REGISTRY_SLOTS) idx = 0;
     }
     return NULL;
 }
 
 
-// Perform a synchronous RPC call.
-// Builds a request, sends it via link layer, then waits for a response/error.
-int transport_call(const char *name, const uint8_t *args, uint16_t args_len,
-                   uint8_t **response, uint16_t *resp_len,
-                   uint8_t *error_code, uint32_t timeout_ms)
-{
-    if (!name || !response || !resp_len || !error_code) return -1;
+/* Register a function by name; copies name and stores the callback (or
+   handler) and flags.  Registering an existing name replaces them.
+   Functions should be registered before peers start calling them. */
+static int register_entry(const char *name, rpc_callback_t callback, rpc_handler_t handler,
+                          uint8_t flags) {
+    if (!name || (!callback && !handler)) return -1;
+
+    size_t nlen = strlen(name);
+    if (nlen > CONFIG_RPC_MAX_NAME_LEN) return -4;
+
+    uint32_t hash = name_hash(name, nlen);
+    rpc_entry_t *entry = probe_registry(name, (uint8_t)nlen, hash);
+    if (!entry) return -2;
+
+    if (!entry_used(entry)) {
+        if (registry_count >= MAX_FUNCTIONS) return -2;
+        memcpy(entry->name, name, nlen);
+        entry->name[nlen] = '\0';
+        entry->name_len = (uint8_t)nlen;
+        entry->hash = hash;
+        registry_count++;
+    } else {
+        rpc_cache_drop(entry);  // the new callback may answer differently
+    }
+    entry->flags = flags;
+    entry->cache_ttl_ms = (CONFIG_RPC_CACHE_ENTRIES > 0 && (flags & RPC_FLAG_CACHEABLE)) ? CONFIG_RPC_CACHE_TTL_MS : 0;
+    // written last: a non-NULL pointer publishes the entry; run_handler() prefers handler
+    entry->handler  = handler;
+    entry->callback = callback;
+    return 0;
+}
+
+
+int transport_register_function_ex(const char *name, rpc_callback_t callback, uint8_t flags) {
+    return register_entry(name, callback, NULL, flags);
+}
+
+
+int transport_register_handler(const char *name, rpc_handler_t handler, uint8_t flags) {
+    return register_entry(name, NULL, handler, flags);
+}
+
+
+// Register a function with default (deferred) dispatch
+int transport_register_function(const char *name, rpc_callback_t callback) {
+    return transport_register_function_ex(name, callback, RPC_FLAG_DEFERRED);
+}
+
+
+// Find a registered function by (name, length) pair and its precomputed hash
+static rpc_entry_t *find_function(const char *name, uint8_t name_len, uint32_t hash) {
+    rpc_entry_t *entry = probe_registry(name, name_len, hash);
+    return (entry && entry_used(entry)) ? entry : NULL;
+}
+
+
+// Registered entry of a C string name, or NULL
+static rpc_entry_t *find_registered(const char *name) {
+    const size_t nlen = strlen(name);
+    if (nlen > CONFIG_RPC_MAX_NAME_LEN) return NULL;
+    return find_function(name, (uint8_t)nlen, name_hash(name, nlen));
+}
+
+
+int transport_set_cache_ttl(const char *name, uint32_t ttl_ms) {
+    if (!name || CONFIG_RPC_CACHE_ENTRIES == 0) return -1;
+    rpc_entry_t *entry = find_registered(name);
+    if (!entry) return -9;
+
+    entry->cache_ttl_ms = ttl_ms;
+    rpc_cache_drop(entry);
+    return 0;
+}
+
+
+void transport_cache_invalidate(const char *name) {
+    rpc_entry_t *entry = name ? find_registered(name) : NULL;
+    if (!name || entry) rpc_cache_drop(entry);
+}
+
 
-    // Ensure only one outstanding call is active
-    if (xSemaphoreTake(pending_mutex, portMAX_DELAY) != pdTRUE) return -2;
-    if (pending_queue != NULL) {
-        xSemaphoreGive(pending_mutex);
-        return -3; // another call is pending
+/* Write a message header [type][id] to p: one ID byte for classic
+   messages, two (little-endian) with MSG_FLAG_WIDE_ID.  Returns its length. */
+static size_t put_header(uint8_t *p, uint8_t type, uint16_t id, bool wide) {
+    if (!wide) {
+        p[0] = type;
+        p[1] = (uint8_t)id;
+        return 2;
+    }
+    p[0] = (uint8_t)(type | MSG_FLAG_WIDE_ID);
+    p[1] = (uint8_t)(id & 0xFF);
+    p[2] = (uint8_t)((id >> 8) & 0xFF);
+    return 3;
+}
+
+
+/* Parse a message header.  Returns its length (2 or 3), or 0 if msg is
+   too short; type comes back without the MSG_FLAG_* bits, which are
+   returned in mflags. */
+static uint16_t get_header(const uint8_t *msg, uint16_t len,
+                           uint8_t *type, uint16_t *id, uint8_t *mflags) {
+    *mflags = (uint8_t)(msg[0] & MSG_FLAGS_MASK);
+    *type   = (uint8_t)(msg[0] & ~MSG_FLAGS_MASK);
+    if (!(*mflags & MSG_FLAG_WIDE_ID)) {
+        if (len < 2) return 0;
+        *id = msg[1];
+        return 2;
+    }
+    if (len < 3) return 0;
+    *id = (uint16_t)msg[1] | ((uint16_t)msg[2] << 8);
+    return 3;
+}
+
+
+/* Compress a payload into a pool block as [raw_len LE16][rpc_lz stream].
+   Returns the block (rpc_pool_free it) with its length in *out_len, or
+   NULL if the payload is below CONFIG_RPC_COMPRESS_MIN or would not
+   shrink. */
+static uint8_t *compress_payload(const uint8_t *data, uint16_t len, uint16_t *out_len) {
+#if CONFIG_RPC_COMPRESS_MIN > 0
+    if (!data || len < CONFIG_RPC_COMPRESS_MIN || len <= 3) return NULL;
+
+    uint8_t *buf = (uint8_t *)rpc_pool_alloc(len);
+    if (!buf) return NULL;
+
+    // Worth it only if the result, length prefix included, is shorter
+    const size_t n = rpc_lz_compress(data, len, buf + 2, (size_t)len - 3);
+    if (n == 0) {
+        rpc_pool_free(buf);
+        return NULL;
+    }
+    buf[0] = (uint8_t)(len & 0xFF);
+    buf[1] = (uint8_t)((len >> 8) & 0xFF);
+    *out_len = (uint16_t)(n + 2);
+    return buf;
+#else
+    (void)data;
+    (void)len;
+    (void)out_len;
+    return NULL;
+#endif
+}
+
+
+/* Expand a compressed payload into a pool block.  Returns the block
+   (rpc_pool_free it) with its length in *out_len, or NULL with *err set:
+   ERR_TOO_LARGE if it expands past CONFIG_RPC_RX_FRAME_SIZE, ERR_INTERNAL
+   if it is corrupt or no memory is left. */
+static uint8_t *expand_payload(const uint8_t *data, uint16_t len,
+                               uint16_t *out_len, uint8_t *err) {
+    if (!data || len < 2) {
+        *err = ERR_INTERNAL;
+        return NULL;
+    }
+    const size_t raw_len = (size_t)data[0] | ((size_t)data[1] << 8);
+    if (raw_len > CONFIG_RPC_RX_FRAME_SIZE) {
+        *err = ERR_TOO_LARGE;
+        return NULL;
     }
 
-    pending_queue = xQueueCreate(1, sizeof(void *));
-    if (!pending_queue) {
-        xSemaphoreGive(pending_mutex);
-        return -4;
+    uint8_t *buf = (uint8_t *)rpc_pool_alloc(raw_len > 0 ? raw_len : 1);
+    if (!buf) {
+        *err = ERR_INTERNAL;
+        return NULL;
+    }
+    if (rpc_lz_decompress(data + 2, (size_t)len - 2, buf, raw_len) != (int)raw_len) {
+        rpc_pool_free(buf);
+        *err = ERR_INTERNAL;
+        return NULL;
+    }
+    *out_len = (uint16_t)raw_len;
+    return buf;
+}
+
+
+/* Find the pending slot a response with this ID belongs to (pending_mutex
+   must be held).  A classic response only carries the low byte, so it can
+   only match a call that was sent narrow. */
+static pending_slot_t *find_pending(rpc_peer_t *peer, uint16_t id, bool wide) {
+    for (size_t i = 0; i < MAX_PENDING_CALLS; i++) {
+        const pending_slot_t *slot = &peer->pending_table[i];
+        if (slot->in_use && slot->wide == wide &&
+            (wide ? slot->id == id : (uint8_t)slot->id == (uint8_t)id)) {
+            return &peer->pending_table[i];
+        }
+    }
+    return NULL;
+}
+
+
+// Draw a request ID; the counter is shared by peers whose mutexes do not cover each other
+static inline uint16_t draw_request_id(void) {
+    return (uint16_t)atomic_fetch_add_explicit(&next_request_id, 1, memory_order_relaxed);
+}
+
+
+/* Claim a free pending slot and give it a request ID that no other
+   outstanding call uses on the wire (pending_mutex must be held).  id
+   was drawn before the lock was taken; it is checked against the table
+   here and only replaced after the counter has wrapped onto a call that
+   is still outstanding. */
+static pending_slot_t *alloc_pending(rpc_peer_t *peer, uint16_t id) {
+    pending_slot_t *slot = NULL;
+    for (size_t i = 0; i < MAX_PENDING_CALLS; i++) {
+        if (!peer->pending_table[i].in_use) {
+            slot = &peer->pending_table[i];
+            break;
+        }
     }
+    if (!slot) return NULL;
 
-    // Build request payload: [type][counter][name][0][args...]
-    current_counter++;
-    uint8_t counter = current_counter;
-    uint8_t name_len = (uint8_t)strlen(name);
+    const bool wide = CLIENT_WIDE_IDS;
+    while (find_pending(peer, id, wide) != NULL) id = draw_request_id();
 
-    uint16_t payload_len = (uint16_t)(2 + name_len + 1 + args_len);
-    uint8_t *payload = (uint8_t *)pvPortMalloc(payload_len);
+    slot->in_use    = true;
+    slot->completed = false;
+    slot->wide      = wide;
+    slot->id        = id;
+    slot->status    = 0;
+    slot->error     = 0;
+    slot->response  = NULL;
+    slot->use_into  = false;
+    slot->into      = NULL;
+    slot->into_cap  = 0;
+    slot->resp_len  = 0;
+    slot->callback  = NULL;
+    slot->cb_ctx    = NULL;
+    return slot;
+}
+
+
+/* Release a pending slot.  Once the slot is marked free under the mutex
+   the RX task can no longer complete it, so a result that raced with a
+   timeout is dropped here and the done semaphore is left empty for the
+   next user. */
+static void release_pending(rpc_peer_t *peer, pending_slot_t *slot) {
+    xSemaphoreTake(peer->pending_mutex, portMAX_DELAY);
+    uint8_t *stale = slot->response;
+    slot->response = NULL;
+    slot->in_use   = false;
+    (void)xSemaphoreTake(slot->done, 0);
+    xSemaphoreGive(peer->pending_mutex);
+
+    if (stale) vPortFree(stale);
+}
+
+
+/* Call target: a function name, or a numeric ID when name is NULL, and
+   how the request travels */
+typedef struct {
+    const char *name;
+    uint16_t    func_id;
+    uint8_t     priority;     // RPC_PRIO_*
+    int64_t     deadline_us;  // not sent after this (esp_timer_get_time()); 0: no limit
+} call_target_t;
 
-    if (!payload) {
-        vQueueDelete(pending_queue);
-        pending_queue = NULL;
-        xSemaphoreGive(pending_mutex);
-        return -5;
+
+// Link TX lane (LINK_TX_* flag) of a request at priority
+static uint8_t prio_lane(uint8_t priority) {
+    return (priority == RPC_PRIO_HIGH) ? LINK_TX_URGENT
+         : (priority == RPC_PRIO_BULK) ? LINK_TX_BULK : 0;
+}
+
+
+/* Send request [type][id][name][0][args...] (type is MSG_TYPE_REQUEST
+   or MSG_TYPE_STREAM) or, for a numeric target,
+   [MSG_TYPE_REQUEST_ID][id][func_lo][func_hi][args...].  The header, the
+   name (with its terminator) and the caller's args go out as separate
+   segments, so nothing is copied, unless the peer takes compressed
+   payloads and the args are worth compressing.  A priority other than
+   normal picks the link lane.  If the peer understands options, the
+   priority and, with CONFIG_RPC_CALL_DEADLINES, the timeout_ms the
+   caller waits for the reply go in front as
+   [MSG_TYPE_OPTIONS][len][RPC_OPT_PRIORITY][1][prio][RPC_OPT_DEADLINE][n][ms...],
+   each TLV only when it applies.
+   Returns 0, -6 if the frame could not be sent, or -13 if its deadline
+   passed first. */
+static int send_request(rpc_peer_t *peer, uint8_t type, uint16_t id, bool wide, const call_target_t *target,
+                        const uint8_t *args, uint16_t args_len, uint32_t timeout_ms) {
+    uint8_t hdr[RPC_OPTIONS_MAX_LEN + 5];
+    phys_iovec_t iov[3];
+    size_t n = 0;
+    size_t h = 0;
+
+    uint8_t  cflag  = 0;
+    uint8_t *packed = NULL;
+    if ((peer->caps & RPC_CAP_COMPRESS) && args) {
+        uint16_t packed_len = 0;
+        packed = compress_payload(args, args_len, &packed_len);
+        if (packed) {
+            cflag    = MSG_FLAG_COMPRESSED;
+            args     = packed;
+            args_len = packed_len;
+        }
     }
 
-    size_t off = 0;
-    payload[off++] = MSG_TYPE_REQUEST;
-    payload[off++] = counter;
-    memcpy(payload + off, name, name_len);
-    off += name_len;
-    payload[off++] = 0x00; // name terminator
-    if (args_len > 0 && args) memcpy(payload + off, args, args_len);
+#if !CONFIG_RPC_CALL_DEADLINES
+    timeout_ms = 0;
+#endif
+    if ((target->priority != RPC_PRIO_NORMAL || timeout_ms > 0) && (peer->caps & RPC_CAP_OPTIONS)) {
+        hdr[h++] = MSG_TYPE_OPTIONS;
+        h++;  // envelope length, filled in below
+        if (target->priority != RPC_PRIO_NORMAL) {
+            hdr[h++] = RPC_OPT_PRIORITY;
+            hdr[h++] = 1;
+            hdr[h++] = target->priority;
+        }
+        if (timeout_ms > 0) {
+            // little-endian in as few bytes as the value needs
+            const size_t tlv = h;
+            h += 2;
+            for (uint32_t v = timeout_ms; v > 0; v >>= 8) hdr[h++] = (uint8_t)(v & 0xFF);
+            hdr[tlv]     = RPC_OPT_DEADLINE;
+            hdr[tlv + 1] = (uint8_t)(h - tlv - 2);
+        }
+        hdr[1] = (uint8_t)(h - 2);
+    }
+    if (target->name) {
+        h += put_header(&hdr[h], type | cflag, id, wide);
+        iov[n++] = (phys_iovec_t){ hdr, h };
+        iov[n++] = (phys_iovec_t){ target->name, strlen(target->name) + 1 };
+    } else {
+        h += put_header(&hdr[h], MSG_TYPE_REQUEST_ID | cflag, id, wide);
+        hdr[h++] = (uint8_t)(target->func_id & 0xFF);
+        hdr[h++] = (uint8_t)((target->func_id >> 8) & 0xFF);
+        iov[n++] = (phys_iovec_t){ hdr, h };
+    }
+    iov[n++] = (phys_iovec_t){ args, (args_len > 0 && args) ? args_len : 0 };
 
     // Send over link layer
-    int rc = link_send_frame(payload, payload_len);
-    vPortFree(payload);
+    int rc = rpc_link_send_framev_until(peer->link, iov, n, prio_lane(target->priority),
+                                        target->deadline_us);
+    rpc_pool_free(packed);
+    if (rc == -7) {
+        RPC_STAT_INC(s_stats.expired);
+        return -13;
+    }
+    return (rc == 0) ? 0 : -6;
+}
+
+
+/* Tell the peer that the calls with these IDs were given up on, in one
+   [MSG_TYPE_CANCEL][id][id...] message, so it drops them unrun or leaves
+   them unanswered.  Only peers that announce RPC_CAP_CANCEL are told.
+   A cancel only saves the peer work, so it is dropped rather than wait
+   for TX room; the timer task sends them too. */
+static void send_cancel(rpc_peer_t *peer, const uint16_t *ids, size_t n) {
+    if (n == 0 || !(peer->caps & RPC_CAP_CANCEL)) return;
+
+    uint8_t msg[3 + 2 * MAX_PENDING_CALLS];
+    size_t len = put_header(msg, MSG_TYPE_CANCEL, ids[0], CLIENT_WIDE_IDS);
+    for (size_t i = 1; i < n; i++) {
+        msg[len++] = (uint8_t)(ids[i] & 0xFF);
+        if (CLIENT_WIDE_IDS) msg[len++] = (uint8_t)((ids[i] >> 8) & 0xFF);
+    }
+    const phys_iovec_t iov = { msg, len };
+    if (rpc_link_send_framev(peer->link, &iov, 1, LINK_TX_URGENT | LINK_TX_NOWAIT) == 0) {
+        RPC_STAT_ADD(s_stats.cancels, n);
+    }
+}
+
+
+/* Blocking call shared by transport_call*().  The response goes to a heap
+   copy in *response or, with response == NULL, into buf (buf_cap bytes). */
+static int call_sync(rpc_peer_t *peer, const call_target_t *target, const uint8_t *args, uint16_t args_len,
+                     uint8_t **response, uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                     uint8_t *error_code, uint32_t timeout_ms)
+{
+    // Reserve a slot in the pending table
+    const uint16_t first_id = draw_request_id();
+    if (xSemaphoreTake(peer->pending_mutex, portMAX_DELAY) != pdTRUE) return -2;
+    pending_slot_t *slot = alloc_pending(peer, first_id);
+    if (!slot) {
+        xSemaphoreGive(peer->pending_mutex);
+        RPC_STAT_INC(s_stats.busy);
+        return -3; // too many calls pending
+    }
+    RPC_STAT_INC(s_stats.calls);
+    if (!response) {
+        slot->use_into = true;
+        slot->into     = buf;
+        slot->into_cap = buf ? buf_cap : 0;
+    }
+    uint16_t id = slot->id;
+    bool wide = slot->wide;
+    xSemaphoreGive(peer->pending_mutex);
+
+    const int rc = send_request(peer, MSG_TYPE_REQUEST, id, wide, target, args, args_len, timeout_ms);
     if (rc != 0) {
-        vQueueDelete(pending_queue);
-        pending_queue = NULL;
-        xSemaphoreGive(pending_mutex);
-        return -6;
-    }
-
-    // Release mutex while waiting
-    xSemaphoreGive(pending_mutex);
-
-    // Wait for response pointer from RX task
-    void *resp_ptr = NULL;
-    if (xQueueReceive(pending_queue, &resp_ptr, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
-        // timeout: clean up pending state
-        xSemaphoreTake(pending_mutex, portMAX_DELAY);
-        vQueueDelete(pending_queue);
-        pending_queue = NULL;
-        xSemaphoreGive(pending_mutex);
+        release_pending(peer, slot);
+        return rc;
+    }
+
+    // Wait for the RX task to complete the slot
+    if (xSemaphoreTake(slot->done, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        // timeout: free the slot; a late response is dropped by the RX task
+        release_pending(peer, slot);
+        send_cancel(peer, &id, 1);
+        RPC_STAT_INC(s_stats.timeouts);
         return -7;
     }
 
-    // Response envelope: [len_low][len_high][error][data...]
-    uint8_t *resp_buf = (uint8_t *)resp_ptr;
-    uint16_t datalen = (uint16_t)resp_buf[0] | ((uint16_t)resp_buf[1] << 8);
-    *error_code = resp_buf[2];
+    // Result fields were written before done was given; take them over
+    int status  = slot->status;
+    *error_code = slot->error;
+    *resp_len   = slot->resp_len;
+    if (response) *response = slot->response;
+    slot->response = NULL;
+    release_pending(peer, slot);
+    return status;
+}
 
-    if (*error_code == 0) {
-        *resp_len = datalen;
-        if (datalen > 0) {
-            *response = (uint8_t *)pvPortMalloc(datalen);
-            if (*response) {
-                memcpy(*response, resp_buf + 3, datalen);
-            } else {
-                vPortFree(resp_buf);
-                return -8; // allocation failure for response
-            }
-        } else {
-            *response = NULL;
-        }
-    } else {
-        *resp_len = 0;
-        *response = NULL;
+
+/* Reserve a pending slot for an async call.  Returns the slot's request
+   ID, or negative if no slot is free. */
+static int start_async(rpc_peer_t *peer, transport_async_cb_t callback, void *ctx, uint32_t timeout_ms) {
+    const uint16_t first_id = draw_request_id();
+    if (xSemaphoreTake(peer->pending_mutex, portMAX_DELAY) != pdTRUE) return -2;
+    pending_slot_t *slot = alloc_pending(peer, first_id);
+    if (!slot) {
+        xSemaphoreGive(peer->pending_mutex);
+        RPC_STAT_INC(s_stats.busy);
+        return -3; // too many calls pending
     }
+    slot->callback = callback;
+    slot->cb_ctx   = ctx;
+    slot->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timeout_ms);
+    uint16_t id = slot->id;
 
-    vPortFree(resp_buf);
+    /* The timer runs free while async calls are pending: restarting an
+       active one would push the next sweep back on every call.  A call
+       it cannot be started for would never time out, so it is refused. */
+    if (!peer->async_timer_on) {
+        peer->async_timer_on = (xTimerStart(peer->async_timer, pdMS_TO_TICKS(ASYNC_SWEEP_MS)) == pdPASS);
+        if (!peer->async_timer_on) {
+            slot->in_use = false;
+            xSemaphoreGive(peer->pending_mutex);
+            return -2;
+        }
+    }
+    RPC_STAT_INC(s_stats.calls);
+    xSemaphoreGive(peer->pending_mutex);
 
-    // Clear pending state
-    xSemaphoreTake(pending_mutex, portMAX_DELAY);
-    vQueueDelete(pending_queue);
-    pending_queue = NULL;
-    xSemaphoreGive(pending_mutex);
-    return 0;
+    // The slot is visible before the request leaves, so even an
+    // immediate response finds it
+    return id;
 }
 
 
-// Helper: send error message [MSG_TYPE_ERROR][counter][error_code]
-static void send_error_response(uint8_t counter, uint8_t error_code) {
-    uint8_t payload[3];
-    payload[0] = MSG_TYPE_ERROR;
-    payload[1] = counter;
-    payload[2] = error_code;
-    (void)link_send_frame(payload, 3);
+/* Drop an async slot before its reply arrived: its request never left,
+   or the call was cancelled.  Returns true if the slot was still
+   waiting; if invoke is set its callback then gets status. */
+static bool abort_async(rpc_peer_t *peer, uint16_t id, int status, bool invoke) {
+    transport_async_cb_t callback = NULL;
+    void *cb_ctx = NULL;
+
+    xSemaphoreTake(peer->pending_mutex, portMAX_DELAY);
+    pending_slot_t *slot = find_pending(peer, id, CLIENT_WIDE_IDS);
+    if (slot && slot->callback) {
+        callback = slot->callback;
+        cb_ctx   = slot->cb_ctx;
+        slot->in_use = false;
+    }
+    xSemaphoreGive(peer->pending_mutex);
+
+    if (callback && invoke) callback(status, 0, NULL, 0, cb_ctx);
+    return callback != NULL;
 }
 
 
-// Helper: send normal response [MSG_TYPE_RESPONSE][counter][data...]
-static void send_response(uint8_t counter, const uint8_t *data, uint16_t len) {
-    uint8_t *payload = (uint8_t *)pvPortMalloc((size_t)2 + len);
+// Non-blocking call shared by transport_call_async() and transport_call_id_async()
+static int call_async(rpc_peer_t *peer, const call_target_t *target, const uint8_t *args, uint16_t args_len,
+                      transport_async_cb_t callback, void *ctx, uint32_t timeout_ms)
+{
+    int id = start_async(peer, callback, ctx, timeout_ms);
+    if (id < 0) return id;
 
-    if (!payload) {
-        send_error_response(counter, ERR_INTERNAL);
-        return;
+    int rc = send_request(peer, MSG_TYPE_REQUEST, (uint16_t)id, CLIENT_WIDE_IDS,
+                          target, args, args_len, timeout_ms);
+    if (rc != 0) {
+        // Only report failure if the slot was not completed meanwhile
+        if (abort_async(peer, (uint16_t)id, rc, false)) return rc;
     }
+    return id;
+}
 
-    payload[0] = MSG_TYPE_RESPONSE;
-    payload[1] = counter;
-    if (len > 0 && data) memcpy(payload + 2, data, len);
-    
-    (void)link_send_frame(payload, (uint16_t)(2 + len));
-    vPortFree(payload);
+
+/* Resolve the link of opts (NULL: all defaults) to its peer state and
+   fill in the target.  Returns NULL if the link is not attached. */
+static rpc_peer_t *start_target(const transport_call_opts_t *opts, const char *name, uint16_t func_id,
+                                call_target_t *target) {
+    target->name        = name;
+    target->func_id     = func_id;
+    target->priority    = RPC_PRIO_NORMAL;
+    target->deadline_us = 0;
+    if (!opts) return peer_of(NULL);
+
+    if (opts->priority <= RPC_PRIO_BULK) target->priority = opts->priority;
+    if (opts->deadline_ms > 0) target->deadline_us = esp_timer_get_time() + (int64_t)opts->deadline_ms * 1000;
+    return peer_of(opts->link);
 }
 
 
-// RX task: continuously receives link-layer frames and dispatches them
-static void transport_receiver_task(void *arg) {
-    (void)arg;
+// Perform a synchronous RPC call.
+// Builds a request, sends it via link layer, then waits for a response/error.
+// Several calls from different tasks may be outstanding at the same time.
+int transport_call_opt(const transport_call_opts_t *opts, const char *name,
+                       const uint8_t *args, uint16_t args_len,
+                       uint8_t **response, uint16_t *resp_len,
+                       uint8_t *error_code, uint32_t timeout_ms)
+{
+    call_target_t target;
+    rpc_peer_t *peer = start_target(opts, name, 0, &target);
+    if (!peer || !name || !response || !resp_len || !error_code) return -1;
+
+    return call_sync(peer, &target, args, args_len, response, NULL, 0, resp_len, error_code, timeout_ms);
+}
 
-    uint8_t  rx_buffer[256];
-    uint16_t rx_len;
 
-    for (;;) {
-        // wait for the next complete link-layer frame
-        if (link_receive_frame(rx_buffer, sizeof(rx_buffer), &rx_len) != 0) continue;
-        if (rx_len < 2) continue;
+// Synchronous call that receives the response into the caller's buffer
+int transport_call_into_opt(const transport_call_opts_t *opts, const char *name,
+                            const uint8_t *args, uint16_t args_len,
+                            uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                            uint8_t *error_code, uint32_t timeout_ms)
+{
+    call_target_t target;
+    rpc_peer_t *peer = start_target(opts, name, 0, &target);
+    if (!peer || !name || (!buf && buf_cap > 0) || !resp_len || !error_code) return -1;
 
-        uint8_t type    = rx_buffer[0];
-        uint8_t counter = rx_buffer[1];
+    return call_sync(peer, &target, args, args_len, NULL, buf, buf_cap, resp_len, error_code, timeout_ms);
+}
 
-        switch (type) {
-        case MSG_TYPE_REQUEST: {
-            // parse request: [type][counter][name ASCIIZ][args...]
-            if (rx_len < 3) {
-                send_error_response(counter, ERR_INTERNAL);
-                break;
-            }
 
-            // scan for terminating zero of the function name
-            uint16_t i = 2;
-            while (i < rx_len && rx_buffer[i] != 0x00) {
-                i++;
-            }
-            if (i >= rx_len) {
-                // no terminator found
-                send_error_response(counter, ERR_INTERNAL);
-                break;
-            }
+// Synchronous call by numeric function ID (compact request)
+int transport_call_id_opt(const transport_call_opts_t *opts, uint16_t func_id,
+                          const uint8_t *args, uint16_t args_len,
+                          uint8_t **response, uint16_t *resp_len,
+                          uint8_t *error_code, uint32_t timeout_ms)
+{
+    call_target_t target;
+    rpc_peer_t *peer = start_target(opts, NULL, func_id, &target);
+    if (!peer || !response || !resp_len || !error_code) return -1;
 
-            uint8_t     name_len    = (uint8_t)(i - 2);
-            const char *name        = (const char *)&rx_buffer[2];
-            uint16_t    args_offset = (uint16_t)(i + 1);
-            uint16_t    args_len    = (args_offset <= rx_len) ? (uint16_t)(rx_len - args_offset) : 0;
-            const uint8_t *args     = (args_len > 0) ? &rx_buffer[args_offset] : NULL;
-
-            // lookup and invoke the registered callback
-            rpc_entry_t *entry = find_function(name, name_len);
-            if (!entry) {
-                send_error_response(counter, ERR_FUNC_NOT_FOUND);
-                break;
-            }
+    return call_sync(peer, &target, args, args_len, response, NULL, 0, resp_len, error_code, timeout_ms);
+}
 
-            uint8_t  *resp_data = NULL;
-            uint16_t  resp_len  = 0;
-            uint8_t   err_code  = 0;
 
-            entry->callback(args, args_len, &resp_data, &resp_len, &err_code);
+// transport_call_into() by numeric function ID
+int transport_call_id_into_opt(const transport_call_opts_t *opts, uint16_t func_id,
+                               const uint8_t *args, uint16_t args_len,
+                               uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                               uint8_t *error_code, uint32_t timeout_ms)
+{
+    call_target_t target;
+    rpc_peer_t *peer = start_target(opts, NULL, func_id, &target);
+    if (!peer || (!buf && buf_cap > 0) || !resp_len || !error_code) return -1;
 
-            if (err_code != 0) send_error_response(counter, err_code);
-            else               send_response(counter, resp_data, resp_len);
+    return call_sync(peer, &target, args, args_len, NULL, buf, buf_cap, resp_len, error_code, timeout_ms);
+}
 
-            if (resp_data) vPortFree(resp_data);
-            break;
-        }
 
-        case MSG_TYPE_RESPONSE:
-        case MSG_TYPE_ERROR: {
-            // deliver the result/error to the waiting caller (if any)
-            xSemaphoreTake(pending_mutex, portMAX_DELAY);
-            if (pending_queue && counter == current_counter) {
-                uint16_t payload_len = 0;
-                uint8_t  err         = 0;
-
-                if (type == MSG_TYPE_ERROR) {
-                    // error payload carries a single byte: error_code
-                    err = (rx_len >= 3) ? rx_buffer[2] : ERR_INTERNAL;
-                    payload_len = 0;
-                } else {
-                    // response payload starts at rx_buffer[2]
-                    payload_len = (rx_len >= 2) ? (uint16_t)(rx_len - 2) : 0;
-                    err = 0;
-                }
-
-                // envelope for the caller: [len_low][len_high][error][data...]
-                uint8_t *copy = (uint8_t *)pvPortMalloc((size_t)2 + 1 + payload_len);
-                if (copy) {
-                    copy[0] = (uint8_t)(payload_len & 0xFF);
-                    copy[1] = (uint8_t)((payload_len >> 8) & 0xFF);
-                    copy[2] = err;
-                    if (type == MSG_TYPE_RESPONSE && payload_len > 0) {
-                        memcpy(copy + 3, &rx_buffer[2], payload_len);
-                    }
-                    (void)xQueueSend(pending_queue, &copy, 0);
-                }
-            }
-            xSemaphoreGive(pending_mutex);
-            break;
-        }
+// Start an asynchronous RPC call; the callback fires on response, error or timeout
+int transport_call_async_opt(const transport_call_opts_t *opts, const char *name,
+                             const uint8_t *args, uint16_t args_len,
+                             transport_async_cb_t callback, void *ctx, uint32_t timeout_ms)
+{
+    call_target_t target;
+    rpc_peer_t *peer = start_target(opts, name, 0, &target);
+    if (!peer || !name || !callback) return -1;
 
-        default:
-            // unknown type: ignore and continue
-            break;
-        }
+    return call_async(peer, &target, args, args_len, callback, ctx, timeout_ms);
+}
+
+
+// Asynchronous call by numeric function ID (compact request)
+int transport_call_id_async_opt(const transport_call_opts_t *opts, uint16_t func_id,
+                                const uint8_t *args, uint16_t args_len,
+                                transport_async_cb_t callback, void *ctx, uint32_t timeout_ms)
+{
+    call_target_t target;
+    rpc_peer_t *peer = start_target(opts, NULL, func_id, &target);
+    if (!peer || !callback) return -1;
+
+    return call_async(peer, &target, args, args_len, callback, ctx, timeout_ms);
+}
+
+
+// The same calls on a given link, at normal priority
+int transport_call_on(rpc_link_t *link, const char *name, const uint8_t *args, uint16_t args_len,
+                      uint8_t **response, uint16_t *resp_len,
+                      uint8_t *error_code, uint32_t timeout_ms) {
+    const transport_call_opts_t opts = { .link = link };
+    return transport_call_opt(&opts, name, args, args_len, response, resp_len, error_code, timeout_ms);
+}
+
+int transport_call_into_on(rpc_link_t *link, const char *name, const uint8_t *args, uint16_t args_len,
+                           uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                           uint8_t *error_code, uint32_t timeout_ms) {
+    const transport_call_opts_t opts = { .link = link };
+    return transport_call_into_opt(&opts, name, args, args_len, buf, buf_cap, resp_len, error_code, timeout_ms);
+}
+
+int transport_call_id_on(rpc_link_t *link, uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                         uint8_t **response, uint16_t *resp_len,
+                         uint8_t *error_code, uint32_t timeout_ms) {
+    const transport_call_opts_t opts = { .link = link };
+    return transport_call_id_opt(&opts, func_id, args, args_len, response, resp_len, error_code, timeout_ms);
+}
+
+int transport_call_id_into_on(rpc_link_t *link, uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                              uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                              uint8_t *error_code, uint32_t timeout_ms) {
+    const transport_call_opts_t opts = { .link = link };
+    return transport_call_id_into_opt(&opts, func_id, args, args_len, buf, buf_cap, resp_len, error_code, timeout_ms);
+}
+
+int transport_call_async_on(rpc_link_t *link, const char *name, const uint8_t *args, uint16_t args_len,
+                            transport_async_cb_t callback, void *ctx, uint32_t timeout_ms) {
+    const transport_call_opts_t opts = { .link = link };
+    return transport_call_async_opt(&opts, name, args, args_len, callback, ctx, timeout_ms);
+}
+
+int transport_call_id_async_on(rpc_link_t *link, uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                               transport_async_cb_t callback, void *ctx, uint32_t timeout_ms) {
+    const transport_call_opts_t opts = { .link = link };
+    return transport_call_id_async_opt(&opts, func_id, args, args_len, callback, ctx, timeout_ms);
+}
+
+
+// And on the default link
+int transport_call(const char *name, const uint8_t *args, uint16_t args_len,
+                   uint8_t **response, uint16_t *resp_len,
+                   uint8_t *error_code, uint32_t timeout_ms) {
+    return transport_call_opt(NULL, name, args, args_len, response, resp_len, error_code, timeout_ms);
+}
+
+int transport_call_into(const char *name, const uint8_t *args, uint16_t args_len,
+                        uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                        uint8_t *error_code, uint32_t timeout_ms) {
+    return transport_call_into_opt(NULL, name, args, args_len, buf, buf_cap, resp_len, error_code, timeout_ms);
+}
+
+int transport_call_id(uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                      uint8_t **response, uint16_t *resp_len,
+                      uint8_t *error_code, uint32_t timeout_ms) {
+    return transport_call_id_opt(NULL, func_id, args, args_len, response, resp_len, error_code, timeout_ms);
+}
+
+int transport_call_id_into(uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                           uint8_t *buf, uint16_t buf_cap, uint16_t *resp_len,
+                           uint8_t *error_code, uint32_t timeout_ms) {
+    return transport_call_id_into_opt(NULL, func_id, args, args_len, buf, buf_cap, resp_len, error_code, timeout_ms);
+}
+
+int transport_call_async(const char *name, const uint8_t *args, uint16_t args_len,
+                         transport_async_cb_t callback, void *ctx, uint32_t timeout_ms) {
+    return transport_call_async_opt(NULL, name, args, args_len, callback, ctx, timeout_ms);
+}
+
+int transport_call_id_async(uint16_t func_id, const uint8_t *args, uint16_t args_len,
+                            transport_async_cb_t callback, void *ctx, uint32_t timeout_ms) {
+    return transport_call_id_async_opt(NULL, func_id, args, args_len, callback, ctx, timeout_ms);
+}
+
+
+// Give up on an async call: complete it with -15 and tell the peer
+int transport_cancel_on(rpc_link_t *link, uint16_t id) {
+    rpc_peer_t *peer = peer_of(link);
+    if (!peer) return -1;
+
+    if (!abort_async(peer, id, -15, true)) return -9;
+    send_cancel(peer, &id, 1);
+    return 0;
+}
+
+
+int transport_cancel(uint16_t id) {
+    return transport_cancel_on(NULL, id);
+}
+
+
+// Ask the peer for the numeric ID of a function (built-in "__resolve")
+int transport_resolve_on(rpc_link_t *link, const char *name, uint16_t *func_id, uint32_t timeout_ms) {
+    if (!name || !func_id) return -1;
+
+    size_t nlen = strlen(name);
+    if (nlen > 0xFF) return -1;
+
+    uint8_t *resp = NULL;
+    uint16_t resp_len = 0;
+    uint8_t  err = 0;
+    int rc = transport_call_on(link, RPC_RESOLVE_FUNCTION, (const uint8_t *)name, (uint16_t)nlen,
+                               &resp, &resp_len, &err, timeout_ms);
+    if (rc != 0) return rc;
+    if (err != 0 || resp_len != 2) {
+        if (resp) vPortFree(resp);
+        return (err == ERR_FUNC_NOT_FOUND) ? -9 : -10;
+    }
+    *func_id = (uint16_t)resp[0] | ((uint16_t)resp[1] << 8);
+    vPortFree(resp);
+    return 0;
+}
+
+
+int transport_resolve(const char *name, uint16_t *func_id, uint32_t timeout_ms) {
+    return transport_resolve_on(NULL, name, func_id, timeout_ms);
+}
+
+
+/* Ask the peer which optional features it supports (built-in "__caps")
+   and use the ones both sides have from now on */
+int transport_negotiate_caps_on(rpc_link_t *link, uint32_t timeout_ms) {
+    rpc_peer_t *peer = peer_of(link);
+    if (!peer) return -1;
+
+    uint8_t *resp = NULL;
+    uint16_t resp_len = 0;
+    uint8_t  err = 0;
+    int rc = transport_call_on(link, RPC_CAPS_FUNCTION, NULL, 0, &resp, &resp_len, &err, timeout_ms);
+    if (rc != 0) return rc;
+    if (err != 0 || resp_len < 1) {
+        if (resp) vPortFree(resp);
+        return (err == ERR_FUNC_NOT_FOUND) ? -9 : -10;
+    }
+    peer->caps = (uint8_t)(resp[0] & RPC_LOCAL_CAPS);
+    vPortFree(resp);
+    return peer->caps;
+}
+
+
+int transport_negotiate_caps(uint32_t timeout_ms) {
+    return transport_negotiate_caps_on(NULL, timeout_ms);
+}
+
+
+// Start building a batch frame for link in caller-provided storage
+void transport_batch_begin_on(transport_batch_t *batch, rpc_link_t *link, uint8_t *buf, uint16_t cap) {
+    batch->link    = link;
+    batch->buf     = buf;
+    batch->cap     = cap;
+    batch->len     = 2;   // [MSG_TYPE_BATCH][count] filled in at commit
+    batch->count   = 0;
+    batch->n_calls = 0;
+}
+
+
+void transport_batch_begin(transport_batch_t *batch, uint8_t *buf, uint16_t cap) {
+    transport_batch_begin_on(batch, NULL, buf, cap);
+}
+
+
+/* Append [len LE16][type][id][name][0][args...] to a batch.
+   Returns -11 if the entry does not fit. */
+static int batch_append(transport_batch_t *batch, uint8_t type, uint16_t id, bool wide,
+                        const char *name, const uint8_t *args, uint16_t args_len) {
+    size_t name_len  = strlen(name);
+    size_t hdr_len   = wide ? 3 : 2;
+    size_t entry_len = hdr_len + name_len + 1 + ((args && args_len > 0) ? args_len : 0);
+    if (!batch->buf || batch->count >= TRANSPORT_BATCH_MAX ||
+        (size_t)batch->len + 2 + entry_len > batch->cap) {
+        return -11;
+    }
+
+    uint8_t *p = batch->buf + batch->len;
+    *p++ = (uint8_t)(entry_len & 0xFF);
+    *p++ = (uint8_t)((entry_len >> 8) & 0xFF);
+    p += put_header(p, type, id, wide);
+    memcpy(p, name, name_len + 1);
+    p += name_len + 1;
+    if (args && args_len > 0) memcpy(p, args, args_len);
+
+    batch->len = (uint16_t)(batch->len + 2 + entry_len);
+    batch->count++;
+    return 0;
+}
+
+
+// Queue an async call in a batch; nothing is sent until transport_batch_commit()
+int transport_batch_call_async(transport_batch_t *batch, const char *name,
+                               const uint8_t *args, uint16_t args_len,
+                               transport_async_cb_t callback, void *ctx, uint32_t timeout_ms) {
+    rpc_peer_t *peer = batch ? peer_of(batch->link) : NULL;
+    if (!peer || !name || !callback) return -1;
+
+    int id = start_async(peer, callback, ctx, timeout_ms);
+    if (id < 0) return id;
+
+    int rc = batch_append(batch, MSG_TYPE_REQUEST, (uint16_t)id, CLIENT_WIDE_IDS,
+                          name, args, args_len);
+    if (rc != 0) {
+        (void)abort_async(peer, (uint16_t)id, rc, false);
+        return rc;
+    }
+    batch->call_ids[batch->n_calls++] = (uint16_t)id;
+    return id;
+}
+
+
+// Queue a stream message in a batch
+int transport_batch_stream(transport_batch_t *batch, const char *name,
+                           const uint8_t *args, uint16_t args_len) {
+    rpc_peer_t *peer = batch ? peer_of(batch->link) : NULL;
+    if (!peer || !name) return -1;
+
+    portENTER_CRITICAL(&peer->stream_lock);
+    uint8_t seq = peer->stream_tx_seq++;
+    portEXIT_CRITICAL(&peer->stream_lock);
+
+    return batch_append(batch, MSG_TYPE_STREAM, seq, false, name, args, args_len);
+}
+
+
+/* Send everything queued in the batch as one frame.  If the frame cannot
+   be sent, every call in it completes at once with status -6. */
+int transport_batch_commit(transport_batch_t *batch) {
+    rpc_peer_t *peer = batch ? peer_of(batch->link) : NULL;
+    if (!peer || !batch->buf) return -1;
+    if (batch->count == 0) return 0;
+
+    batch->buf[0] = MSG_TYPE_BATCH;
+    batch->buf[1] = batch->count;
+
+    // A batch of one goes out as the plain message it wraps
+    const phys_iovec_t iov = (batch->count == 1)
+                           ? (phys_iovec_t){ batch->buf + 4, (size_t)(batch->len - 4) }
+                           : (phys_iovec_t){ batch->buf, batch->len };
+    int rc = rpc_link_send_framev(peer->link, &iov, 1, 0);
+
+    if (rc != 0) {
+        for (uint8_t i = 0; i < batch->n_calls; i++) {
+            (void)abort_async(peer, batch->call_ids[i], -6, true);
+        }
+    }
+    batch->len     = 2;
+    batch->count   = 0;
+    batch->n_calls = 0;
+    return (rc == 0) ? 0 : -6;
+}
+
+
+// Fire-and-forget call: no pending slot, no response
+int transport_stream_on(rpc_link_t *link, const char *name, const uint8_t *args, uint16_t args_len) {
+    rpc_peer_t *peer = peer_of(link);
+    if (!peer || !name) return -1;
+
+    portENTER_CRITICAL(&peer->stream_lock);
+    uint8_t seq = peer->stream_tx_seq++;
+    portEXIT_CRITICAL(&peer->stream_lock);
+
+    const call_target_t target = { name, 0, RPC_PRIO_NORMAL, 0 };
+    return send_request(peer, MSG_TYPE_STREAM, seq, false, &target, args, args_len, 0);
+}
+
+
+int transport_stream(const char *name, const uint8_t *args, uint16_t args_len) {
+    return transport_stream_on(NULL, name, args, args_len);
+}
+
+
+// Report stream messages received and lost (by sequence gaps)
+void transport_stream_stats(uint32_t *received, uint32_t *lost) {
+    rpc_peer_t *peer = &default_peer;
+    portENTER_CRITICAL(&peer->stream_lock);
+    if (received) *received = peer->stream_rx_count;
+    if (lost)     *lost     = peer->stream_rx_lost;
+    portEXIT_CRITICAL(&peer->stream_lock);
+}
+
+
+/* Stream counters this close behind the expected one belong to a
+   duplicate or a late message; further back, the sender restarted or
+   a long outage wrapped the counter */
+#define STREAM_LATE_WINDOW 16
+
+/* Account for an incoming stream message: every counter value skipped
+   since the previous one is a message lost on the way.  A counter up to
+   STREAM_LATE_WINDOW behind the expected one loses nothing and leaves
+   the expected counter where it is; anything else resyncs to it, as a
+   forward gap when it is one. */
+static void stream_track(rpc_peer_t *peer, uint8_t seq) {
+    portENTER_CRITICAL(&peer->stream_lock);
+    const uint8_t gap = (uint8_t)(seq - peer->stream_rx_expected);
+    const bool late = peer->stream_rx_synced && (uint8_t)(-gap) <= STREAM_LATE_WINDOW && gap != 0;
+    if (!late) {
+        if (peer->stream_rx_synced && gap < 0x80) peer->stream_rx_lost += gap;
+        peer->stream_rx_expected = (uint8_t)(seq + 1);
+    }
+    peer->stream_rx_synced = true;
+    peer->stream_rx_count++;
+    portEXIT_CRITICAL(&peer->stream_lock);
+}
+
+
+// A stream message arrived intact but its handler never ran
+static void stream_drop(rpc_peer_t *peer) {
+    portENTER_CRITICAL(&peer->stream_lock);
+    peer->stream_rx_lost++;
+    portEXIT_CRITICAL(&peer->stream_lock);
+}
+
+
+// Look up a registered function by the ID handed out by __resolve
+static rpc_entry_t *find_function_id(uint16_t func_id) {
+    if (func_id >= REGISTRY_SLOTS) return NULL;
+    rpc_entry_t *entry = &function_registry[func_id];
+    return entry_used(entry) ? entry : NULL;
+}
+
+
+/* Built-in "__resolve": args carry a function name (no terminator), the
+   response is its registry slot as a little-endian uint16.  Slots never
+   move once assigned, so the ID stays valid until the peer reboots. */
+static void rpc_resolve(const uint8_t *args, uint16_t args_len,
+                        rpc_writer_t *resp, uint8_t *error_code) {
+    rpc_entry_t *entry = NULL;
+    if (args && args_len > 0 && args_len <= CONFIG_RPC_MAX_NAME_LEN) {
+        entry = find_function((const char *)args, (uint8_t)args_len,
+                              name_hash((const char *)args, args_len));
+    }
+    if (!entry) {
+        *error_code = ERR_FUNC_NOT_FOUND;
+        return;
+    }
+    rpc_put_u16(resp, (uint16_t)(entry - function_registry));
+}
+
+
+// Built-in "__caps": the response is one byte of RPC_CAP_* bits
+static void rpc_caps(const uint8_t *args, uint16_t args_len,
+                     rpc_writer_t *resp, uint8_t *error_code) {
+    (void)args; (void)args_len; (void)error_code;
+    rpc_put_u8(resp, RPC_LOCAL_CAPS);
+}
+
+
+void transport_get_stats(transport_stats_t *out) {
+    if (!out) return;
+    TRANSPORT_STATS_FIELDS(RPC_STAT_LOAD_)
+}
+
+
+static void load_function_stats(const rpc_entry_t *entry, rpc_func_stats_t *out) {
+    out->calls  = atomic_load_explicit(&entry->stats.calls, memory_order_relaxed);
+    out->handler_us = atomic_load_explicit(&entry->stats.handler_us, memory_order_relaxed);
+}
+
+
+int transport_get_function_stats(const char *name, rpc_func_stats_t *out) {
+    if (!name || !out) return -1;
+
+    const size_t nlen = strlen(name);
+    if (nlen > CONFIG_RPC_MAX_NAME_LEN) return -9;
+    const rpc_entry_t *entry = find_function(name, (uint8_t)nlen, name_hash(name, nlen));
+    if (!entry) return -9;
+    load_function_stats(entry, out);
+    return 0;
+}
+
+
+#if CONFIG_RPC_STATS
+// Copy the fields of one record into the rpc_stats_t of the same names
+#define STATS_COPY_(kind, field) all.field = part.field;
+
+/* Built-in "__stats": without args the rpc_stats record, with a function
+   name (no terminator) that function's rpc_func_stats record. */
+static void rpc_stats_query(const uint8_t *args, uint16_t args_len,
+                            rpc_writer_t *resp, uint8_t *error_code) {
+    if (args_len > 0) {
+        const rpc_entry_t *entry = NULL;
+        if (args && args_len <= CONFIG_RPC_MAX_NAME_LEN) {
+            entry = find_function((const char *)args, (uint8_t)args_len,
+                                  name_hash((const char *)args, args_len));
+        }
+        if (!entry) {
+            *error_code = ERR_FUNC_NOT_FOUND;
+            return;
+        }
+        rpc_func_stats_t fs;
+        load_function_stats(entry, &fs);
+        rpc_func_stats_put(resp, &fs);
+        return;
+    }
+
+    rpc_stats_t all;
+    {
+        link_stats_t part;
+        link_get_stats(&part);
+        LINK_STATS_FIELDS(STATS_COPY_)
+    }
+    {
+        transport_stats_t part;
+        transport_get_stats(&part);
+        TRANSPORT_STATS_FIELDS(STATS_COPY_)
+    }
+    rpc_stats_put(resp, &all);
+}
+#endif
+
+
+// Read the peer's counters through "__stats"
+int transport_get_peer_stats(rpc_stats_t *out, uint32_t timeout_ms) {
+    if (!out) return -1;
+
+    uint8_t  resp[rpc_stats_MAX_SIZE];
+    uint16_t resp_len = 0;
+    uint8_t  err = 0;
+    int rc = transport_call_into(RPC_STATS_FUNCTION, NULL, 0, resp, sizeof(resp),
+                                 &resp_len, &err, timeout_ms);
+    if (rc == -12) rc = 0;  // counters of a newer peer past ours are ignored
+    if (rc != 0) return rc;
+    if (err != 0) return (err == ERR_FUNC_NOT_FOUND) ? -9 : -10;
+
+    rpc_reader_t r;
+    rpc_reader_init(&r, resp, (resp_len < sizeof(resp)) ? resp_len : (uint16_t)sizeof(resp));
+    (void)rpc_stats_get(&r, out);
+    return r.error ? -10 : 0;
+}
+
+
+/* Timer callback: fail async calls whose deadline has passed.  Runs in the
+   timer service task, so it never blocks: a busy mutex just postpones
+   the sweep to the next period, and the cancels go out without waiting
+   for TX room. */
+static void async_sweep(TimerHandle_t timer) {
+    rpc_peer_t *peer = (rpc_peer_t *)pvTimerGetTimerID(timer);
+    struct {
+        transport_async_cb_t callback;
+        void *ctx;
+    } expired[MAX_PENDING_CALLS];
+    uint16_t expired_ids[MAX_PENDING_CALLS];
+    size_t n_expired = 0;
+    bool   any_async = false;
+
+    if (xSemaphoreTake(peer->pending_mutex, 0) != pdTRUE) return;
+    TickType_t now = xTaskGetTickCount();
+    for (size_t i = 0; i < MAX_PENDING_CALLS; i++) {
+        pending_slot_t *slot = &peer->pending_table[i];
+        if (!slot->in_use || !slot->callback) continue;
+        if ((int32_t)(now - slot->deadline) >= 0) {
+            expired[n_expired].callback = slot->callback;
+            expired[n_expired].ctx      = slot->cb_ctx;
+            expired_ids[n_expired]      = slot->id;
+            n_expired++;
+            slot->in_use = false;
+        } else {
+            any_async = true;
+        }
+    }
+    if (!any_async) {
+        // Stopped under the mutex, so a call that follows queues its start after the stop
+        (void)xTimerStop(timer, 0);
+        peer->async_timer_on = false;
+    }
+    xSemaphoreGive(peer->pending_mutex);
+    RPC_STAT_ADD(s_stats.timeouts, n_expired);
+    send_cancel(peer, expired_ids, n_expired);
+
+    // Run callbacks without the mutex so they may start new calls
+    for (size_t i = 0; i < n_expired; i++) {
+        expired[i].callback(-7, 0, NULL, 0, expired[i].ctx);
+    }
+}
+
+
+/* Send the replies collected so far as one MSG_TYPE_BATCH frame.  A lone
+   reply goes out as a plain message, without the batch wrapper. */
+static void flush_reply_batch(rpc_peer_t *peer, reply_batch_t *out) {
+    if (out->count == 1) {
+        const phys_iovec_t iov = { out->buf + 2, (size_t)(out->len - 2) };
+        (void)rpc_link_send_framev(peer->link, &iov, 1, 0);
+    } else if (out->count > 1) {
+        const uint8_t hdr[2] = { MSG_TYPE_BATCH, out->count };
+        const phys_iovec_t iov[2] = {
+            { hdr,      sizeof(hdr) },
+            { out->buf, out->len },
+        };
+        (void)rpc_link_send_framev(peer->link, iov, 2, 0);
+    }
+    out->len   = 0;
+    out->count = 0;
+}
+
+
+// Link TX lane of a reply of len bytes to a request at priority
+static uint8_t reply_lane(uint8_t priority, size_t len) {
+    return (priority == RPC_PRIO_NORMAL && len <= URGENT_MESSAGE_MAX) ? LINK_TX_URGENT : prio_lane(priority);
+}
+
+
+/* Send one transport message given as segments.  With a collector the
+   message is appended to the pending reply batch ([len LE16][msg]),
+   flushing first if it does not fit; messages too big for the collector
+   are sent on their own.  Replies take the lane of the request's
+   priority; at normal priority the short ones (errors, small responses)
+   take the urgent lane.  Returns the rpc_link_send_framev() result. */
+static int send_message(rpc_peer_t *peer, reply_batch_t *out, const phys_iovec_t *iov, size_t iovcnt,
+                        uint8_t priority) {
+    size_t len = 0;
+    for (size_t i = 0; i < iovcnt; i++) len += iov[i].len;
+
+    if (out) {
+        if (out->len + 2 + len > out->cap) flush_reply_batch(peer, out);
+        if (out->len + 2 + len <= out->cap) {
+            uint8_t *p = out->buf + out->len;
+            *p++ = (uint8_t)(len & 0xFF);
+            *p++ = (uint8_t)((len >> 8) & 0xFF);
+            for (size_t i = 0; i < iovcnt; i++) {
+                if (iov[i].len > 0) memcpy(p, iov[i].base, iov[i].len);
+                p += iov[i].len;
+            }
+            out->len = (uint16_t)(out->len + 2 + len);
+            out->count++;
+            if (out->count == UINT8_MAX) flush_reply_batch(peer, out);
+            return 0;
+        }
+    }
+    return rpc_link_send_framev(peer->link, iov, iovcnt, reply_lane(priority, len));
+}
+
+
+// Helper: send error message [MSG_TYPE_ERROR][id][error_code]
+static void send_error_response(rpc_peer_t *peer, reply_batch_t *out, uint16_t id, uint8_t mflags, uint8_t error_code) {
+    uint8_t payload[4];
+    size_t n = put_header(payload, MSG_TYPE_ERROR, id, (mflags & MSG_FLAG_WIDE_ID) != 0);
+    payload[n++] = error_code;
+    if (error_code == ERR_BUSY) RPC_STAT_INC(s_stats.busy_replies);
+    const phys_iovec_t iov = { payload, n };
+    (void)send_message(peer, out, &iov, 1, mflags & MFLAG_PRIO_MASK);
+}
+
+
+// What a response is cached under: the function and the args it ran with
+typedef struct {
+    const rpc_entry_t *entry;
+    const uint8_t     *args;
+    uint16_t           args_len;
+} cache_key_t;
+
+
+/* Keep a response message, framed, for repeats of the request; its
+   request ID bytes are patched per reply. */
+static void cache_response(const cache_key_t *key, uint8_t mflags, const phys_iovec_t *iov, size_t iovcnt) {
+    size_t len = 0;
+    for (size_t i = 0; i < iovcnt; i++) len += iov[i].len;
+    if (len > CONFIG_RPC_CACHE_MAX_SIZE) return;
+
+    link_prebuilt_t *frame = link_prebuild(iov, iovcnt, 1, (mflags & MSG_FLAG_WIDE_ID) ? 2 : 1);
+    rpc_cache_put(key->entry, (uint8_t)(mflags & MSG_FLAGS_MASK), key->args, key->args_len,
+                  frame, key->entry->cache_ttl_ms);
+}
+
+
+/* Answer a request from the response cache: the prebuilt frame goes to
+   the link as it is, with only the request ID (and the CRC) patched, or
+   the cached message is sent the usual way on links that transform their
+   frames and into reply batches.  Returns false on a miss. */
+static bool send_cached(rpc_peer_t *peer, reply_batch_t *out, const rpc_entry_t *entry,
+                        uint16_t id, uint8_t mflags, const uint8_t *args, uint16_t args_len) {
+    rpc_cache_entry_t *hit = rpc_cache_get(entry, (uint8_t)(mflags & MSG_FLAGS_MASK), args, args_len);
+    if (!hit) return false;
+    RPC_STAT_INC(s_stats.cache_hits);
+
+    const link_prebuilt_t *frame = rpc_cache_frame(hit);
+    const uint8_t  id_bytes[2] = { (uint8_t)(id & 0xFF), (uint8_t)((id >> 8) & 0xFF) };
+    const uint8_t  priority = mflags & MFLAG_PRIO_MASK;
+    uint16_t       len = 0;
+    const uint8_t *msg = link_prebuilt_payload(frame, &len);
+
+    int rc = -5;
+    if (!out) rc = rpc_link_send_prebuilt(peer->link, frame, id_bytes, reply_lane(priority, len));
+    if (rc == -5) {
+        const size_t rest = 1 + frame->patch_len;
+        const phys_iovec_t iov[3] = {
+            { msg,        1 },
+            { id_bytes,   frame->patch_len },
+            { msg + rest, len - rest },
+        };
+        rc = send_message(peer, out, iov, 3, priority);
+    }
+    rpc_cache_release(hit);
+
+    if (rc == -1) {
+        send_error_response(peer, out, id, mflags, ERR_INTERNAL);
+    } else if (rc == -2) {
+        send_error_response(peer, out, id, mflags, ERR_BUSY);
+    }
+    return true;
+}
+
+
+/* Helper: send normal response [MSG_TYPE_RESPONSE][id][data...].  The
+   data is compressed only when the request was, which proves the peer
+   can expand it.  With a key the message is also cached. */
+static void send_response(rpc_peer_t *peer, reply_batch_t *out, uint16_t id, uint8_t mflags,
+                          const uint8_t *data, uint16_t len, const cache_key_t *key) {
+    uint8_t  type = MSG_TYPE_RESPONSE;
+    uint8_t *packed = NULL;
+    if ((mflags & MSG_FLAG_COMPRESSED) && data) {
+        uint16_t packed_len = 0;
+        packed = compress_payload(data, len, &packed_len);
+        if (packed) {
+            type |= MSG_FLAG_COMPRESSED;
+            data  = packed;
+            len   = packed_len;
+        }
+    }
+
+    uint8_t hdr[3];
+    const phys_iovec_t iov[2] = {
+        { hdr,  put_header(hdr, type, id, (mflags & MSG_FLAG_WIDE_ID) != 0) },
+        { data, (len > 0 && data) ? len : 0 },
+    };
+    if (key) cache_response(key, mflags, iov, 2);
+
+    const int rc = send_message(peer, out, iov, 2, mflags & MFLAG_PRIO_MASK);
+    rpc_pool_free(packed);
+    if (rc == -1) {
+        send_error_response(peer, out, id, mflags, ERR_INTERNAL);
+    } else if (rc == -2) {
+        // normal TX lane full: tell the caller to retry instead of timing out
+        send_error_response(peer, out, id, mflags, ERR_BUSY);
+    }
+}
+
+
+/* True once the caller of a deferred request gave up on it: it sent a
+   MSG_TYPE_CANCEL, or the deadline the request came with has passed */
+static bool job_abandoned(const rpc_job_t *job) {
+    return atomic_load_explicit(&job->cancelled, memory_order_relaxed) ||
+           (job->expires_us != 0 && esp_timer_get_time() >= job->expires_us);
+}
+
+
+// Make a queued job findable by cancel_jobs(); false if the table is full
+static bool track_job(rpc_job_t *job) {
+    bool tracked = false;
+    portENTER_CRITICAL(&s_jobs_lock);
+    for (size_t i = 0; i < MAX_JOBS && !tracked; i++) {
+        if (!s_jobs[i]) {
+            s_jobs[i] = job;
+            tracked = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_jobs_lock);
+    return tracked;
+}
+
+
+// Forget a job before it is freed
+static void untrack_job(const rpc_job_t *job) {
+    portENTER_CRITICAL(&s_jobs_lock);
+    for (size_t i = 0; i < MAX_JOBS; i++) {
+        if (s_jobs[i] == job) {
+            s_jobs[i] = NULL;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_jobs_lock);
+}
+
+
+// Mark the job answering request id from peer as cancelled, if it is still there
+static void cancel_jobs(rpc_peer_t *peer, uint16_t id, bool wide) {
+    portENTER_CRITICAL(&s_jobs_lock);
+    for (size_t i = 0; i < MAX_JOBS; i++) {
+        rpc_job_t *job = s_jobs[i];
+        if (job && job->peer == peer && job->id == id &&
+            ((job->mflags & MSG_FLAG_WIDE_ID) != 0) == wide) {
+            atomic_store_explicit(&job->cancelled, true, memory_order_relaxed);
+        }
+    }
+    portEXIT_CRITICAL(&s_jobs_lock);
+}
+
+
+bool transport_cancelled(void) {
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < CONFIG_RPC_WORKER_COUNT; i++) {
+        if (s_workers[i].task == self) {
+            const rpc_job_t *job = s_workers[i].job;
+            return job && job_abandoned(job);
+        }
+    }
+    return false;
+}
+
+
+// Whether the reply to a request is still to be sent once its handler returned
+static bool reply_wanted(const rpc_job_t *job, bool reply) {
+    if (!reply || !job || !job_abandoned(job)) return reply;
+    RPC_STAT_INC(s_stats.abandoned);  // the caller no longer waits for it
+    return false;
+}
+
+
+/* Run a handler and send its response or error (unless reply is false).
+   out collects the reply when the request came in a batch (RX task only).
+   resp_buf is the calling task's CONFIG_RPC_RESP_BUFFER_SIZE buffer for
+   rpc_handler_t handlers (NULL if it could not be allocated).  job is
+   the worker's job (NULL in the RX task); nothing is sent once its
+   caller has given up on it. */
+static void run_handler(rpc_peer_t *peer, reply_batch_t *out, rpc_entry_t *entry,
+                        uint16_t id, uint8_t mflags, bool reply,
+                        const uint8_t *args, uint16_t args_len, uint8_t *resp_buf,
+                        const rpc_job_t *job) {
+    uint8_t  *resp_data = NULL;
+    uint16_t  resp_len  = 0;
+    uint8_t   err_code  = 0;
+
+    const cache_key_t  key   = { entry, args, args_len };
+    const cache_key_t *cache = (entry->cache_ttl_ms > 0) ? &key : NULL;
+
+    RPC_STAT_INC(entry->stats.calls);
+#if CONFIG_RPC_STATS
+    const int64_t start = esp_timer_get_time();
+#endif
+
+    const rpc_handler_t handler = entry->handler;
+    if (handler) {
+        rpc_writer_t resp;
+        rpc_writer_init(&resp, resp_buf, resp_buf ? CONFIG_RPC_RESP_BUFFER_SIZE : 0);
+        handler(args, args_len, &resp, &err_code);
+        RPC_STAT_ADD(entry->stats.handler_us, (uint32_t)(esp_timer_get_time() - start));
+        reply = reply_wanted(job, reply);
+
+        if (!reply)             { /* stream: result is discarded */ }
+        else if (err_code != 0) send_error_response(peer, out, id, mflags, err_code);
+        else if (resp.overflow) send_error_response(peer, out, id, mflags, resp_buf ? ERR_TOO_LARGE : ERR_INTERNAL);
+        else                    send_response(peer, out, id, mflags, resp.buf, resp.len, cache);
+        return;
+    }
+
+    entry->callback(args, args_len, &resp_data, &resp_len, &err_code);
+    RPC_STAT_ADD(entry->stats.handler_us, (uint32_t)(esp_timer_get_time() - start));
+    reply = reply_wanted(job, reply);
+
+    if (!reply)             { /* stream: result is discarded */ }
+    else if (err_code != 0) send_error_response(peer, out, id, mflags, err_code);
+    else                    send_response(peer, out, id, mflags, resp_data, resp_len, cache);
+
+    if (resp_data) vPortFree(resp_data);
+}
+
+
+/* Dispatch a parsed request: inline handlers (or all handlers when there
+   are no workers) run here, the rest are copied into a job for a worker
+   and answered individually once they finish.  Each priority has its own
+   queue, so bulk work cannot hold up a high-priority request.
+   A full dispatch queue is reported as ERR_BUSY rather than stalling RX;
+   stream messages (reply == false) get no error.  Requests to cached
+   functions are first looked up in the response cache.  A queued
+   request is kept where a MSG_TYPE_CANCEL finds it, and dropped unrun
+   if its caller gives up on it (expires_us, 0: never) before a worker
+   gets to it.  Returns false if the request was dropped. */
+static bool dispatch_request(rpc_peer_t *peer, reply_batch_t *out, rpc_entry_t *entry,
+                             uint16_t id, uint8_t mflags, bool reply,
+                             const uint8_t *args, uint16_t args_len, int64_t expires_us) {
+    if (reply && entry->cache_ttl_ms > 0 && send_cached(peer, out, entry, id, mflags, args, args_len)) {
+        return true;
+    }
+    if (!dispatch_jobs || (entry->flags & RPC_FLAG_INLINE)) {
+        run_handler(peer, out, entry, id, mflags, reply, args, args_len, peer->rx_resp_buf, NULL);
+        return true;
+    }
+
+    rpc_job_t *job = (rpc_job_t *)rpc_pool_alloc(sizeof(rpc_job_t) + args_len);
+    if (!job) {
+        if (reply) send_error_response(peer, out, id, mflags, ERR_INTERNAL);
+        return false;
+    }
+    job->peer     = peer;
+    job->entry    = entry;
+    job->id       = id;
+    job->mflags   = mflags;
+    job->reply    = reply;
+    job->expires_us = expires_us;
+    job->args_len = args_len;
+    atomic_init(&job->cancelled, false);
+    if (args_len > 0) memcpy(job->args, args, args_len);
+
+    // untracked (table full), the job can still expire, just not be cancelled
+    const bool tracked = reply && track_job(job);
+    if (xQueueSend(dispatch_queue[mflags & MFLAG_PRIO_MASK], &job, 0) != pdTRUE) {
+        if (tracked) untrack_job(job);
+        rpc_pool_free(job);
+        if (reply) send_error_response(peer, out, id, mflags, ERR_BUSY);
+        return false;
+    }
+    xSemaphoreGive(dispatch_jobs);
+    return true;
+}
+
+
+/* Worker task: runs deferred handlers queued by the RX task, taking the
+   highest priority waiting first; arg is its worker_slot_t */
+static void transport_worker_task(void *arg) {
+    worker_slot_t *self = (worker_slot_t *)arg;
+    self->task = xTaskGetCurrentTaskHandle();
+
+    // This worker's response buffer for rpc_handler_t handlers
+    uint8_t *resp_buf = (uint8_t *)pvPortMalloc(CONFIG_RPC_RESP_BUFFER_SIZE);
+
+    for (;;) {
+        if (xSemaphoreTake(dispatch_jobs, portMAX_DELAY) != pdTRUE) continue;
+
+        static const uint8_t order[] = { RPC_PRIO_HIGH, RPC_PRIO_NORMAL, RPC_PRIO_BULK };
+        rpc_job_t *job = NULL;
+        for (size_t i = 0; i < sizeof(order) && !job; i++) {
+            if (xQueueReceive(dispatch_queue[order[i]], &job, 0) != pdTRUE) job = NULL;
+        }
+        if (!job) continue;
+
+        if (job->reply && job_abandoned(job)) {
+            RPC_STAT_INC(s_stats.abandoned);  // cancelled or stale while queued
+        } else {
+            self->job = job;
+            run_handler(job->peer, NULL, job->entry, job->id, job->mflags, job->reply,
+                        (job->args_len > 0) ? job->args : NULL, job->args_len, resp_buf, job);
+            self->job = NULL;
+        }
+        if (job->reply) untrack_job(job);
+        rpc_pool_free(job);
+    }
+}
+
+
+/* Deliver a response or error to the call waiting for id, if any.
+   Sync callers get a heap copy of the data (theirs to vPortFree) in the
+   slot, or the data copied into their own buffer while the mutex keeps
+   them from giving up on it; async callers get data straight from the
+   RX buffer.  A duplicate
+   response finds the slot already completed and is ignored; a late one
+   finds no slot, since IDs are not reused until the 16-bit space wraps. */
+static void complete_call(rpc_peer_t *peer, uint16_t id, bool wide, uint8_t err,
+                          const uint8_t *data, uint16_t len) {
+    transport_async_cb_t callback = NULL;
+    void *cb_ctx = NULL;
+
+    xSemaphoreTake(peer->pending_mutex, portMAX_DELAY);
+    pending_slot_t *slot = find_pending(peer, id, wide);
+    if (slot && slot->callback) {
+        // async call: complete the slot, run the callback below
+        callback = slot->callback;
+        cb_ctx   = slot->cb_ctx;
+        slot->in_use = false;
+    } else if (slot && !slot->completed) {
+        slot->error    = err;
+        slot->resp_len = (err == 0) ? len : 0;
+        if (err == 0 && len > 0 && slot->use_into) {
+            if (slot->into_cap > 0) memcpy(slot->into, data, (len < slot->into_cap) ? len : slot->into_cap);
+            if (len > slot->into_cap) slot->status = -12; // truncated
+        } else if (err == 0 && len > 0) {
+            slot->response = (uint8_t *)pvPortMalloc(len);
+            if (slot->response) {
+                memcpy(slot->response, data, len);
+            } else {
+                slot->resp_len = 0;
+                slot->status   = -8; // allocation failure for response
+            }
+        }
+        slot->completed = true;
+        xSemaphoreGive(slot->done);
+    } else {
+        RPC_STAT_INC(s_stats.late_responses);
+    }
+    xSemaphoreGive(peer->pending_mutex);
+
+    if (callback) {
+        callback(0, err, (len > 0) ? data : NULL, len, cb_ctx);
+    }
+}
+
+
+/* Like dispatch_request(), but expands compressed args first; the
+   handler always sees them as the caller passed them. */
+static bool dispatch_payload(rpc_peer_t *peer, reply_batch_t *out, rpc_entry_t *entry,
+                             uint16_t id, uint8_t mflags, bool reply,
+                             const uint8_t *args, uint16_t args_len, int64_t expires_us) {
+    if (!(mflags & MSG_FLAG_COMPRESSED)) {
+        return dispatch_request(peer, out, entry, id, mflags, reply, args, args_len, expires_us);
+    }
+
+    uint8_t  err = 0;
+    uint16_t raw_len = 0;
+    uint8_t *raw = expand_payload(args, args_len, &raw_len, &err);
+    if (!raw) {
+        if (reply) send_error_response(peer, out, id, mflags, err);
+        return false;
+    }
+    const bool ok = dispatch_request(peer, out, entry, id, mflags, reply, raw, raw_len, expires_us);
+    rpc_pool_free(raw);
+    return ok;
+}
+
+
+/* A frame passed its CRC but did not fit the RX buffer; only its first
+   bytes were kept.  Answer a request with ERR_TOO_LARGE and fail a
+   waiting call the same way, so neither side sits out a timeout. */
+static void reject_oversize(rpc_peer_t *peer, const uint8_t *prefix) {
+    uint16_t skip = 0;
+    if (prefix[0] == MSG_TYPE_OPTIONS) {
+        skip = (uint16_t)(2 + prefix[1]);  // the error goes out at normal priority
+        if (skip + 3 > CONFIG_RPC_RX_FRAME_SIZE) return;
+    }
+
+    uint8_t  type;
+    uint16_t id;
+    uint8_t  mflags;
+    (void)get_header(prefix + skip, (uint16_t)(CONFIG_RPC_RX_FRAME_SIZE - skip), &type, &id, &mflags);
+
+    if (type == MSG_TYPE_REQUEST || type == MSG_TYPE_REQUEST_ID) {
+        send_error_response(peer, NULL, id, mflags, ERR_TOO_LARGE);
+    } else if (type == MSG_TYPE_RESPONSE) {
+        complete_call(peer, id, (mflags & MSG_FLAG_WIDE_ID) != 0, ERR_TOO_LARGE, NULL, 0);
+    }
+}
+
+
+/* Parse the TLVs of an options envelope [type][opts_len][tlv...][message]
+   into the request's priority and the ms its caller still waits (0 if
+   not given).  Returns the offset of the enclosed message, or 0 if the
+   envelope is malformed; unknown tags are skipped. */
+static uint16_t parse_options(const uint8_t *msg, uint16_t len, uint8_t *priority, uint32_t *timeout_ms) {
+    if (len < 2 || msg[1] > len - 2) return 0;
+    const uint16_t end = (uint16_t)(2 + msg[1]);
+
+    for (uint16_t off = 2; off < end; ) {
+        if (off + 2 > end || msg[off + 1] > end - off - 2) return 0;
+        const uint8_t tag = msg[off], tlen = msg[off + 1];
+        if (tag == RPC_OPT_PRIORITY && tlen >= 1 && msg[off + 2] <= RPC_PRIO_BULK) {
+            *priority = msg[off + 2];
+        } else if (tag == RPC_OPT_DEADLINE && tlen >= 1 && tlen <= 4) {
+            *timeout_ms = 0;
+            for (uint8_t i = tlen; i > 0; i--) *timeout_ms = (*timeout_ms << 8) | msg[off + 1 + i];
+        }
+        off = (uint16_t)(off + 2 + tlen);
+    }
+    return end;
+}
+
+
+/* Handle one transport message: a whole frame, or one entry of a batch.
+   out collects replies that should travel back in one batch frame;
+   priority is the RPC_PRIO_* the request came with, expires_us when its
+   caller stops waiting (0: not known). */
+static void handle_message(rpc_peer_t *peer, const uint8_t *msg, uint16_t len, reply_batch_t *out,
+                           uint8_t priority, int64_t expires_us) {
+    if (len < 1) return;
+
+    if (msg[0] == MSG_TYPE_OPTIONS) {
+        // envelopes do not nest, nor enclose batches
+        uint8_t  inner_prio = RPC_PRIO_NORMAL;
+        uint32_t timeout_ms = 0;
+        const uint16_t off = parse_options(msg, len, &inner_prio, &timeout_ms);
+        if (off == 0 || off >= len || msg[off] == MSG_TYPE_OPTIONS || msg[off] == MSG_TYPE_BATCH) return;
+        // the caller's clock started before ours, so this errs on the late side
+        const int64_t expires = (timeout_ms > 0) ? esp_timer_get_time() + (int64_t)timeout_ms * 1000 : 0;
+        handle_message(peer, &msg[off], (uint16_t)(len - off), out, inner_prio, expires);
+        return;
+    }
+
+    uint8_t  type;
+    uint16_t id;
+    uint8_t  mflags;
+    uint16_t hdr_len = get_header(msg, len, &type, &id, &mflags);
+    if (hdr_len == 0) return;
+    mflags |= (uint8_t)(priority & MFLAG_PRIO_MASK);
+
+    switch (type) {
+    case MSG_TYPE_REQUEST:
+    case MSG_TYPE_STREAM: {
+        /* parse request: [type][id][name ASCIIZ][args...]
+           Streams carry the sender's sequence in the ID byte and are
+           never answered, not even with an error. */
+        const bool reply = (type == MSG_TYPE_REQUEST);
+        if (!reply) stream_track(peer, (uint8_t)id);
+
+        if (len <= hdr_len) {
+            if (reply) send_error_response(peer, out, id, mflags, ERR_INTERNAL);
+            else       stream_drop(peer);
+            break;
+        }
+
+        // scan for terminating zero of the function name, hashing as we go
+        uint16_t i = hdr_len;
+        uint32_t hash = NAME_HASH_INIT;
+        while (i < len && msg[i] != 0x00) {
+            hash = name_hash_step(hash, msg[i]);
+            i++;
+        }
+        if (i >= len || i - hdr_len > CONFIG_RPC_MAX_NAME_LEN) {
+            // no terminator found, or a name no entry can match
+            if (reply) send_error_response(peer, out, id, mflags, (i >= len) ? ERR_INTERNAL : ERR_FUNC_NOT_FOUND);
+            else       stream_drop(peer);
+            break;
+        }
+
+        uint8_t     name_len    = (uint8_t)(i - hdr_len);
+        const char *name        = (const char *)&msg[hdr_len];
+        uint16_t    args_offset = (uint16_t)(i + 1);
+        uint16_t    args_len    = (args_offset <= len) ? (uint16_t)(len - args_offset) : 0;
+        const uint8_t *args     = (args_len > 0) ? &msg[args_offset] : NULL;
+
+        // lookup the registered callback and run or queue it
+        rpc_entry_t *entry = find_function(name, name_len, hash);
+        if (!entry) {
+            if (reply) send_error_response(peer, out, id, mflags, ERR_FUNC_NOT_FOUND);
+            else       stream_drop(peer);
+            break;
+        }
+
+        if (!dispatch_payload(peer, out, entry, id, mflags, reply, args, args_len, expires_us) && !reply) {
+            stream_drop(peer);
+        }
+        break;
+    }
+
+    case MSG_TYPE_REQUEST_ID: {
+        // parse compact request: [type][id][func_lo][func_hi][args...]
+        if (len < hdr_len + 2) {
+            send_error_response(peer, out, id, mflags, ERR_INTERNAL);
+            break;
+        }
+
+        uint16_t func_id   = (uint16_t)msg[hdr_len] | ((uint16_t)msg[hdr_len + 1] << 8);
+        uint16_t args_len  = (uint16_t)(len - hdr_len - 2);
+        const uint8_t *args = (args_len > 0) ? &msg[hdr_len + 2] : NULL;
+
+        rpc_entry_t *entry = find_function_id(func_id);
+        if (!entry) {
+            send_error_response(peer, out, id, mflags, ERR_FUNC_NOT_FOUND);
+            break;
+        }
+
+        (void)dispatch_payload(peer, out, entry, id, mflags, true, args, args_len, expires_us);
+        break;
+    }
+
+    case MSG_TYPE_RESPONSE:
+    case MSG_TYPE_ERROR: {
+        // deliver the result/error to the waiting caller (if any)
+        const bool wide = (mflags & MSG_FLAG_WIDE_ID) != 0;
+        const uint8_t *data = &msg[hdr_len];
+        uint16_t data_len = (uint16_t)(len - hdr_len);
+
+        if (type == MSG_TYPE_ERROR) {
+            // error payload carries a single byte: error_code
+            complete_call(peer, id, wide, (data_len > 0) ? data[0] : ERR_INTERNAL, NULL, 0);
+        } else if (mflags & MSG_FLAG_COMPRESSED) {
+            uint8_t err = 0;
+            uint8_t *raw = expand_payload(data, data_len, &data_len, &err);
+            complete_call(peer, id, wide, raw ? 0 : err, raw, raw ? data_len : 0);
+            rpc_pool_free(raw);
+        } else {
+            // response payload follows the header
+            complete_call(peer, id, wide, 0, data, data_len);
+        }
+        break;
+    }
+
+    case MSG_TYPE_CANCEL: {
+        // [type][id][id...]: drop these requests, or leave them unanswered
+        const bool wide = (mflags & MSG_FLAG_WIDE_ID) != 0;
+        const uint16_t step = wide ? 2 : 1;
+        for (uint16_t off = 1; off + step <= len; off = (uint16_t)(off + step)) {
+            const uint16_t cid = wide ? (uint16_t)(msg[off] | ((uint16_t)msg[off + 1] << 8)) : msg[off];
+            cancel_jobs(peer, cid, wide);
+        }
+        break;
+    }
+
+    case MSG_TYPE_BATCH:
+        // [type][count]([len LE16][message])...; handled by the caller
+    case MSG_TYPE_OPTIONS:
+        // unwrapped above
+    default:
+        // unknown type: ignore and continue
+        break;
+    }
+}
+
+
+/* Handle a MSG_TYPE_BATCH frame: [type][count]([len LE16][message])...
+   Replies from inline handlers are collected and sent back as one batch;
+   deferred handlers answer on their own when they finish. */
+static void handle_batch(rpc_peer_t *peer, const uint8_t *frame, uint16_t len, reply_batch_t *out) {
+    uint8_t  count = frame[1];
+    uint16_t off   = 2;
+
+    for (uint8_t n = 0; n < count && off + 2 <= len; n++) {
+        uint16_t sub_len = (uint16_t)frame[off] | ((uint16_t)frame[off + 1] << 8);
+        off = (uint16_t)(off + 2);
+        if (sub_len > len - off) break; // truncated entry
+        if (sub_len >= 1 && frame[off] != MSG_TYPE_BATCH) {
+            handle_message(peer, &frame[off], sub_len, out, RPC_PRIO_NORMAL, 0);
+        }
+        off = (uint16_t)(off + sub_len);
+    }
+    flush_reply_batch(peer, out);
+}
+
+
+// RX task: continuously receives link-layer frames and dispatches them
+static void transport_receiver_task(void *arg) {
+    rpc_peer_t *peer = (rpc_peer_t *)arg;
+
+    // Wait for transport_attach() to claim the link; another caller may have served it first
+    (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (rpc_link_get_context(peer->link) != peer) {
+        peer_free(peer);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    // Sized from Kconfig and kept off the task stack
+    uint8_t  *rx_buffer = (uint8_t *)pvPortMalloc(CONFIG_RPC_RX_FRAME_SIZE);
+    uint16_t  rx_len;
+
+    // Collector for replies to incoming batches
+    reply_batch_t replies = {
+        .buf = (uint8_t *)pvPortMalloc(CONFIG_RPC_BATCH_REPLY_SIZE),
+        .cap = CONFIG_RPC_BATCH_REPLY_SIZE,
+    };
+    peer->rx_resp_buf = (uint8_t *)pvPortMalloc(CONFIG_RPC_RESP_BUFFER_SIZE);
+
+    if (!rx_buffer || !replies.buf) {
+        vPortFree(rx_buffer);
+        vPortFree(replies.buf);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    for (;;) {
+        // wait for the next complete link-layer frame
+        int rc = rpc_link_receive_frame(peer->link, rx_buffer, CONFIG_RPC_RX_FRAME_SIZE, &rx_len);
+        if (rc == -4) {
+            reject_oversize(peer, rx_buffer);
+            continue;
+        }
+        if (rc != 0) continue;
+        if (rx_len < 2) continue;
+
+        if (rx_buffer[0] == MSG_TYPE_BATCH) handle_batch(peer, rx_buffer, rx_len, &replies);
+        else                                handle_message(peer, rx_buffer, rx_len, NULL, RPC_PRIO_NORMAL, 0);
     }
     // unreachable
 }